@@ -21,11 +21,64 @@
  */
 
 #include "stateMachine.h"
+#include "stateMachineCompile.h"
+#include "stateMachineBroadcast.h"
+#include "stateMachineLayout.h"
+#include <limits.h>
+#include <string.h>
 
 static void goToErrorState( struct stateMachine *stateMachine,
       struct event *const event );
 static struct transition *getTransition( struct stateMachine *stateMachine,
+      struct state *state, struct event *const event,
+      struct guardMemo *memo );
+static int dispatchEvent( struct stateMachine *stateMachine,
+      struct event *event );
+static int recallDeferredEvents( struct stateMachine *stateMachine, int ret,
+      struct event *deferred );
+static int completeEvent( struct stateMachine *stateMachine,
+      struct event *event, int ret );
+static int handleSingleEvent( struct stateMachine *stateMachine,
+      struct event *event );
+static int dispatchQueuedEvents( struct stateMachine *stateMachine,
+      int ret );
+static bool popEvent( struct stateMachine *stateMachine,
+      struct event *event );
+static void clearEventQueue( struct stateMachine *stateMachine );
+static int handleCompiledEvent( struct stateMachine *stateMachine,
+      struct event *event, struct guardMemo *memo );
+static int takeTransition( struct stateMachine *stateMachine,
+      struct transition *transition, struct state *source,
+      struct event *event );
+static int changeRegionState( struct stateMachine *stateMachine,
+      struct transition *transition, size_t region, struct state *nextState,
+      struct event *event );
+static struct state *entryLeaf( struct stateMachine *stateMachine,
+      struct state *state );
+static void recordHistory( struct stateMachine *stateMachine,
+      struct state *state, struct state *outermostState );
+static struct state *regionOwner( struct state *state, size_t *region );
+static void setRegions( struct stateMachine *stateMachine,
+      struct state *orthogonalState, struct state *regionState,
+      size_t region );
+static void setRegionState( struct stateMachine *stateMachine,
+      size_t region, struct state *state );
+static void enterRegions( struct stateMachine *stateMachine,
+      struct state *orthogonalState, struct event *event );
+static void exitRegions( struct stateMachine *stateMachine,
+      struct event *event );
+static unsigned long eventBit( int eventType );
+static bool isDeferred( struct stateMachine *stateMachine,
       struct state *state, struct event *const event );
+static struct state *parentOf( struct stateMachine *stateMachine,
+      struct state *state );
+static struct hotState *hotState( struct stateMachine *stateMachine,
+      struct state *state );
+static uint64_t hotEventBit( int eventType );
+static int deferEvent( struct stateMachine *stateMachine,
+      struct event *const event );
+static bool popDeferredEvent( struct stateMachine *stateMachine,
+      struct event *event );
 
 void stateM_init( struct stateMachine *fsm,
       struct state *initialState, struct state *errorState )
@@ -35,7 +88,53 @@ void stateM_init( struct stateMachine *fsm,
 
    fsm->currentState = initialState;
    fsm->previousState = NULL;
+   fsm->definition = NULL;
+   fsm->verified = false;
+   fsm->compiled = NULL;
+   fsm->relocated = NULL;
+   fsm->group = NULL;
+   fsm->groupNext = NULL;
+   fsm->groupPrevious = NULL;
+   memset( fsm->history, 0, sizeof( fsm->history ) );
+
+   /* If the initial state belongs to an orthogonal region, the state owning
+    * the region is the current state. The other regions start in their
+    * entry states: */
+   if ( initialState )
+   {
+      size_t region = 0;
+      struct state *orthogonalState = regionOwner( initialState, &region );
+      if ( orthogonalState )
+         fsm->currentState = orthogonalState;
+
+      /* Leave the current state undefined (so that the error state is
+       * entered by stateM_handleEvent()) if there are too many regions: */
+      if ( fsm->currentState->numRegions > STATEM_MAX_REGIONS )
+         fsm->currentState = NULL;
+      else
+         setRegions( fsm, fsm->currentState, orthogonalState ? initialState
+               : NULL, region );
+   }
+
    fsm->errorState = errorState;
+   clearEventQueue( fsm );
+   fsm->overflowPolicy = stateM_overflowReject;
+   fsm->handlingEvent = false;
+   fsm->queueOverflowed = false;
+   fsm->numPendingActions = 0;
+   fsm->deferQueueHead = 0;
+   fsm->numDeferredEvents = 0;
+}
+
+void stateM_initWithDefinition( struct stateMachine *fsm,
+      struct stateMachineDefinition *definition )
+{
+   if ( !fsm || !definition )
+      return;
+
+   stateM_init( fsm, definition->initialState, definition->errorState );
+   fsm->definition = definition;
+   fsm->verified = definition->verified;
 }
 
 int stateM_handleEvent( struct stateMachine *fsm,
@@ -44,78 +143,515 @@ int stateM_handleEvent( struct stateMachine *fsm,
    if ( !fsm || !event )
       return stateM_errArg;
 
-   if ( !fsm->currentState )
+   /* An action is passing an event to its own state machine. Handling it
+    * now would corrupt the ongoing transition, so queue it instead: */
+   if ( fsm->handlingEvent )
+      return stateM_postEvent( fsm, event ) ? stateM_noStateChange :
+         stateM_errArg;
+
+   /* An asynchronous action has not completed yet. The event is handled
+    * when it has: */
+   if ( fsm->numPendingActions )
+      return stateM_postEvent( fsm, event ) ? stateM_actionPending :
+         stateM_errArg;
+
+   fsm->handlingEvent = true;
+
+   /* Events posted while the state machine was idle are older than the
+    * given event: */
+   int ret = dispatchQueuedEvents( fsm, stateM_noStateChange );
+   bool wait = ret != stateM_errorStateReached && fsm->numPendingActions;
+   if ( ret != stateM_errorStateReached && !wait )
+   {
+      int eventRet = dispatchEvent( fsm, event );
+      if ( eventRet != stateM_noStateChange )
+         ret = eventRet;
+
+      ret = dispatchQueuedEvents( fsm, ret );
+   }
+
+   fsm->handlingEvent = false;
+
+   /* One of the queued events started an asynchronous action: */
+   if ( wait )
+      return stateM_postEvent( fsm, event ) ? stateM_actionPending :
+         stateM_errArg;
+
+   return ret;
+}
+
+void stateM_suspend( struct stateMachine *fsm )
+{
+   if ( !fsm )
+      return;
+
+   ++fsm->numPendingActions;
+}
+
+int stateM_resume( struct stateMachine *fsm )
+{
+   if ( !fsm || !fsm->numPendingActions )
+      return stateM_errArg;
+
+   if ( --fsm->numPendingActions )
+      return stateM_actionPending;
+
+   /* The action completed before the transition that started it did. The
+    * queued events are handled by the ongoing stateM_handleEvent(): */
+   if ( fsm->handlingEvent )
+      return stateM_noStateChange;
+
+   /* The state may have changed since the events were deferred. If an
+    * action overflows the queue, the error state is entered with the last
+    * event recalled (or an empty event if none were): */
+   struct event deferred = { 0 };
+   fsm->handlingEvent = true;
+   int ret = recallDeferredEvents( fsm, stateM_noStateChange, &deferred );
+   ret = completeEvent( fsm, &deferred, ret );
+   ret = dispatchQueuedEvents( fsm, ret );
+   fsm->handlingEvent = false;
+
+   return ret;
+}
+
+bool stateM_actionsPending( struct stateMachine *fsm )
+{
+   return fsm && fsm->numPendingActions;
+}
+
+bool stateM_postEvent( struct stateMachine *fsm, struct event *event )
+{
+   return stateM_postPriorityEvent( fsm, event, 0, false );
+}
+
+bool stateM_postPriorityEvent( struct stateMachine *fsm,
+      struct event *event, unsigned priority, bool coalesce )
+{
+   if ( !fsm || !event || priority >= STATEM_NUM_PRIORITIES )
+      return false;
+
+   /* The queue is sorted by priority, so the events of a given priority are
+    * found after all the events of higher priority: */
+   size_t first = 0;
+   unsigned p;
+   for ( p = priority + 1; p < STATEM_NUM_PRIORITIES; ++p )
+      first += fsm->numQueuedByPriority[ p ];
+
+   size_t end = first + fsm->numQueuedByPriority[ priority ];
+
+   if ( coalesce )
+   {
+      size_t i;
+      for ( i = first; i < end; ++i )
+      {
+         if ( fsm->eventQueue[ i ].type == event->type )
+         {
+            fsm->eventQueue[ i ].data = event->data;
+            return true;
+         }
+      }
+   }
+
+   if ( fsm->numQueuedEvents == STATEM_EVENTQUEUE_SIZE )
+   {
+      /* Find the lowest priority that has queued events: */
+      unsigned lowest = 0;
+      while ( !fsm->numQueuedByPriority[ lowest ] )
+         ++lowest;
+
+      /* Make room for the event by discarding the oldest of the events with
+       * the lowest priority if the new event is more important (or as
+       * important and the policy says to drop old events): */
+      if ( lowest < priority || ( lowest == priority &&
+               fsm->overflowPolicy == stateM_overflowDropOldest ) )
+      {
+         size_t victim = fsm->numQueuedEvents - fsm->numQueuedByPriority[
+            lowest ];
+         memmove( &fsm->eventQueue[ victim ], &fsm->eventQueue[ victim + 1 ],
+               ( fsm->numQueuedEvents - victim - 1 ) * sizeof(
+                  fsm->eventQueue[ 0 ] ) );
+         --fsm->numQueuedByPriority[ lowest ];
+         --fsm->numQueuedEvents;
+         if ( lowest == priority )
+            --end;
+      }
+      else if ( fsm->overflowPolicy == stateM_overflowErrorState )
+      {
+         /* Do not interrupt a transition in progress. The error state is
+          * entered once the transition has completed: */
+         if ( fsm->handlingEvent )
+            fsm->queueOverflowed = true;
+         else
+         {
+            clearEventQueue( fsm );
+            goToErrorState( fsm, event );
+         }
+         return false;
+      }
+      else
+         return false;
+   }
+
+   memmove( &fsm->eventQueue[ end + 1 ], &fsm->eventQueue[ end ],
+         ( fsm->numQueuedEvents - end ) * sizeof( fsm->eventQueue[ 0 ] ) );
+   fsm->eventQueue[ end ] = *event;
+   ++fsm->numQueuedByPriority[ priority ];
+   ++fsm->numQueuedEvents;
+
+   return true;
+}
+
+void stateM_setOverflowPolicy( struct stateMachine *fsm,
+      enum stateM_overflowPolicies policy )
+{
+   if ( !fsm )
+      return;
+
+   fsm->overflowPolicy = policy;
+}
+
+static int dispatchEvent( struct stateMachine *fsm,
+      struct event *event )
+{
+   int ret = handleSingleEvent( fsm, event );
+   struct event deferred;
+
+   /* Give the deferred events another chance every time the state
+    * changes: */
+   if ( ret == stateM_stateChanged )
+      ret = recallDeferredEvents( fsm, ret, &deferred );
+
+   return completeEvent( fsm, event, ret );
+}
+
+static int recallDeferredEvents( struct stateMachine *fsm, int ret,
+      struct event *deferred )
+{
+   /* Events deferred once more are put back at the end of the queue, so
+    * every event is tried at most once per state change: */
+   size_t numRecalls = fsm->numDeferredEvents;
+   while ( numRecalls-- && !fsm->queueOverflowed &&
+         !fsm->numPendingActions && popDeferredEvent( fsm, deferred ) )
+   {
+      int recallRet = handleSingleEvent( fsm, deferred );
+      if ( recallRet == stateM_stateChanged )
+         numRecalls = fsm->numDeferredEvents;
+      else if ( recallRet == stateM_errorStateReached ||
+            recallRet == stateM_finalStateReached )
+         numRecalls = 0;
+
+      if ( recallRet != stateM_noStateChange &&
+            recallRet != stateM_eventDeferred )
+         ret = recallRet;
+   }
+
+   return ret;
+}
+
+static int completeEvent( struct stateMachine *fsm, struct event *event,
+      int ret )
+{
+   /* A queue overflowed while running the actions for this event: */
+   if ( fsm->queueOverflowed )
+   {
+      fsm->queueOverflowed = false;
+      goToErrorState( fsm, event );
+      ret = stateM_errorStateReached;
+   }
+
+   /* There is no point in handling the rest of the queued events once the
+    * error state has been reached: */
+   if ( ret == stateM_errorStateReached )
+   {
+      clearEventQueue( fsm );
+      fsm->numDeferredEvents = 0;
+   }
+
+   return ret;
+}
+
+static int handleSingleEvent( struct stateMachine *fsm,
+      struct event *event )
+{
+   /* A validated state machine cannot end up without a current state: */
+   if ( !fsm->verified && !fsm->currentState )
    {
       goToErrorState( fsm, event );
       return stateM_errorStateReached;
    }
 
-   if ( !fsm->currentState->numTransitions )
+   if ( !fsm->currentState->numTransitions &&
+         !fsm->currentState->numRegions )
       return stateM_noStateChange;
 
+   struct state *orthogonalState = fsm->currentState;
+   int ret = stateM_noStateChange;
+   size_t i;
+
+   /* Pure guards are only called once for this event. Only the number of
+    * entries needs to be initialised: */
+   struct guardMemo memo;
+   memo.numEntries = 0;
+
+   /* If the current state has orthogonal regions, pass the event to the
+    * active state in every region. Regions without any transitions for the
+    * event's type are skipped without looking at their states: */
+   for ( i = 0; i < orthogonalState->numRegions; ++i )
+   {
+      if ( !( fsm->regionEventMasks[ i ] & eventBit( event->type ) ) )
+         continue;
+
+      struct transition *transition = NULL;
+      if ( fsm->compiled )
+      {
+         /* Walk the region state's ancestor array backwards, stopping at
+          * the orthogonal state: */
+         const struct compiledState *compiled = &fsm->compiled->states[
+            fsm->regionStates[ i ]->id ];
+         size_t outermost = fsm->compiled->states[ orthogonalState->id ].depth
+            + 1;
+         size_t depth = compiled->depth + 1;
+
+         while ( !transition && depth-- > outermost )
+            transition = getTransition( fsm, fsm->compiled->definition->states[
+                  compiled->ancestors[ depth ] ], event, &memo );
+      }
+      else
+      {
+         struct state *state;
+         for ( state = fsm->regionStates[ i ]; !transition && state !=
+               orthogonalState; state = state->parentState )
+            transition = getTransition( fsm, state, event, &memo );
+      }
+
+      if ( !transition )
+         continue;
+
+      int regionRet = takeTransition( fsm, transition,
+            fsm->regionStates[ i ], event );
+
+      /* The transition left the orthogonal state. The remaining regions are
+       * no longer active: */
+      if ( fsm->currentState != orthogonalState )
+         return regionRet;
+
+      if ( ret == stateM_noStateChange || regionRet == stateM_stateChanged )
+         ret = regionRet;
+   }
+
+   if ( ret != stateM_noStateChange )
+      return ret;
+
+   if ( fsm->compiled )
+      return handleCompiledEvent( fsm, event, &memo );
+
    struct state *nextState = fsm->currentState;
    do {
-      struct transition *transition = getTransition( fsm, nextState, event );
+      struct transition *transition = getTransition( fsm, nextState, event,
+            &memo );
 
       /* If there were no transitions for the given event for the current
        * state, check if there are any transitions for any of the parent
        * states (if any): */
       if ( !transition )
       {
-         nextState = nextState->parentState;
+         /* Keep the event instead of handing it to the parent if the state
+          * defers it: */
+         if ( isDeferred( fsm, nextState, event ) )
+            return deferEvent( fsm, event );
+
+         nextState = parentOf( fsm, nextState );
          continue;
       }
 
-      /* A transition must have a next state defined. If the user has not
-       * defined the next state, go to error state: */
-      if ( !transition->nextState )
-      {
-         goToErrorState( fsm, event );
-         return stateM_errorStateReached;
-      }
+      return takeTransition( fsm, transition, fsm->currentState, event );
+   } while ( nextState );
+
+   return stateM_noStateChange;
+}
+
+static int handleCompiledEvent( struct stateMachine *fsm,
+      struct event *event, struct guardMemo *memo )
+{
+   const struct compiledState *compiled = &fsm->compiled->states[
+      fsm->currentState->id ];
+   struct state **states = fsm->compiled->definition->states;
+   size_t depth = compiled->depth + 1;
+
+   /* Try the current state and then its parents, innermost first, by
+    * walking its ancestor array backwards: */
+   while ( depth-- )
+   {
+      struct state *state = states[ compiled->ancestors[ depth ] ];
+      struct transition *transition = stateM_compiledTransition(
+            fsm->compiled, state, event, memo );
+
+      if ( transition )
+         return takeTransition( fsm, transition, fsm->currentState, event );
+
+      /* Keep the event instead of handing it to the parent if the state
+       * defers it: */
+      if ( isDeferred( fsm, state, event ) )
+         return deferEvent( fsm, event );
+   }
 
-      nextState = transition->nextState;
+   return stateM_noStateChange;
+}
+
+static int takeTransition( struct stateMachine *fsm,
+      struct transition *transition, struct state *source,
+      struct event *event )
+{
+   /* A transition must have a next state defined. If the user has not
+    * defined the next state, go to error state (this has already been
+    * checked if the state machine is validated): */
+   if ( !fsm->verified && !transition->nextState )
+   {
+      goToErrorState( fsm, event );
+      return stateM_errorStateReached;
+   }
 
-      /* If the new state is a parent state, enter its entry state (if it has
-       * one). Step down through the whole family tree until a state without
-       * an entry state is found: */
-      while ( nextState->entryState )
-         nextState = nextState->entryState;
+   struct state *nextState = entryLeaf( fsm, transition->nextState );
 
-      /* Run exit action only if the current state is left (only if it does
-       * not return to itself): */
-      if ( nextState != fsm->currentState && fsm->currentState->exitAction )
+   /* If the new state belongs to an orthogonal region, the state owning the
+    * region becomes the current state: */
+   size_t region = 0;
+   struct state *orthogonalState = regionOwner( nextState, &region );
+
+   /* Only the active state of a region changes if the orthogonal state is
+    * not left: */
+   if ( orthogonalState && orthogonalState == fsm->currentState )
+      return changeRegionState( fsm, transition, region, nextState, event );
+
+   struct state *newState = orthogonalState ? orthogonalState : nextState;
+   if ( !fsm->verified && newState->numRegions > STATEM_MAX_REGIONS )
+   {
+      goToErrorState( fsm, event );
+      return stateM_errorStateReached;
+   }
+
+   /* Run exit actions only if the current state is left (only if it does
+    * not return to itself). The active states in any regions are left
+    * first: */
+   if ( newState != fsm->currentState )
+   {
+      exitRegions( fsm, event );
+      recordHistory( fsm, fsm->currentState, NULL );
+      if ( fsm->currentState->exitAction )
          fsm->currentState->exitAction( fsm->currentState->data, event );
+   }
 
-      /* Run transition action (if any): */
-      if ( transition->action )
-         transition->action( fsm->currentState->data, event, nextState->
-               data );
+   /* Run transition action (if any): */
+   if ( transition->action )
+      transition->action( source->data, event, nextState->data );
 
-      /* Call the new state's entry action if it has any (only if state does
-       * not return to itself): */
-      if ( nextState != fsm->currentState && nextState->entryAction )
-         nextState->entryAction( nextState->data, event );
+   /* Call the new state's entry action if it has any (only if state does
+    * not return to itself). The regions' states are entered afterwards: */
+   if ( newState != fsm->currentState )
+   {
+      if ( newState->entryAction )
+         newState->entryAction( newState->data, event );
 
-      fsm->previousState = fsm->currentState;
-      fsm->currentState = nextState;
-      
-      /* If the state returned to itself: */
-      if ( fsm->currentState == fsm->previousState )
-         return stateM_stateLoopSelf;
+      setRegions( fsm, newState, orthogonalState ? nextState : NULL,
+            region );
+      enterRegions( fsm, newState, event );
+   }
 
-      if ( fsm->currentState == fsm->errorState )
-         return stateM_errorStateReached;
+   fsm->previousState = fsm->currentState;
+   fsm->currentState = newState;
+   if ( fsm->group )
+      stateM_groupStateChanged( fsm, fsm->previousState );
 
-      /* If the new state is a final state, notify user that the state
-       * machine has stopped: */
-      if ( !fsm->currentState->numTransitions )
-         return stateM_finalStateReached;
+   /* If the state returned to itself: */
+   if ( fsm->currentState == fsm->previousState )
+      return stateM_stateLoopSelf;
 
-      return stateM_stateChanged;
-   } while ( nextState );
+   if ( fsm->currentState == fsm->errorState )
+      return stateM_errorStateReached;
 
-   return stateM_noStateChange;
+   /* If the new state is a final state, notify user that the state
+    * machine has stopped: */
+   if ( !fsm->currentState->numTransitions &&
+         !fsm->currentState->numRegions )
+      return stateM_finalStateReached;
+
+   return stateM_stateChanged;
+}
+
+static int changeRegionState( struct stateMachine *fsm,
+      struct transition *transition, size_t region, struct state *nextState,
+      struct event *event )
+{
+   struct state *oldState = fsm->regionStates[ region ];
+
+   if ( nextState != oldState )
+   {
+      recordHistory( fsm, oldState, fsm->currentState );
+      if ( oldState->exitAction )
+         oldState->exitAction( oldState->data, event );
+   }
+
+   if ( transition->action )
+      transition->action( oldState->data, event, nextState->data );
+
+   if ( nextState != oldState && nextState->entryAction )
+      nextState->entryAction( nextState->data, event );
+
+   setRegionState( fsm, region, nextState );
+
+   return nextState == oldState ? stateM_stateLoopSelf :
+      stateM_stateChanged;
+}
+
+bool stateM_guardHolds( struct transition *transition, struct event *event,
+      struct guardMemo *memo )
+{
+   intptr_t value = (intptr_t)event->data;
+   size_t i;
+
+   switch ( transition->guardKind )
+   {
+      case stateM_guardEquals:
+         return value == (intptr_t)transition->condition;
+
+      case stateM_guardRange:
+         {
+            struct guardRange *range = transition->condition;
+            return value >= range->first && value <= range->last;
+         }
+
+      case stateM_guardSet:
+         {
+            struct guardSet *set = transition->condition;
+            return value >= 0 && value < 256 && ( set->members[ value / 8 ]
+                  >> ( value % 8 ) & 1 );
+         }
+
+      default:
+         if ( !transition->guard )
+            return true;
+
+         if ( !memo || !transition->pureGuard )
+            return transition->guard( transition->condition, event );
+
+         for ( i = 0; i < memo->numEntries; ++i )
+            if ( memo->entries[ i ].guard == transition->guard &&
+                  memo->entries[ i ].condition == transition->condition )
+               return memo->entries[ i ].result;
+
+         bool result = transition->guard( transition->condition, event );
+
+         if ( memo->numEntries < STATEM_GUARD_MEMO_SIZE )
+         {
+            memo->entries[ memo->numEntries ].guard = transition->guard;
+            memo->entries[ memo->numEntries ].condition =
+               transition->condition;
+            memo->entries[ memo->numEntries ].result = result;
+            ++memo->numEntries;
+         }
+
+         return result;
+   }
 }
 
 struct state *stateM_currentState( struct stateMachine *fsm )
@@ -140,39 +676,328 @@ static void goToErrorState( struct stateMachine *fsm,
 {
    fsm->previousState = fsm->currentState;
    fsm->currentState = fsm->errorState;
+   if ( fsm->group )
+      stateM_groupStateChanged( fsm, fsm->previousState );
 
    if ( fsm->currentState && fsm->currentState->entryAction )
       fsm->currentState->entryAction( fsm->currentState->data, event );
 }
 
-static struct transition *getTransition( struct stateMachine *fsm,
-      struct state *state, struct event *const event )
+static int dispatchQueuedEvents( struct stateMachine *fsm, int ret )
+{
+   struct event event;
+
+   while ( ret != stateM_errorStateReached && !fsm->numPendingActions &&
+         popEvent( fsm, &event ) )
+   {
+      int eventRet = dispatchEvent( fsm, &event );
+      if ( eventRet != stateM_noStateChange )
+         ret = eventRet;
+   }
+
+   return ret;
+}
+
+static bool popEvent( struct stateMachine *fsm, struct event *event )
+{
+   if ( !fsm->numQueuedEvents )
+      return false;
+
+   /* The first event belongs to the highest priority with queued events: */
+   unsigned priority = STATEM_NUM_PRIORITIES - 1;
+   while ( !fsm->numQueuedByPriority[ priority ] )
+      --priority;
+
+   *event = fsm->eventQueue[ 0 ];
+   --fsm->numQueuedEvents;
+   --fsm->numQueuedByPriority[ priority ];
+   memmove( &fsm->eventQueue[ 0 ], &fsm->eventQueue[ 1 ],
+         fsm->numQueuedEvents * sizeof( fsm->eventQueue[ 0 ] ) );
+
+   return true;
+}
+
+static void clearEventQueue( struct stateMachine *fsm )
+{
+   fsm->numQueuedEvents = 0;
+   memset( fsm->numQueuedByPriority, 0, sizeof( fsm->numQueuedByPriority ) );
+}
+
+struct state *stateM_regionState( struct stateMachine *fsm, size_t region )
+{
+   if ( !fsm || !fsm->currentState || region >=
+         fsm->currentState->numRegions )
+      return NULL;
+
+   return fsm->regionStates[ region ];
+}
+
+static struct state *entryLeaf( struct stateMachine *fsm,
+      struct state *state )
+{
+   /* If the state is a parent state, enter its entry state (if it has one).
+    * Step down through the whole family tree until a state without an entry
+    * state is found. History pseudo-states are replaced by the state
+    * recorded for their parent: */
+   for ( ;; )
+   {
+      if ( state->historyType != stateM_noHistory )
+      {
+         struct state *parent = state->parentState;
+         struct state *last = NULL;
+
+         if ( parent->historySlot && parent->historySlot <=
+               STATEM_HISTORY_SLOTS )
+            last = fsm->history[ parent->historySlot - 1 ];
+
+         /* Without any history, use the pseudo-state's default state, or
+          * stay in the parent (without following its entry state, which
+          * may well be the pseudo-state): */
+         if ( !last )
+         {
+            if ( !state->entryState )
+               return parent;
+
+            state = state->entryState;
+            continue;
+         }
+
+         /* Shallow history only restores the parent's direct child. Its
+          * entry states are followed as usual: */
+         if ( state->historyType == stateM_shallowHistory )
+            while ( last->parentState != parent )
+               last = last->parentState;
+
+         state = last;
+      }
+      else if ( state->entryState )
+         state = state->entryState;
+      else
+         return state;
+   }
+}
+
+static void recordHistory( struct stateMachine *fsm, struct state *state,
+      struct state *outermostState )
+{
+   struct state *parent;
+
+   /* Remember the state being left in all its parents (up to, but not
+    * including, outermostState) that record their history. Parents that
+    * are not left now will have their history overwritten when they are: */
+   for ( parent = state->parentState; parent != outermostState; parent =
+         parent->parentState )
+      if ( parent->historySlot && parent->historySlot <=
+            STATEM_HISTORY_SLOTS )
+         fsm->history[ parent->historySlot - 1 ] = state;
+}
+
+static struct state *regionOwner( struct state *state, size_t *region )
+{
+   for ( ; state->parentState; state = state->parentState )
+   {
+      struct state *parent = state->parentState;
+      size_t i;
+
+      for ( i = 0; i < parent->numRegions; ++i )
+      {
+         if ( parent->regions[ i ] == state )
+         {
+            *region = i;
+            return parent;
+         }
+      }
+   }
+
+   return NULL;
+}
+
+static void setRegions( struct stateMachine *fsm,
+      struct state *orthogonalState, struct state *regionState,
+      size_t region )
 {
    size_t i;
 
-   for ( i = 0; i < state->numTransitions; ++i )
+   for ( i = 0; i < orthogonalState->numRegions; ++i )
+      setRegionState( fsm, i, regionState && i == region ? regionState :
+            entryLeaf( fsm, orthogonalState->regions[ i ] ) );
+}
+
+static void setRegionState( struct stateMachine *fsm, size_t region,
+      struct state *state )
+{
+   struct state *orthogonalState = state;
+   unsigned long mask = 0;
+   size_t i;
+
+   /* Record the event types handled by the state and its parents within the
+    * region, so that the region can be skipped for all other events: */
+   while ( !orthogonalState->numRegions )
+   {
+      for ( i = 0; i < orthogonalState->numTransitions; ++i )
+         mask |= eventBit( orthogonalState->transitions[ i ].eventType );
+
+      orthogonalState = orthogonalState->parentState;
+   }
+
+   fsm->regionStates[ region ] = state;
+   fsm->regionEventMasks[ region ] = mask;
+}
+
+static void enterRegions( struct stateMachine *fsm,
+      struct state *orthogonalState, struct event *event )
+{
+   size_t i;
+
+   for ( i = 0; i < orthogonalState->numRegions; ++i )
+   {
+      struct state *state = fsm->regionStates[ i ];
+      if ( state->entryAction )
+         state->entryAction( state->data, event );
+   }
+}
+
+static void exitRegions( struct stateMachine *fsm, struct event *event )
+{
+   size_t i;
+
+   for ( i = 0; i < fsm->currentState->numRegions; ++i )
    {
-      struct transition *t = &state->transitions[ i ];
+      struct state *state = fsm->regionStates[ i ];
+      recordHistory( fsm, state, fsm->currentState );
+      if ( state->exitAction )
+         state->exitAction( state->data, event );
+   }
+}
+
+static unsigned long eventBit( int eventType )
+{
+   return 1UL << ( (unsigned)eventType % ( sizeof( unsigned long ) *
+            CHAR_BIT ) );
+}
+
+static bool isDeferred( struct stateMachine *fsm, struct state *state,
+      struct event *const event )
+{
+   size_t i;
+
+   if ( fsm->relocated && !( hotState( fsm, state )->deferredMask &
+            hotEventBit( event->type ) ) )
+      return false;
+
+   for ( i = 0; i < state->numDeferredEvents; ++i )
+      if ( state->deferredEvents[ i ] == event->type )
+         return true;
+
+   return false;
+}
 
-      /* A transition for the given event has been found: */
-      if ( t->eventType == event->type )
+static int deferEvent( struct stateMachine *fsm, struct event *const event )
+{
+   if ( fsm->numDeferredEvents == STATEM_DEFERQUEUE_SIZE )
+   {
+      switch ( fsm->overflowPolicy )
       {
-         if ( !t->guard )
-            return t;
-         /* If transition is guarded, ensure that the condition is held: */
-         else if ( t->guard( t->condition, event ) )
-            return t;
+         case stateM_overflowDropOldest:
+            fsm->deferQueueHead = ( fsm->deferQueueHead + 1 ) %
+               STATEM_DEFERQUEUE_SIZE;
+            --fsm->numDeferredEvents;
+            break;
+
+         case stateM_overflowErrorState:
+            fsm->queueOverflowed = true;
+            return stateM_noStateChange;
+
+         default:
+            return stateM_noStateChange;
       }
    }
 
+   fsm->deferQueue[ ( fsm->deferQueueHead + fsm->numDeferredEvents ) %
+      STATEM_DEFERQUEUE_SIZE ] = *event;
+   ++fsm->numDeferredEvents;
+
+   return stateM_eventDeferred;
+}
+
+static bool popDeferredEvent( struct stateMachine *fsm, struct event *event )
+{
+   if ( !fsm->numDeferredEvents )
+      return false;
+
+   *event = fsm->deferQueue[ fsm->deferQueueHead ];
+   fsm->deferQueueHead = ( fsm->deferQueueHead + 1 ) %
+      STATEM_DEFERQUEUE_SIZE;
+   --fsm->numDeferredEvents;
+
+   return true;
+}
+
+static struct transition *getTransition( struct stateMachine *fsm,
+      struct state *state, struct event *const event,
+      struct guardMemo *memo )
+{
+   struct transition *transitions = state->transitions;
+   size_t numTransitions = state->numTransitions;
+   size_t i;
+
+   if ( fsm->compiled )
+      return stateM_compiledTransition( fsm->compiled, state, event, memo );
+
+   /* Only look at the transitions if there are any for the event's type: */
+   if ( fsm->relocated )
+   {
+      struct hotState *hot = hotState( fsm, state );
+
+      if ( !( hot->eventMask & hotEventBit( event->type ) ) )
+         return NULL;
+
+      transitions = &fsm->relocated->transitions[ hot->firstTransition ];
+      numTransitions = hot->numTransitions;
+   }
+
+   for ( i = 0; i < numTransitions; ++i )
+   {
+      struct transition *t = &transitions[ i ];
+
+      /* A transition for the given event has been found. If transition is
+       * guarded, ensure that the condition is held: */
+      if ( t->eventType == event->type && stateM_guardHolds( t, event,
+               memo ) )
+         return t;
+   }
+
    /* No transitions found for given event for given state: */
    return NULL;
 }
 
+static struct state *parentOf( struct stateMachine *fsm, struct state *state )
+{
+   if ( !fsm->relocated )
+      return state->parentState;
+
+   uint32_t parent = hotState( fsm, state )->parent;
+   return parent == STATEM_NO_PARENT ? NULL : &fsm->relocated->states[
+      parent ];
+}
+
+static struct hotState *hotState( struct stateMachine *fsm,
+      struct state *state )
+{
+   /* The index is found without reading the state itself: */
+   return &fsm->relocated->hotStates[ state - fsm->relocated->states ];
+}
+
+static uint64_t hotEventBit( int eventType )
+{
+   return (uint64_t)1 << ( (unsigned)eventType % 64 );
+}
+
 bool stateM_stopped( struct stateMachine *stateMachine )
 {
    if ( !stateMachine )
       return true;
 
-   return stateMachine->currentState->numTransitions == 0;
+   return stateMachine->currentState->numTransitions == 0 &&
+      stateMachine->currentState->numRegions == 0;
 }
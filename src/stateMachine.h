@@ -69,6 +69,7 @@
 
 #include <stddef.h>
 #include <stdbool.h>
+#include <stdint.h>
 
 /**
  * \brief Event
@@ -95,6 +96,114 @@ struct event
 };
 
 struct state;
+struct compiledStateMachine;
+struct relocatedStateMachine;
+struct stateMachineGroup;
+
+/**
+ * \brief Kinds of declarative guards
+ *
+ * Instead of calling a \ref transition::guard "guard function", a
+ * transition may compare the incoming event's \ref event::data "payload",
+ * interpreted as an integer (\c (intptr_t)event->data), against its \ref
+ * transition::condition "condition". Declarative guards are evaluated
+ * without calling any functions, and a \ref stateM_compile() "compiled"
+ * state machine can test a whole series of them with a single table lookup.
+ *
+ * \sa transition::guardKind
+ */
+enum stateM_guardKinds
+{
+   /** \brief Call \ref transition::guard "guard", if non-NULL (default) */
+   stateM_guardFunction,
+   /**
+    * \brief The payload must equal the condition, \c (intptr_t)condition
+    */
+   stateM_guardEquals,
+   /**
+    * \brief The payload must be within the \ref guardRange "range" pointed
+    * to by the condition
+    */
+   stateM_guardRange,
+   /**
+    * \brief The payload must be a member of the \ref guardSet "set" pointed
+    * to by the condition
+    */
+   stateM_guardSet,
+};
+
+/**
+ * \brief Number of \ref transition::pureGuard "pure guard" results
+ * remembered while handling an event
+ *
+ * Once the memo is full, further guards are called as usual. This macro may
+ * be defined by the user.
+ */
+#ifndef STATEM_GUARD_MEMO_SIZE
+#define STATEM_GUARD_MEMO_SIZE 8
+#endif
+
+/**
+ * \brief Results of \ref transition::pureGuard "pure guards" evaluated for
+ * an event
+ *
+ * stateM_handleEvent() creates a new, empty memo for every event it
+ * handles.
+ */
+struct guardMemo
+{
+   /** \brief Number of results in #entries */
+   size_t numEntries;
+   /** \brief Remembered results */
+   struct
+   {
+      /** \brief The guard function */
+      bool ( *guard )( void *condition, struct event *event );
+      /** \brief The condition passed to #guard */
+      void *condition;
+      /** \brief What #guard returned */
+      bool result;
+   } entries[ STATEM_GUARD_MEMO_SIZE ];
+};
+
+/**
+ * \brief Condition of a #stateM_guardRange guard
+ */
+struct guardRange
+{
+   /** \brief The smallest value in the range */
+   intptr_t first;
+   /** \brief The largest value in the range */
+   intptr_t last;
+};
+
+/**
+ * \brief Condition of a #stateM_guardSet guard
+ *
+ * The set can hold values from 0 to 255, which makes it suitable for
+ * character classes. Value \c n is a member if bit \c n % 8 of
+ * <tt>members[ n / 8 ]</tt> is set.
+ */
+struct guardSet
+{
+   /** \brief Membership bits */
+   unsigned char members[ 32 ];
+};
+
+/**
+ * \brief Types of history pseudo-states
+ *
+ * \sa state::historyType
+ */
+enum stateM_historyTypes
+{
+   /** \brief The state is an ordinary state (default) */
+   stateM_noHistory,
+   /** \brief Restore the last active child of the parent state */
+   stateM_shallowHistory,
+   /** \brief Restore the last active descendant of the parent state */
+   stateM_deepHistory,
+};
 
 /**
  * \brief Transition between a state and another state
@@ -147,6 +256,23 @@ struct state;
  * used, operating on the supplied argument #condition. In this example,
  * `coordinatesWithinLimits` checks whether the coordinates in the mouse event
  * are within the limits of the "box".
+ * - Declarative guards comparing the event's payload against a character
+ *   range and a character set
+ * ~~~{.c}
+ * {
+ *    .eventType = Event_keyboard,
+ *    .condition = &(struct guardRange){ '0', '9' },
+ *    .guardKind = stateM_guardRange,
+ *    .nextState = &numberState,
+ * },
+ * {
+ *    .eventType = Event_keyboard,
+ *    .condition = &whitespace,
+ *    .guardKind = stateM_guardSet,
+ *    .nextState = &separatorState,
+ * },
+ * ~~~
+ * See #stateM_guardKinds.
  *
  * \sa event
  * \sa state
@@ -201,6 +327,24 @@ struct transition
     * stateMachine::errorState "error state".
     */
    struct state *nextState;
+   /**
+    * \brief Kind of guard
+    *
+    * If not #stateM_guardFunction, #guard is ignored, and the event's
+    * payload is compared against #condition as described in
+    * #stateM_guardKinds.
+    */
+   enum stateM_guardKinds guardKind;
+   /**
+    * \brief Set if #guard is a pure function
+    *
+    * A pure guard's result only depends on #condition and the event. While
+    * an event is being handled, a pure guard is called at most once for
+    * every distinct #condition, even if it is used by several transitions
+    * (typically in a state and its parents). Its result is remembered in a
+    * \ref guardMemo "memo" for the rest of the event.
+    */
+   bool pureGuard;
 };
 
 /**
@@ -281,6 +425,99 @@ struct transition
  * final state. Any calls to stateM_handleEvent() when the current state is a
  * final state will return #stateM_noStateChange.
  *
+ * ### Deferring events ###
+ * A state may list event types in #deferredEvents. If such an event is not
+ * handled by a transition in the state (or in any of its children that were
+ * asked first), it is kept by the state machine instead of being passed on
+ * to the state's parent. Deferred events are passed to the state machine
+ * again, in the order they arrived, every time the current state changes,
+ * until a state handles them:
+ * ~~~{.c}
+ * struct state busyState = {
+ *    .parentState = &connectedState,
+ *    .transitions = (struct transition[]){
+ *       { Event_done, NULL, NULL, NULL, &readyState },
+ *    },
+ *    .numTransitions = 1,
+ *    .deferredEvents = (int[]){ Event_send },
+ *    .numDeferredEvents = 1,
+ * };
+ * ~~~
+ *
+ * ### Orthogonal regions ###
+ * A state may be divided into independent, concurrently active #regions.
+ * Every region is represented by a state whose #parentState is the
+ * orthogonal state, and whose children (and their children) make up the
+ * region. While the orthogonal state is the current state, one state in
+ * every region is active, and every event is passed to all the active
+ * states (and their parents within the region) that have transitions for
+ * the event's type. Regions without any such transitions are skipped
+ * without looking at their states. Only if no region handles the event is it
+ * passed to the orthogonal state itself (and its parents):
+ * ~~~{.c}
+ * struct state sessionState = {
+ *    .transitions = (struct transition[]){
+ *       { Event_close, NULL, NULL, NULL, &closedState },
+ *    },
+ *    .numTransitions = 1,
+ *    .regions = (struct state *[]){ &connectionRegion, &authRegion },
+ *    .numRegions = 2,
+ * };
+ *
+ * struct state connectionRegion = {
+ *    .parentState = &sessionState,
+ *    .entryState = &connectingState,
+ * };
+ * ~~~
+ * When the orthogonal state is entered, the \ref #entryState "entry state"
+ * of every region is entered, unless the transition leads to a state inside
+ * one of the regions, in which case that state is entered in its region.
+ * The orthogonal state's #entryAction is called before the regions' states'
+ * entry actions, and its #exitAction is called after the regions' states'
+ * exit actions when it is left.
+ *
+ * A transition from a state in a region to another state in the region
+ * (or in another region of the same orthogonal state) only changes the
+ * active state of that region. A transition to a state outside the
+ * orthogonal state leaves all the regions.
+ *
+ * stateM_currentState() returns the orthogonal state while its regions are
+ * active. Use stateM_regionState() to get the active states in the regions.
+ *
+ * \note Orthogonal states may not be nested inside the regions of other
+ * orthogonal states, and their states' #deferredEvents are ignored. An
+ * orthogonal state may have at most #STATEM_MAX_REGIONS regions. If a state
+ * with more regions is entered, the error state is entered instead.
+ *
+ * ### History ###
+ * A parent state may remember which of its children was active when it was
+ * last left. To do so, it must be given a #historySlot, a number between 1
+ * and #STATEM_HISTORY_SLOTS that is unique within the state machine. The
+ * state machine stores the last active state in this slot, so restoring it
+ * is a single array lookup. The history is restored by transitions to a
+ * history pseudo-state, a child of the parent state with its #historyType
+ * set:
+ * ~~~{.c}
+ * struct state playingState = {
+ *    .entryState = &track1State,
+ *    .historySlot = 1,
+ * };
+ *
+ * struct state playingHistory = {
+ *    .parentState = &playingState,
+ *    .historyType = stateM_deepHistory,
+ *    .entryState = &track1State,
+ * };
+ * ~~~
+ * With #stateM_shallowHistory, the child of the parent state that was last
+ * active is entered (and its entry states are followed as usual). With
+ * #stateM_deepHistory, the (grandchild) state that was last active is
+ * entered directly. If the parent state has not yet been left, the
+ * pseudo-state's #entryState is entered instead. If it does not have one,
+ * the parent state itself is entered. History pseudo-states are never the
+ * current state, and only their #parentState, #entryState and #historyType
+ * are used.
+ *
  * \sa event
  * \sa transition
  */
@@ -333,6 +570,182 @@ struct state
     * \param event the event that triggered a transition will be passed.
     */
    void ( *exitAction )( void *stateData, struct event *event );
+   /**
+    * \brief Event types that are kept until a later state handles them
+    *
+    * May be NULL. See \ref state "Deferring events".
+    */
+   int *deferredEvents;
+   /**
+    * \brief Number of event types in the #deferredEvents array.
+    */
+   size_t numDeferredEvents;
+   /**
+    * \brief Orthogonal regions of the state
+    *
+    * May be NULL. See \ref state "Orthogonal regions".
+    */
+   struct state **regions;
+   /**
+    * \brief Number of regions in the #regions array.
+    */
+   size_t numRegions;
+   /**
+    * \brief If non-zero, the slot in \ref stateMachine::history used to
+    * remember the last active child of this state
+    *
+    * See \ref state "History".
+    */
+   size_t historySlot;
+   /**
+    * \brief Makes this state a history pseudo-state if not
+    * #stateM_noHistory
+    *
+    * See \ref state "History".
+    */
+   enum stateM_historyTypes historyType;
+   /**
+    * \brief The state's index in its \ref stateMachineDefinition
+    * "definition"
+    *
+    * Assigned by stateM_compile(), stateM_minimise() and stateM_relocate().
+    * A state can only belong to one compiled state machine.
+    */
+   size_t id;
+};
+
+/**
+ * \brief Capacity of the internal event queue
+ *
+ * Every state machine object contains a fixed-size queue for events posted
+ * with stateM_postEvent(). The queue is stored inline in struct
+ * #stateMachine, so no memory is allocated. Define this macro before
+ * including this header (and when compiling stateMachine.c) to change the
+ * capacity.
+ */
+#ifndef STATEM_EVENTQUEUE_SIZE
+#define STATEM_EVENTQUEUE_SIZE 8
+#endif
+
+/**
+ * \brief Number of event priority levels
+ *
+ * Events posted with stateM_postPriorityEvent() are handled in order of
+ * priority, from \c STATEM_NUM_PRIORITIES - 1 (most urgent) down to 0
+ * (events posted with stateM_postEvent()). Events with the same priority are
+ * handled in the order they were posted. Like #STATEM_EVENTQUEUE_SIZE, this
+ * macro may be defined by the user.
+ */
+#ifndef STATEM_NUM_PRIORITIES
+#define STATEM_NUM_PRIORITIES 4
+#endif
+
+/**
+ * \brief Maximum number of \ref state::regions "orthogonal regions" in a
+ * state
+ *
+ * The active state of every region is stored inline in struct
+ * #stateMachine. Like #STATEM_EVENTQUEUE_SIZE, this macro may be defined by
+ * the user.
+ */
+#ifndef STATEM_MAX_REGIONS
+#define STATEM_MAX_REGIONS 4
+#endif
+
+/**
+ * \brief Number of history slots
+ *
+ * Every state machine object has room for remembering the history of this
+ * many parent states (see \ref state::historySlot). Like
+ * #STATEM_EVENTQUEUE_SIZE, this macro may be defined by the user.
+ */
+#ifndef STATEM_HISTORY_SLOTS
+#define STATEM_HISTORY_SLOTS 4
+#endif
+
+/**
+ * \brief Capacity of the deferred event queue
+ *
+ * Events \ref state::deferredEvents "deferred" by a state are kept in a
+ * fixed-size queue stored inline in struct #stateMachine. Like
+ * #STATEM_EVENTQUEUE_SIZE, this macro may be defined by the user.
+ */
+#ifndef STATEM_DEFERQUEUE_SIZE
+#define STATEM_DEFERQUEUE_SIZE 8
+#endif
+
+/**
+ * \brief What to do when an event is posted to a full event queue
+ *
+ * The policy only applies if none of the queued events have a lower
+ * priority than the new event. Otherwise the oldest of the events with the
+ * lowest priority is discarded to make room, so that urgent events are
+ * never rejected in favour of less important ones. The policy also applies
+ * when an event is deferred while the deferred event queue is full.
+ *
+ * \sa stateM_setOverflowPolicy()
+ * \sa stateM_postEvent()
+ */
+enum stateM_overflowPolicies
+{
+   /** \brief Discard the new event (default) */
+   stateM_overflowReject,
+   /**
+    * \brief Discard the oldest queued event to make room for the new one
+    *
+    * Only events with the same priority as the new event are discarded. If
+    * all queued events have a higher priority, the new event is discarded
+    * instead.
+    */
+   stateM_overflowDropOldest,
+   /**
+    * \brief Enter the \ref stateMachine::errorState "error state"
+    *
+    * If the event is posted from an action, the error state is entered as
+    * soon as the current transition has completed. All queued events are
+    * discarded.
+    */
+   stateM_overflowErrorState,
+};
+
+/**
+ * \brief State machine definition
+ *
+ * A definition lists all the states in a state machine, together with its
+ * initial and error states. It is not needed in order to run a state
+ * machine, but it allows the state machine to be checked once by
+ * stateM_validate(). State machines initialised from a validated definition
+ * with stateM_initWithDefinition() skip the checks that stateM_handleEvent()
+ * otherwise performs for every event.
+ *
+ * A state's index in #states serves as its id.
+ *
+ * ~~~{.c}
+ * struct stateMachineDefinition definition = {
+ *    .states = (struct state *[]){ &idleState, &hState, &errorState },
+ *    .numStates = 3,
+ *    .initialState = &idleState,
+ *    .errorState = &errorState,
+ * };
+ * ~~~
+ */
+struct stateMachineDefinition
+{
+   /** \brief All states in the state machine, including the error state */
+   struct state **states;
+   /** \brief Number of states in #states */
+   size_t numStates;
+   /** \brief The state the state machine starts in */
+   struct state *initialState;
+   /** \brief The \ref stateMachine::errorState "error state" */
+   struct state *errorState;
+   /**
+    * \brief Set by stateM_validate() if no problems were found
+    *
+    * The definition (and its states and transitions) must not be modified
+    * after it has been validated.
+    */
+   bool verified;
 };
 
 /**
@@ -359,6 +772,90 @@ struct stateMachine
     * error state.
     */
    struct state *errorState;
+   /**
+    * \brief Events posted with stateM_postEvent() waiting to be handled
+    *
+    * The events are sorted by priority, most urgent first. Events with the
+    * same priority are sorted by age, oldest first.
+    */
+   struct event eventQueue[ STATEM_EVENTQUEUE_SIZE ];
+   /** \brief Number of events in #eventQueue */
+   size_t numQueuedEvents;
+   /** \brief Number of events in #eventQueue of every priority */
+   size_t numQueuedByPriority[ STATEM_NUM_PRIORITIES ];
+   /** \brief How to handle posting to a full #eventQueue */
+   enum stateM_overflowPolicies overflowPolicy;
+   /** \brief True while stateM_handleEvent() is running */
+   bool handlingEvent;
+   /**
+    * \brief Set if the queue overflowed during stateM_handleEvent() with
+    * #overflowPolicy set to #stateM_overflowErrorState
+    */
+   bool queueOverflowed;
+   /**
+    * \brief Number of \ref stateM_suspend() "asynchronous actions" that have
+    * not completed yet
+    */
+   unsigned numPendingActions;
+   /**
+    * \brief Events \ref state::deferredEvents "deferred" by states
+    *
+    * The queue is a ring buffer starting at #deferQueueHead.
+    */
+   struct event deferQueue[ STATEM_DEFERQUEUE_SIZE ];
+   /** \brief Index of the oldest event in #deferQueue */
+   size_t deferQueueHead;
+   /** \brief Number of events in #deferQueue */
+   size_t numDeferredEvents;
+   /**
+    * \brief Active state in every \ref state::regions "region" of
+    * #currentState
+    */
+   struct state *regionStates[ STATEM_MAX_REGIONS ];
+   /**
+    * \brief Event types handled in every region of #currentState
+    *
+    * Bit \c n is set if the active state in the region, or any of its
+    * parents within the region, has a transition for an event type that
+    * equals \c n modulo the number of bits in the mask.
+    */
+   unsigned long regionEventMasks[ STATEM_MAX_REGIONS ];
+   /**
+    * \brief Last active state within the states that record their history,
+    * indexed by \ref state::historySlot "historySlot" - 1
+    */
+   struct state *history[ STATEM_HISTORY_SLOTS ];
+   /**
+    * \brief The definition the state machine was initialised from, if any
+    */
+   struct stateMachineDefinition *definition;
+   /**
+    * \brief Set if #definition has been \ref stateM_validate() "validated"
+    *
+    * stateM_handleEvent() trusts the definition and skips its checks for
+    * errors in the state machine.
+    */
+   bool verified;
+   /**
+    * \brief If non-NULL, transitions are looked up in this \ref
+    * stateM_compile() "compiled" version of #definition
+    */
+   struct compiledStateMachine *compiled;
+   /**
+    * \brief If non-NULL, #definition is part of this \ref stateM_relocate()
+    * "relocated" state machine, and its \ref hotState "hot states" are used
+    * to search for transitions
+    */
+   struct relocatedStateMachine *relocated;
+   /**
+    * \brief The \ref stateM_groupAdd() "group" the state machine is a
+    * member of, or NULL
+    */
+   struct stateMachineGroup *group;
+   /** \brief Next member of #group in the same state */
+   struct stateMachine *groupNext;
+   /** \brief Previous member of #group in the same state */
+   struct stateMachine *groupPrevious;
 };
 
 /**
@@ -377,6 +874,15 @@ struct stateMachine
  * state::entryState "entryState" defined, it will not be entered. The user
  * must explicitly set the initial state.
  *
+ * \note If \pn{initialState} has \ref state::regions "orthogonal regions",
+ * the regions start in their entry states. If it is a state inside a region,
+ * the state owning the region becomes the current state, with
+ * \pn{initialState} active in its region.
+ *
+ * \note Any queued or deferred events and all history are discarded, and
+ * the \ref stateMachine::overflowPolicy "overflow policy" is reset to
+ * #stateM_overflowReject.
+ *
  * \param stateMachine the state machine to initialise.
  * \param initialState the initial state of the state machine.
  * \param errorState pointer to a state that acts a final state and notifies
@@ -385,6 +891,21 @@ struct stateMachine
 void stateM_init( struct stateMachine *stateMachine,
       struct state *initialState, struct state *errorState );
 
+/**
+ * \brief Initialise the state machine from a definition
+ *
+ * This function works like stateM_init(), using the definition's initial
+ * and error states. If the definition has been successfully \ref
+ * stateM_validate() "validated", stateM_handleEvent() will not check the
+ * state machine for errors (like transitions without a next state) while
+ * handling events.
+ *
+ * \param stateMachine the state machine to initialise.
+ * \param definition the state machine definition.
+ */
+void stateM_initWithDefinition( struct stateMachine *stateMachine,
+      struct stateMachineDefinition *definition );
+
 /**
  * \brief stateM_handleEvent() return values
  */
@@ -405,7 +926,10 @@ enum stateM_handleEventRetVals
     * - A transition for the current event did not define the next state
     */
    stateM_errorStateReached,
-   /** \brief The current state changed into a non-final state */
+   /**
+    * \brief The current state changed into a non-final state, or the active
+    * state of an \ref state::regions "orthogonal region" changed
+    */
    stateM_stateChanged,
    /**
     * \brief The state changed back to itself
@@ -424,6 +948,16 @@ enum stateM_handleEventRetVals
    stateM_noStateChange,
    /** \brief A final state (any but the error state) was reached */
    stateM_finalStateReached,
+   /**
+    * \brief The event was \ref state::deferredEvents "deferred" by the
+    * current state (or one of its parents)
+    */
+   stateM_eventDeferred,
+   /**
+    * \brief The event was queued because an \ref stateM_suspend()
+    * "asynchronous action" has not completed yet
+    */
+   stateM_actionPending,
 };
 
 /**
@@ -438,6 +972,23 @@ enum stateM_handleEventRetVals
  * state, the new state's \ref state::entryAction "entry action" is called (if
  * defined).
  *
+ * If the state (or parent) that would have passed the event on to its
+ * parent \ref state::deferredEvents "defers" it, the event is kept and
+ * #stateM_eventDeferred is returned. Deferred events are handled again,
+ * oldest first, every time the current state changes.
+ *
+ * Any events posted with stateM_postEvent() by actions run as a result of
+ * \pn{event} are handled in order before this function returns (run to
+ * completion). Events posted while the state machine was idle are handled
+ * before \pn{event}. If more than one event is handled, the value returned
+ * is that of the last event that did not result in #stateM_noStateChange.
+ * If the error state is reached, any remaining queued events are discarded.
+ *
+ * \note An action must not pass events to its own state machine by calling
+ * this function. If it does, the event is posted as if by
+ * stateM_postEvent(), and #stateM_noStateChange (or #stateM_errArg, if the
+ * event could not be queued) is returned.
+ *
  * The returned value is negative if an error occurs.
  *
  * \param stateMachine the state machine to pass an event to.
@@ -448,6 +999,135 @@ enum stateM_handleEventRetVals
 int stateM_handleEvent( struct stateMachine *stateMachine,
       struct event *event );
 
+/**
+ * \brief Post an event to the state machine's internal queue
+ *
+ * This function is meant to be called from \ref state::entryAction
+ * "entry", \ref state::exitAction "exit" and \ref transition::action
+ * "transition" actions in order to raise follow-up events. The event is
+ * handled after the current transition has completed, within the same call
+ * to stateM_handleEvent(). Events are handled in the order they were posted.
+ *
+ * The event is copied, but its \ref event::data "payload" is not. The
+ * payload must remain valid until the event has been handled.
+ *
+ * If the queue is full (see #STATEM_EVENTQUEUE_SIZE), the state machine's
+ * \ref stateM_overflowPolicies "overflow policy" decides what happens.
+ *
+ * The event is posted with the lowest priority, 0, and is never coalesced.
+ *
+ * \param stateMachine the state machine to post an event to.
+ * \param event the event to be queued.
+ *
+ * \retval true if the event was queued.
+ * \retval false if the arguments are NULL, or if the queue was full and
+ * the overflow policy is not #stateM_overflowDropOldest. With
+ * #stateM_overflowDropOldest, false is also returned if the queue was full
+ * of events with higher priority than 0, since only events with the same
+ * priority are discarded.
+ *
+ * \sa stateM_postPriorityEvent()
+ */
+bool stateM_postEvent( struct stateMachine *stateMachine,
+      struct event *event );
+
+/**
+ * \brief Post an event with a given priority to the internal queue
+ *
+ * This function works like stateM_postEvent(), but the event is handled
+ * before any queued events with lower priority.
+ *
+ * If \pn{coalesce} is true and an event of the same \ref event::type "type"
+ * and priority is already queued, the queued event's \ref event::data
+ * "payload" is replaced by that of \pn{event} instead of queuing another
+ * event. The queued event keeps its place in the queue. This keeps the queue
+ * short when the same kind of event (like "data available") is raised
+ * repeatedly.
+ *
+ * \param stateMachine the state machine to post an event to.
+ * \param event the event to be queued.
+ * \param priority the event's priority, less than #STATEM_NUM_PRIORITIES.
+ * Higher values are more urgent.
+ * \param coalesce whether to replace a queued event of the same type.
+ *
+ * \retval true if the event was queued or coalesced.
+ * \retval false if the arguments are invalid, or if the event could not be
+ * queued (see #stateM_overflowPolicies).
+ */
+bool stateM_postPriorityEvent( struct stateMachine *stateMachine,
+      struct event *event, unsigned priority, bool coalesce );
+
+/**
+ * \brief Set what happens when posting to a full event queue
+ *
+ * \param stateMachine the state machine to configure.
+ * \param policy the new overflow policy.
+ */
+void stateM_setOverflowPolicy( struct stateMachine *stateMachine,
+      enum stateM_overflowPolicies policy );
+
+/**
+ * \brief Hold back events until an asynchronous action has completed
+ *
+ * This function is meant to be called from an action that starts work
+ * (I/O, for instance) it does not wait for. The current transition is
+ * completed as usual, but any events queued or passed to the state machine
+ * afterwards are kept in the event queue (and #stateM_actionPending is
+ * returned) until stateM_resume() has been called as many times as this
+ * function. The thread running stateM_handleEvent() is free to do other
+ * work in the meantime.
+ *
+ * Since the events wait in the event queue, its \ref
+ * stateM_overflowPolicies "overflow policy" decides what happens if too
+ * many events arrive.
+ *
+ * \param stateMachine the state machine whose action is still running.
+ */
+void stateM_suspend( struct stateMachine *stateMachine );
+
+/**
+ * \brief Signal that an asynchronous action has completed
+ *
+ * Once every action that called stateM_suspend() has completed, the queued
+ * events are handled. stateM_resume() must not be called while another
+ * thread passes events to the state machine.
+ *
+ * \param stateMachine the state machine whose action has completed.
+ *
+ * \returns #stateM_actionPending if other actions have not completed yet,
+ * #stateM_errArg if \pn{stateMachine} is NULL or has no pending actions,
+ * and otherwise what stateM_handleEvent() returns for the queued events
+ * (#stateM_noStateChange if there were none).
+ */
+int stateM_resume( struct stateMachine *stateMachine );
+
+/**
+ * \brief Check whether any asynchronous actions have not completed yet
+ *
+ * \param stateMachine the state machine to test.
+ *
+ * \retval true if stateM_suspend() has been called more often than
+ * stateM_resume().
+ * \retval false otherwise, or if \pn{stateMachine} is NULL.
+ */
+bool stateM_actionsPending( struct stateMachine *stateMachine );
+
+/**
+ * \brief Check whether a transition's guard holds for an event
+ *
+ * \param transition the transition whose guard (function or \ref
+ * stateM_guardKinds "declarative") to check.
+ * \param event the event to check.
+ * \param memo results of \ref transition::pureGuard "pure guards" already
+ * called for \pn{event}. The result of a pure guard called by this function
+ * is added to it. May be NULL.
+ *
+ * \retval true if the transition is unguarded or if its guard holds.
+ * \retval false otherwise.
+ */
+bool stateM_guardHolds( struct transition *transition, struct event *event,
+      struct guardMemo *memo );
+
 /**
  * \brief Get the current state
  *
@@ -458,6 +1138,20 @@ int stateM_handleEvent( struct stateMachine *stateMachine,
  */
 struct state *stateM_currentState( struct stateMachine *stateMachine );
 
+/**
+ * \brief Get the active state in an orthogonal region of the current state
+ *
+ * \param stateMachine the state machine to get the state from.
+ * \param region the index of the region in the current state's \ref
+ * state::regions "regions" array.
+ *
+ * \retval a pointer to the active state in the region.
+ * \retval NULL if \pn{stateMachine} is NULL or if the current state does not
+ * have the given region.
+ */
+struct state *stateM_regionState( struct stateMachine *stateMachine,
+      size_t region );
+
 /**
  * \brief Get the previous state
  *
@@ -480,6 +1174,78 @@ struct state *stateM_previousState( struct stateMachine *stateMachine );
  */
 bool stateM_stopped( struct stateMachine *stateMachine );
 
+/**
+ * \brief Problems found by stateM_validate()
+ */
+enum stateM_definitionErrors
+{
+   /** \brief The definition's initial or error state is NULL */
+   stateM_missingState,
+   /**
+    * \brief A state refers to a state that is not in the definition
+    *
+    * The state referred to may be a transition's next state, a parent
+    * state, an entry state or a region. The initial and error states must
+    * also be in the definition.
+    */
+   stateM_unknownState,
+   /** \brief A transition does not define its \ref transition::nextState
+    * "next state" */
+   stateM_nullNextState,
+   /** \brief The state can never become active */
+   stateM_unreachableState,
+   /** \brief Following the state's \ref state::entryState "entry states"
+    * leads back to the state */
+   stateM_entryStateCycle,
+   /** \brief Following the state's \ref state::parentState "parents" leads
+    * back to the state */
+   stateM_parentStateCycle,
+   /**
+    * \brief The transition can never be taken
+    *
+    * An earlier transition in the same state for the same event type is
+    * either unguarded or uses the same guard and condition.
+    */
+   stateM_shadowedTransition,
+   /** \brief The state has more than #STATEM_MAX_REGIONS regions */
+   stateM_tooManyRegions,
+   /**
+    * \brief One of the state's regions does not have the state as its
+    * parent, or the state is nested inside the region of another orthogonal
+    * state
+    */
+   stateM_invalidRegion,
+   /** \brief The state's \ref state::historySlot "history slot" is larger
+    * than #STATEM_HISTORY_SLOTS, or is used by another state */
+   stateM_invalidHistorySlot,
+   /** \brief The history pseudo-state has no parent state */
+   stateM_orphanHistoryState,
+};
+
+/**
+ * \brief Check a state machine definition for errors
+ *
+ * All states reachable from the definition's initial state are visited
+ * once, and every problem found is reported through \pn{report} (if
+ * non-NULL). If no problems are found, the definition is marked as \ref
+ * stateMachineDefinition::verified "verified".
+ *
+ * The error state is never reported as unreachable.
+ *
+ * \param definition the definition to check.
+ * \param report function called for every problem found, with the problem,
+ * the state the problem belongs to, the transition in question (or NULL)
+ * and \pn{userData}.
+ * \param userData passed on to \pn{report}.
+ *
+ * \returns the number of problems found, or -1 if \pn{definition} is NULL
+ * or if memory could not be allocated.
+ */
+int stateM_validate( struct stateMachineDefinition *definition,
+      void ( *report )( enum stateM_definitionErrors error,
+         struct state *state, struct transition *transition,
+         void *userData ), void *userData );
+
 #endif // STATEMACHINE_H
 
 /**
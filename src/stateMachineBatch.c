@@ -0,0 +1,207 @@
+/* 
+ * Copyright (c) 2013 Andreas Misje
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#include "stateMachineBatch.h"
+#include <stdint.h>
+#include <stdlib.h>
+
+/* Numbers the distinct pointers seen, by open addressing: */
+struct pointerTable
+{
+   const void **keys;
+   /* Zero for empty slots, and otherwise the key's number plus one: */
+   uint32_t *values;
+   size_t mask;
+   /* The slots in use, so that the table can be emptied without touching
+    * all of them: */
+   size_t *used;
+   uint32_t numUsed;
+};
+
+static bool createTable( struct pointerTable *table, size_t maxKeys );
+static void freeTable( struct pointerTable *table );
+static void clearTable( struct pointerTable *table );
+static uint32_t numberOf( struct pointerTable *table, const void *key );
+static void sortByKey( const uint32_t *keys, uint32_t numKeys,
+      const uint32_t *from, uint32_t *to, size_t numIndices,
+      uint32_t *counts );
+
+bool stateM_dispatchBatch( struct batchEntry *batch, size_t numEntries )
+{
+   struct pointerTable machines = { 0 }, states = { 0 }, definitions = { 0 };
+   bool success = false;
+   size_t i;
+
+   if ( ( !batch && numEntries ) || numEntries >= UINT32_MAX )
+      return false;
+
+   if ( !numEntries )
+      return true;
+
+   /* Every entry's round, its state's and definition's numbers within the
+    * round, and the entries in the order they are handled: */
+   uint32_t *rounds = malloc( numEntries * sizeof( *rounds ) + 1 );
+   uint32_t *stateKeys = malloc( numEntries * sizeof( *stateKeys ) + 1 );
+   uint32_t *definitionKeys = malloc( numEntries * sizeof( *definitionKeys )
+         + 1 );
+   uint32_t *order = malloc( numEntries * sizeof( *order ) + 1 );
+   uint32_t *scratch = malloc( numEntries * sizeof( *scratch ) + 1 );
+   uint32_t *counts = calloc( numEntries + 1, sizeof( *counts ) );
+   if ( !rounds || !stateKeys || !definitionKeys || !order || !scratch ||
+         !counts || !createTable( &machines, numEntries ) || !createTable(
+            &states, numEntries ) || !createTable( &definitions, numEntries ) )
+      goto done;
+
+   /* A state machine's nth event is handled in round n. The state machines'
+    * events are counted in 'counts' until it is needed for sorting: */
+   uint32_t numRounds = 0;
+   for ( i = 0; i < numEntries; ++i )
+   {
+      rounds[ i ] = counts[ numberOf( &machines, batch[ i ].stateMachine ) ]++;
+      scratch[ i ] = (uint32_t)i;
+      if ( rounds[ i ] >= numRounds )
+         numRounds = rounds[ i ] + 1;
+   }
+   sortByKey( rounds, numRounds, scratch, order, numEntries, counts );
+
+   size_t begin, end;
+   for ( begin = 0; begin < numEntries; begin = end )
+   {
+      uint32_t *round = &order[ begin ];
+
+      for ( end = begin; end < numEntries && rounds[ order[ end ] ] ==
+            rounds[ round[ 0 ] ]; ++end )
+         ;
+
+      /* The states must be numbered anew in every round, since the state
+       * machines have changed state: */
+      clearTable( &states );
+      clearTable( &definitions );
+      for ( i = 0; i < end - begin; ++i )
+      {
+         struct stateMachine *fsm = batch[ round[ i ] ].stateMachine;
+
+         stateKeys[ round[ i ] ] = numberOf( &states, fsm->currentState );
+         definitionKeys[ round[ i ] ] = numberOf( &definitions,
+               fsm->definition );
+      }
+
+      /* Sort by state, and then by definition, keeping the states of a
+       * definition together: */
+      sortByKey( stateKeys, states.numUsed, round, scratch, end - begin,
+            counts );
+      sortByKey( definitionKeys, definitions.numUsed, scratch, round, end -
+            begin, counts );
+
+      for ( i = 0; i < end - begin; ++i )
+      {
+         struct batchEntry *entry = &batch[ round[ i ] ];
+
+         entry->result = stateM_handleEvent( entry->stateMachine,
+               &entry->event );
+      }
+   }
+
+   success = true;
+
+done:
+   free( rounds );
+   free( stateKeys );
+   free( definitionKeys );
+   free( order );
+   free( scratch );
+   free( counts );
+   freeTable( &machines );
+   freeTable( &states );
+   freeTable( &definitions );
+
+   return success;
+}
+
+static bool createTable( struct pointerTable *table, size_t maxKeys )
+{
+   size_t numSlots = 2;
+
+   while ( numSlots < 2 * maxKeys )
+      numSlots *= 2;
+
+   table->keys = malloc( numSlots * sizeof( *table->keys ) );
+   table->values = calloc( numSlots, sizeof( *table->values ) );
+   table->used = malloc( numSlots * sizeof( *table->used ) );
+   table->mask = numSlots - 1;
+   table->numUsed = 0;
+
+   return table->keys && table->values && table->used;
+}
+
+static void freeTable( struct pointerTable *table )
+{
+   free( table->keys );
+   free( table->values );
+   free( table->used );
+}
+
+static void clearTable( struct pointerTable *table )
+{
+   uint32_t i;
+
+   for ( i = 0; i < table->numUsed; ++i )
+      table->values[ table->used[ i ] ] = 0;
+
+   table->numUsed = 0;
+}
+
+static uint32_t numberOf( struct pointerTable *table, const void *key )
+{
+   size_t slot = (size_t)( (uint64_t)(uintptr_t)key * UINT64_C(
+            0x9e3779b97f4a7c15 ) >> 32 ) & table->mask;
+
+   while ( table->values[ slot ] && table->keys[ slot ] != key )
+      slot = ( slot + 1 ) & table->mask;
+
+   if ( !table->values[ slot ] )
+   {
+      table->keys[ slot ] = key;
+      table->used[ table->numUsed ] = slot;
+      table->values[ slot ] = ++table->numUsed;
+   }
+
+   return table->values[ slot ] - 1;
+}
+
+/* A stable counting sort of the indices in 'from' by their keys: */
+static void sortByKey( const uint32_t *keys, uint32_t numKeys,
+      const uint32_t *from, uint32_t *to, size_t numIndices,
+      uint32_t *counts )
+{
+   uint32_t k;
+   size_t i;
+
+   for ( k = 0; k <= numKeys; ++k )
+      counts[ k ] = 0;
+   for ( i = 0; i < numIndices; ++i )
+      ++counts[ keys[ from[ i ] ] + 1 ];
+   for ( k = 0; k < numKeys; ++k )
+      counts[ k + 1 ] += counts[ k ];
+   for ( i = 0; i < numIndices; ++i )
+      to[ counts[ keys[ from[ i ] ] ]++ ] = from[ i ];
+}
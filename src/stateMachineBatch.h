@@ -0,0 +1,90 @@
+/* 
+ * Copyright (c) 2013 Andreas Misje
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+/**
+ * \addtogroup stateMachine
+ * @{
+ *
+ * \file
+ * \brief Dispatching batches of events to many state machines
+ *
+ * A worker that handles events for many state machines one after the other
+ * touches a different definition and state for almost every event, so the
+ * transitions it needs are rarely in the cache. stateM_dispatchBatch()
+ * instead handles the events for state machines in the same state (of the
+ * same definition) together.
+ *
+ * Every state machine's events are still handled in the order they appear
+ * in the batch: the batch is handled in rounds, the first round handling
+ * every state machine's first event, the second round every second event
+ * and so on. Only the events in a round are reordered, with two counting
+ * sort passes over small keys numbering the states and definitions seen.
+ */
+
+#ifndef STATEMACHINE_BATCH_H
+#define STATEMACHINE_BATCH_H
+
+#include "stateMachine.h"
+
+/**
+ * \brief An event for one of many state machines
+ */
+struct batchEntry
+{
+   /** \brief The state machine to pass the event to */
+   struct stateMachine *stateMachine;
+   /** \brief The event */
+   struct event event;
+   /**
+    * \brief The value stateM_handleEvent() returned for the event
+    *
+    * Set by stateM_dispatchBatch().
+    */
+   int result;
+};
+
+/**
+ * \brief Pass a batch of events to their state machines
+ *
+ * Every event is passed to its state machine with stateM_handleEvent(), in
+ * batch order for every state machine, but with the events of different
+ * state machines grouped by definition and current state.
+ *
+ * If an action passes events to another state machine in the batch, that
+ * state machine's events may no longer be grouped by its current state,
+ * but they are still handled in order.
+ *
+ * \param batch the events. The \ref batchEntry::result "results" are set
+ * as the events are handled.
+ * \param numEntries the number of events in \pn{batch}.
+ *
+ * \returns false if \pn{batch} is NULL while \pn{numEntries} is not zero,
+ * if \pn{numEntries} is not less than UINT32_MAX, or if memory could not be
+ * allocated, in which case no events are handled, and true otherwise.
+ */
+bool stateM_dispatchBatch( struct batchEntry *batch, size_t numEntries );
+
+#endif // STATEMACHINE_BATCH_H
+
+/**
+ * @}
+ */
@@ -0,0 +1,296 @@
+/* 
+ * Copyright (c) 2013 Andreas Misje
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#include "stateMachineBroadcast.h"
+#include <stdlib.h>
+
+static size_t listIndex( struct stateMachineGroup *group,
+      struct state *state );
+static bool validList( struct stateMachineGroup *group, struct state *state );
+static void insertMember( struct stateMachine *fsm, size_t list );
+static void linkMember( struct stateMachine *fsm, size_t list );
+static void unlinkMember( struct stateMachine *fsm, size_t list );
+static bool mayHandle( struct stateMachineGroup *group, struct state *state,
+      int eventType );
+
+struct stateMachineGroup *stateM_createGroup(
+      struct compiledStateMachine *compiled )
+{
+   if ( !compiled )
+      return NULL;
+
+   struct stateMachineGroup *group = calloc( 1, sizeof( *group ) );
+   if ( !group )
+      return NULL;
+
+   group->compiled = compiled;
+   group->members = calloc( compiled->definition->numStates + 1, sizeof(
+            *group->members ) );
+   group->numMembers = calloc( compiled->definition->numStates + 1, sizeof(
+            *group->numMembers ) );
+   if ( !group->members || !group->numMembers )
+   {
+      free( group->members );
+      free( group->numMembers );
+      free( group );
+      return NULL;
+   }
+
+   return group;
+}
+
+void stateM_freeGroup( struct stateMachineGroup *group )
+{
+   size_t i;
+
+   if ( !group )
+      return;
+
+   for ( i = 0; i <= group->compiled->definition->numStates; ++i )
+      while ( group->members[ i ] )
+         stateM_groupRemove( group->members[ i ] );
+
+   free( group->members );
+   free( group->numMembers );
+   free( group );
+}
+
+bool stateM_groupAdd( struct stateMachineGroup *group,
+      struct stateMachine *fsm )
+{
+   if ( !group || !fsm || fsm->group || fsm->compiled != group->compiled )
+      return false;
+
+   fsm->group = group;
+   linkMember( fsm, listIndex( group, fsm->currentState ) );
+
+   return true;
+}
+
+void stateM_groupRemove( struct stateMachine *fsm )
+{
+   if ( !fsm || !fsm->group )
+      return;
+
+   unlinkMember( fsm, listIndex( fsm->group, fsm->currentState ) );
+   fsm->group = NULL;
+}
+
+size_t stateM_broadcastEvent( struct stateMachineGroup *group,
+      struct event *event )
+{
+   size_t numDispatched = 0;
+   size_t i;
+
+   if ( !group || !event )
+      return 0;
+
+   struct state **states = group->compiled->definition->states;
+   size_t numStates = group->compiled->definition->numStates;
+
+   /* Detach the lists of all states that may handle the event before
+    * dispatching anything, so that members moving into such a state do not
+    * receive the event twice. The lists are chained through the first
+    * members' groupPrevious pointers, which are unused for list heads: */
+   struct stateMachine *pending = NULL;
+   for ( i = 0; i < numStates; ++i )
+   {
+      struct stateMachine *first = group->members[ i ];
+
+      if ( !first || !mayHandle( group, states[ i ], event->type ) )
+         continue;
+
+      group->members[ i ] = NULL;
+      first->groupPrevious = pending;
+      pending = first;
+   }
+
+   while ( pending )
+   {
+      struct stateMachine *fsm = pending;
+      pending = pending->groupPrevious;
+
+      while ( fsm )
+      {
+         struct stateMachine *next = fsm->groupNext;
+
+         /* Put the member back in its list (where it still is counted)
+          * before passing the event, so that it is moved as usual if it
+          * changes state: */
+         insertMember( fsm, listIndex( group, fsm->currentState ) );
+         stateM_handleEvent( fsm, event );
+         ++numDispatched;
+
+         fsm = next;
+      }
+   }
+
+   return numDispatched;
+}
+
+size_t stateM_groupCount( struct stateMachineGroup *group,
+      struct state *state )
+{
+   if ( !validList( group, state ) )
+      return 0;
+
+   return group->numMembers[ listIndex( group, state ) ];
+}
+
+struct stateMachine *stateM_groupFirst( struct stateMachineGroup *group,
+      struct state *state )
+{
+   if ( !validList( group, state ) )
+      return NULL;
+
+   return group->members[ listIndex( group, state ) ];
+}
+
+struct stateMachine *stateM_groupNext( struct stateMachine *fsm )
+{
+   if ( !fsm )
+      return NULL;
+
+   return fsm->groupNext;
+}
+
+size_t stateM_groupForEach( struct stateMachineGroup *group,
+      struct state *state, void ( *function )( struct stateMachine *,
+         void * ), void *data )
+{
+   size_t numCalls = 0;
+
+   if ( !function || !validList( group, state ) )
+      return 0;
+
+   /* Detach the list, so that members leaving and re-entering the state do
+    * not show up twice: */
+   size_t list = listIndex( group, state );
+   struct stateMachine *fsm = group->members[ list ];
+   group->members[ list ] = NULL;
+
+   while ( fsm )
+   {
+      struct stateMachine *next = fsm->groupNext;
+
+      insertMember( fsm, list );
+      function( fsm, data );
+      ++numCalls;
+
+      fsm = next;
+   }
+
+   return numCalls;
+}
+
+void stateM_groupStateChanged( struct stateMachine *fsm,
+      struct state *oldState )
+{
+   struct stateMachineGroup *group = fsm->group;
+
+   if ( oldState == fsm->currentState )
+      return;
+
+   unlinkMember( fsm, listIndex( group, oldState ) );
+   linkMember( fsm, listIndex( group, fsm->currentState ) );
+}
+
+static size_t listIndex( struct stateMachineGroup *group,
+      struct state *state )
+{
+   return state ? state->id : group->compiled->definition->numStates;
+}
+
+static bool validList( struct stateMachineGroup *group, struct state *state )
+{
+   if ( !group )
+      return false;
+
+   if ( !state )
+      return true;
+
+   struct stateMachineDefinition *definition = group->compiled->definition;
+   return state->id < definition->numStates && definition->states[
+      state->id ] == state;
+}
+
+static void insertMember( struct stateMachine *fsm, size_t list )
+{
+   struct stateMachine **first = &fsm->group->members[ list ];
+
+   fsm->groupPrevious = NULL;
+   fsm->groupNext = *first;
+   if ( *first )
+      ( *first )->groupPrevious = fsm;
+
+   *first = fsm;
+}
+
+static void linkMember( struct stateMachine *fsm, size_t list )
+{
+   insertMember( fsm, list );
+   ++fsm->group->numMembers[ list ];
+}
+
+static void unlinkMember( struct stateMachine *fsm, size_t list )
+{
+   if ( fsm->groupPrevious )
+      fsm->groupPrevious->groupNext = fsm->groupNext;
+   else
+      fsm->group->members[ list ] = fsm->groupNext;
+
+   if ( fsm->groupNext )
+      fsm->groupNext->groupPrevious = fsm->groupPrevious;
+
+   fsm->groupPrevious = NULL;
+   fsm->groupNext = NULL;
+   --fsm->group->numMembers[ list ];
+}
+
+static bool mayHandle( struct stateMachineGroup *group, struct state *state,
+      int eventType )
+{
+   size_t i;
+
+   /* The regions' states are not known here: */
+   if ( state->numRegions )
+      return true;
+
+   /* Check the state and its parents from the compiled ancestor array: */
+   const struct compiledState *compiled = &group->compiled->states[
+      state->id ];
+   size_t depth = compiled->depth + 1;
+   while ( depth-- )
+   {
+      struct state *ancestor = group->compiled->definition->states[
+         compiled->ancestors[ depth ] ];
+
+      if ( stateM_compiledHandles( group->compiled, ancestor, eventType ) )
+         return true;
+
+      for ( i = 0; i < ancestor->numDeferredEvents; ++i )
+         if ( ancestor->deferredEvents[ i ] == eventType )
+            return true;
+   }
+
+   return false;
+}
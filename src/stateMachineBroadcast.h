@@ -0,0 +1,208 @@
+/* 
+ * Copyright (c) 2013 Andreas Misje
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+/**
+ * \addtogroup stateMachine
+ * @{
+ *
+ * \file
+ * \brief Broadcasting events to groups of state machines
+ *
+ * Sending an event (a timer tick, for instance) to a large number of state
+ * machines one by one is wasteful if most of them ignore it. A group keeps
+ * its members in one list per current state, updated whenever a member
+ * changes state. stateM_broadcastEvent() checks once per state whether the
+ * event can be handled, and only passes it to the members in such states.
+ *
+ * The lists also answer questions about the members without scanning all of
+ * them: stateM_groupCount() tells how many members are in a state,
+ * stateM_groupFirst() and stateM_groupNext() enumerate them, and
+ * stateM_groupForEach() acts on all of them (passing them an event that
+ * makes them fail, for instance).
+ */
+
+#ifndef STATEMACHINE_BROADCAST_H
+#define STATEMACHINE_BROADCAST_H
+
+#include "stateMachine.h"
+#include "stateMachineCompile.h"
+
+/**
+ * \brief A group of state machines sharing a compiled definition
+ *
+ * Created by stateM_createGroup(). There is no need to manipulate the
+ * members directly.
+ */
+struct stateMachineGroup
+{
+   /** \brief The compiled state machine all members use */
+   struct compiledStateMachine *compiled;
+   /**
+    * \brief The first member in every state, indexed by \ref state::id
+    * "state id"
+    *
+    * The last element holds the members without a current state.
+    */
+   struct stateMachine **members;
+   /**
+    * \brief The number of members in every state, indexed like #members
+    */
+   size_t *numMembers;
+};
+
+/**
+ * \brief Create an empty group
+ *
+ * \param compiled the compiled state machine the members will be
+ * initialised from with stateM_initCompiled().
+ *
+ * \returns the group, which must be freed with stateM_freeGroup(), or NULL
+ * if \pn{compiled} is NULL or if memory could not be allocated.
+ */
+struct stateMachineGroup *stateM_createGroup(
+      struct compiledStateMachine *compiled );
+
+/**
+ * \brief Free a group
+ *
+ * All members are removed from the group first.
+ *
+ * \param group the group to free. May be NULL.
+ */
+void stateM_freeGroup( struct stateMachineGroup *group );
+
+/**
+ * \brief Add a state machine to a group
+ *
+ * A state machine can be a member of one group at a time. It must be
+ * removed from its group before it is initialised again.
+ *
+ * \param group the group.
+ * \param stateMachine a state machine initialised with
+ * stateM_initCompiled() from the group's compiled state machine.
+ *
+ * \returns true if the state machine was added, or false if an argument is
+ * NULL, if the state machine uses a different compiled state machine, or if
+ * it already is a member of a group.
+ */
+bool stateM_groupAdd( struct stateMachineGroup *group,
+      struct stateMachine *stateMachine );
+
+/**
+ * \brief Remove a state machine from its group
+ *
+ * \param stateMachine the state machine. Nothing is done if it is not a
+ * member of a group.
+ */
+void stateM_groupRemove( struct stateMachine *stateMachine );
+
+/**
+ * \brief Pass an event to the members that may handle it
+ *
+ * The event is passed to every member whose current state, or one of its
+ * parents, has a transition for the event or defers it, and to every
+ * member whose current state has regions. Every such member receives the
+ * event once, even if it changes state. Actions must not add or remove
+ * members of the group.
+ *
+ * \param group the group.
+ * \param event the event.
+ *
+ * \returns the number of members the event was passed to.
+ */
+size_t stateM_broadcastEvent( struct stateMachineGroup *group,
+      struct event *event );
+
+/**
+ * \brief Get the number of members in a state
+ *
+ * Only the members whose current state is \pn{state} are counted, not
+ * those in one of its child states.
+ *
+ * \param group the group.
+ * \param state the state, or NULL to count the members without a current
+ * state.
+ *
+ * \returns the number of members, or 0 if \pn{group} is NULL or if
+ * \pn{state} is not part of the group's definition.
+ */
+size_t stateM_groupCount( struct stateMachineGroup *group,
+      struct state *state );
+
+/**
+ * \brief Get the first member in a state
+ *
+ * \param group the group.
+ * \param state the state, or NULL for the members without a current state.
+ *
+ * \returns the first member, or NULL if there are no members in
+ * \pn{state}. The others are found with stateM_groupNext().
+ */
+struct stateMachine *stateM_groupFirst( struct stateMachineGroup *group,
+      struct state *state );
+
+/**
+ * \brief Get the next member in the same state
+ *
+ * \param stateMachine a member of a group.
+ *
+ * \returns the next member in the same state, or NULL if \pn{stateMachine}
+ * is the last one.
+ */
+struct stateMachine *stateM_groupNext( struct stateMachine *stateMachine );
+
+/**
+ * \brief Call a function for every member in a state
+ *
+ * The function is called once for every member whose current state was
+ * \pn{state} when stateM_groupForEach() was called, even if it changes the
+ * member's state (by passing it an event) or removes it from the group.
+ * It must not add, remove or pass events to other members.
+ *
+ * \param group the group.
+ * \param state the state, or NULL for the members without a current state.
+ * \param function the function, which is given the member and \pn{data}.
+ * \param data passed to \pn{function}.
+ *
+ * \returns the number of members \pn{function} was called for.
+ */
+size_t stateM_groupForEach( struct stateMachineGroup *group,
+      struct state *state, void ( *function )( struct stateMachine *,
+         void * ), void *data );
+
+/**
+ * \brief Move a state machine to the list of its new state
+ *
+ * Called by the state machine whenever its current state changes. There is
+ * no need to call this function directly.
+ *
+ * \param stateMachine the state machine, which is a member of a group.
+ * \param oldState the state the state machine left.
+ */
+void stateM_groupStateChanged( struct stateMachine *stateMachine,
+      struct state *oldState );
+
+#endif // STATEMACHINE_BROADCAST_H
+
+/**
+ * @}
+ */
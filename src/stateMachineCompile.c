@@ -0,0 +1,757 @@
+/* 
+ * Copyright (c) 2013 Andreas Misje
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#include "stateMachineCompile.h"
+#include <stdint.h>
+#include <stdlib.h>
+
+/* Smaller event tables are never replaced by a perfect hash: */
+#define MIN_HASHED_TABLE_SIZE 4096
+/* Average number of state and event type pairs in a perfect hash bucket: */
+#define PAIRS_PER_BUCKET 4
+#define MAX_SEEDS ( 1u << 20 )
+/* Set in bucket seeds that are slots: */
+#define DIRECT_SLOT 0x80000000u
+
+struct hashBucket
+{
+   uint32_t bucket;
+   uint32_t size;
+};
+
+static int compareEventTypes( const void *a, const void *b );
+static void compileState( struct compiledStateMachine *compiled,
+      struct state *state, struct compiledEventTransitions *events,
+      size_t *numGuarded );
+static struct compiledEventTransitions *findEvent(
+      const struct compiledStateMachine *compiled, const struct state *state,
+      int eventType );
+static int compareInts( const void *a, const void *b );
+static bool collectEventTypes( struct compiledStateMachine *compiled,
+      size_t numEvents );
+static bool buildEventIds( struct compiledStateMachine *compiled );
+static bool buildEventTable( struct compiledStateMachine *compiled,
+      size_t numEvents );
+static bool buildPerfectHash( struct compiledStateMachine *compiled,
+      size_t numEvents );
+static bool placeKeys( const uint64_t *keys, size_t numKeys,
+      uint32_t *seeds, size_t numSeeds, uint32_t *slotKeys );
+static int compareBuckets( const void *a, const void *b );
+static uint32_t findSlot( const uint32_t *seeds, size_t numSeeds,
+      size_t numSlots, uint64_t key );
+static uint64_t hashKey( uint64_t key, uint32_t seed );
+static uint32_t reduceHash( uint64_t hash, size_t range );
+static size_t countTableableGuards( struct compiledStateMachine *compiled,
+      struct compiledEventTransitions *events );
+static void buildClassTable( struct compiledStateMachine *compiled,
+      struct compiledEventTransitions *events, unsigned char *classTable );
+
+struct compiledStateMachine *stateM_compile(
+      struct stateMachineDefinition *definition )
+{
+   if ( !definition || !definition->verified || definition->numStates >
+         UINT32_MAX )
+      return NULL;
+
+   struct compiledStateMachine *compiled = calloc( 1, sizeof( *compiled ) );
+   size_t numStates = definition->numStates;
+   size_t numTransitions = 0, numAncestors = 0;
+   size_t i;
+
+   if ( !compiled )
+      return NULL;
+
+   for ( i = 0; i < numStates; ++i )
+   {
+      struct state *state = definition->states[ i ];
+
+      state->id = i;
+      numTransitions += state->numTransitions;
+      for ( ; state; state = state->parentState )
+         ++numAncestors;
+   }
+
+   /* There are never more event types or guarded transitions than there are
+    * transitions. One extra element avoids zero-sized allocations: */
+   compiled->definition = definition;
+   compiled->states = calloc( numStates + 1, sizeof( *compiled->states ) );
+   compiled->events = calloc( numTransitions + 1, sizeof(
+            *compiled->events ) );
+   compiled->guardedTransitions = calloc( numTransitions + 1, sizeof(
+            *compiled->guardedTransitions ) );
+   compiled->ancestors = malloc( ( numAncestors + 1 ) * sizeof(
+            *compiled->ancestors ) );
+
+   if ( !compiled->states || !compiled->events ||
+         !compiled->guardedTransitions || !compiled->ancestors )
+   {
+      stateM_freeCompiled( compiled );
+      return NULL;
+   }
+
+   struct compiledEventTransitions *events = compiled->events;
+   uint32_t *ancestors = compiled->ancestors;
+   size_t numGuarded = 0;
+
+   for ( i = 0; i < numStates; ++i )
+   {
+      struct state *state = definition->states[ i ];
+      struct state *ancestor;
+      size_t depth = 0;
+
+      for ( ancestor = state->parentState; ancestor; ancestor =
+            ancestor->parentState )
+         ++depth;
+
+      /* Fill in the ancestors from the state outwards: */
+      compiled->states[ i ].ancestors = ancestors;
+      compiled->states[ i ].depth = depth;
+      for ( ancestor = state; ancestor; ancestor = ancestor->parentState )
+         ancestors[ depth-- ] = (uint32_t)ancestor->id;
+      ancestors += compiled->states[ i ].depth + 1;
+
+      compiled->states[ i ].events = events;
+      compileState( compiled, state, events, &numGuarded );
+      events += compiled->states[ i ].numEvents;
+   }
+
+   /* Number the event types densely, so that tables are sized by the
+    * number of event types used rather than by their values: */
+   size_t numEvents = events - compiled->events;
+   if ( !collectEventTypes( compiled, numEvents ) || !buildEventIds(
+            compiled ) || !buildEventTable( compiled, numEvents ) )
+   {
+      stateM_freeCompiled( compiled );
+      return NULL;
+   }
+
+   /* Build class tables for all event types starting with enough
+    * declarative guards: */
+   size_t numClassTables = 0;
+
+   for ( i = 0; i < numEvents; ++i )
+      if ( countTableableGuards( compiled, &compiled->events[ i ] ) )
+         ++numClassTables;
+
+   if ( numClassTables )
+   {
+      compiled->classTables = malloc( numClassTables * 256 );
+      if ( !compiled->classTables )
+      {
+         stateM_freeCompiled( compiled );
+         return NULL;
+      }
+   }
+
+   unsigned char *classTable = compiled->classTables;
+   for ( i = 0; i < numEvents; ++i )
+   {
+      if ( countTableableGuards( compiled, &compiled->events[ i ] ) )
+      {
+         buildClassTable( compiled, &compiled->events[ i ], classTable );
+         classTable += 256;
+      }
+   }
+
+   return compiled;
+}
+
+void stateM_freeCompiled( struct compiledStateMachine *compiled )
+{
+   if ( !compiled )
+      return;
+
+   free( compiled->states );
+   free( compiled->events );
+   free( compiled->guardedTransitions );
+   free( compiled->classTables );
+   free( compiled->ancestors );
+   free( compiled->eventTypes );
+   free( compiled->eventIds );
+   free( compiled->eventIdSeeds );
+   free( compiled->eventTable );
+   free( compiled->eventSeeds );
+   free( compiled->eventSlots );
+   free( compiled );
+}
+
+void stateM_initCompiled( struct stateMachine *fsm,
+      struct compiledStateMachine *compiled )
+{
+   if ( !fsm || !compiled )
+      return;
+
+   stateM_initWithDefinition( fsm, compiled->definition );
+   fsm->compiled = compiled;
+}
+
+struct transition *stateM_compiledTransition(
+      const struct compiledStateMachine *compiled, struct state *state,
+      struct event *event, struct guardMemo *memo )
+{
+   struct compiledEventTransitions *events = findEvent( compiled, state,
+         event->type );
+   size_t i;
+
+   if ( !events )
+      return NULL;
+
+   i = 0;
+
+   /* Look up the first leading declarative guard that holds in the class
+    * table. If none do, continue with the rest of the guards: */
+   if ( events->classTable )
+   {
+      intptr_t value = (intptr_t)event->data;
+
+      if ( value >= 0 && value < 256 )
+      {
+         unsigned char match = events->classTable[ value ];
+         if ( match )
+            return compiled->guardedTransitions[ events->firstGuarded +
+               match - 1 ];
+
+         i = events->numTabled;
+      }
+   }
+
+   /* Only guarded transitions need to be tried in order. If there are none,
+    * the default transition is taken right away: */
+   for ( ; i < events->numGuarded; ++i )
+   {
+      struct transition *t = compiled->guardedTransitions[
+         events->firstGuarded + i ];
+
+      if ( stateM_guardHolds( t, event, memo ) )
+         return t;
+   }
+
+   return events->defaultTransition;
+}
+
+bool stateM_compiledHandles( const struct compiledStateMachine *compiled,
+      struct state *state, int eventType )
+{
+   return findEvent( compiled, state, eventType ) != NULL;
+}
+
+size_t stateM_compiledEventId( const struct compiledStateMachine *compiled,
+      int eventType )
+{
+   uint32_t slot;
+
+   if ( compiled->eventIdSeeds )
+   {
+      slot = findSlot( compiled->eventIdSeeds, compiled->numEventIdSeeds,
+            compiled->numEventIdSlots, (uint32_t)eventType );
+      if ( slot == UINT32_MAX )
+         return STATEM_NO_EVENT_ID;
+   }
+   else
+   {
+      /* Event types below the smallest one wrap around to large slots: */
+      slot = (uint32_t)eventType - (uint32_t)compiled->minEventType;
+      if ( slot >= compiled->numEventIdSlots )
+         return STATEM_NO_EVENT_ID;
+   }
+
+   uint32_t id = compiled->eventIds[ slot ];
+   if ( !id || compiled->eventTypes[ id - 1 ] != eventType )
+      return STATEM_NO_EVENT_ID;
+
+   return id - 1;
+}
+
+struct state *stateM_compiledCommonAncestor(
+      const struct compiledStateMachine *compiled, struct state *first,
+      struct state *second )
+{
+   const struct compiledState *a = &compiled->states[ first->id ];
+   const struct compiledState *b = &compiled->states[ second->id ];
+   size_t depth = a->depth < b->depth ? a->depth : b->depth;
+   size_t i;
+
+   /* The common prefix ends at the first depth where the chains differ: */
+   for ( i = 0; i <= depth && a->ancestors[ i ] == b->ancestors[ i ]; ++i )
+      ;
+
+   return i ? compiled->definition->states[ a->ancestors[ i - 1 ] ] : NULL;
+}
+
+static int compareEventTypes( const void *a, const void *b )
+{
+   int typeA = ( (const struct compiledEventTransitions *)a )->eventType;
+   int typeB = ( (const struct compiledEventTransitions *)b )->eventType;
+
+   return ( typeA > typeB ) - ( typeA < typeB );
+}
+
+static void compileState( struct compiledStateMachine *compiled,
+      struct state *state, struct compiledEventTransitions *events,
+      size_t *numGuarded )
+{
+   struct compiledState *compiledState = &compiled->states[ state->id ];
+   size_t i, j;
+
+   /* Visit the event types in the order they first appear in, and collect
+    * all the transitions for each of them, preserving their order: */
+   for ( i = 0; i < state->numTransitions; ++i )
+   {
+      int eventType = state->transitions[ i ].eventType;
+
+      for ( j = 0; j < compiledState->numEvents; ++j )
+         if ( events[ j ].eventType == eventType )
+            break;
+
+      if ( j < compiledState->numEvents )
+         continue;
+
+      struct compiledEventTransitions *event =
+         &events[ compiledState->numEvents++ ];
+      event->eventType = eventType;
+      event->firstGuarded = *numGuarded;
+
+      for ( j = i; j < state->numTransitions; ++j )
+      {
+         struct transition *t = &state->transitions[ j ];
+
+         if ( t->eventType != eventType )
+            continue;
+
+         /* Nothing after the first unguarded transition will ever be
+          * taken: */
+         if ( t->guardKind == stateM_guardFunction && !t->guard )
+         {
+            event->defaultTransition = t;
+            break;
+         }
+
+         compiled->guardedTransitions[ ( *numGuarded )++ ] = t;
+         ++event->numGuarded;
+      }
+   }
+
+   qsort( events, compiledState->numEvents, sizeof( *events ),
+         &compareEventTypes );
+}
+
+static struct compiledEventTransitions *findEvent(
+      const struct compiledStateMachine *compiled, const struct state *state,
+      int eventType )
+{
+   size_t id = stateM_compiledEventId( compiled, eventType );
+   if ( id == STATEM_NO_EVENT_ID )
+      return NULL;
+
+   const struct compiledState *compiledState = &compiled->states[
+      state->id ];
+
+   if ( !compiled->eventSlots )
+   {
+      uint32_t index = compiled->eventTable[ state->id *
+         compiled->numEventTypes + id ];
+      return index ? &compiledState->events[ index - 1 ] : NULL;
+   }
+
+   uint32_t slot = findSlot( compiled->eventSeeds, compiled->numEventSeeds,
+         compiled->numEventSlots, (uint64_t)state->id *
+         compiled->numEventTypes + id );
+   if ( slot == UINT32_MAX )
+      return NULL;
+
+   uint16_t index = compiled->eventSlots[ slot ];
+
+   /* The slot may belong to any other pair: */
+   if ( index >= compiledState->numEvents ||
+         compiledState->events[ index ].eventType != eventType )
+      return NULL;
+
+   return &compiledState->events[ index ];
+}
+
+static int compareInts( const void *a, const void *b )
+{
+   int first = *(const int *)a;
+   int second = *(const int *)b;
+
+   return ( first > second ) - ( first < second );
+}
+
+static bool collectEventTypes( struct compiledStateMachine *compiled,
+      size_t numEvents )
+{
+   size_t i, n = 0;
+
+   compiled->eventTypes = malloc( ( numEvents + 1 ) * sizeof(
+            *compiled->eventTypes ) );
+   if ( !compiled->eventTypes )
+      return false;
+
+   for ( i = 0; i < numEvents; ++i )
+      compiled->eventTypes[ i ] = compiled->events[ i ].eventType;
+
+   qsort( compiled->eventTypes, numEvents, sizeof( *compiled->eventTypes ),
+         &compareInts );
+
+   for ( i = 0; i < numEvents; ++i )
+      if ( !n || compiled->eventTypes[ n - 1 ] != compiled->eventTypes[ i ] )
+         compiled->eventTypes[ n++ ] = compiled->eventTypes[ i ];
+
+   compiled->numEventTypes = n;
+   return n < UINT32_MAX;
+}
+
+static bool buildEventIds( struct compiledStateMachine *compiled )
+{
+   size_t n = compiled->numEventTypes;
+   size_t i;
+
+   /* Event types that are close together are looked up in a direct
+    * table: */
+   uint32_t range = n ? (uint32_t)compiled->eventTypes[ n - 1 ] -
+      (uint32_t)compiled->eventTypes[ 0 ] + 1 : 1;
+
+   /* Sparse event types (protocol opcodes, for instance) are hashed like
+    * state and event type pairs instead. The hash takes five bytes per
+    * event type, however sparse they are, rather than four bytes for every
+    * value in their range: */
+   if ( !range || range > 4 * n + 64 )
+   {
+      size_t numSeeds = ( n + PAIRS_PER_BUCKET - 1 ) / PAIRS_PER_BUCKET;
+      uint64_t *keys = malloc( n * sizeof( *keys ) );
+      bool success = false;
+
+      compiled->eventIdSeeds = calloc( numSeeds, sizeof(
+               *compiled->eventIdSeeds ) );
+      compiled->eventIds = calloc( n, sizeof( *compiled->eventIds ) );
+
+      if ( keys && compiled->eventIdSeeds && compiled->eventIds )
+      {
+         for ( i = 0; i < n; ++i )
+            keys[ i ] = (uint32_t)compiled->eventTypes[ i ];
+
+         /* The slots hold the dense ids plus one: */
+         success = placeKeys( keys, n, compiled->eventIdSeeds, numSeeds,
+               compiled->eventIds );
+      }
+      free( keys );
+
+      if ( success )
+      {
+         compiled->numEventIdSeeds = numSeeds;
+         compiled->numEventIdSlots = n;
+         return true;
+      }
+
+      free( compiled->eventIdSeeds );
+      free( compiled->eventIds );
+      compiled->eventIdSeeds = NULL;
+      compiled->eventIds = NULL;
+
+      /* Fall back to the direct table, if the event types' range fits: */
+      if ( !range )
+         return false;
+   }
+
+   compiled->minEventType = n ? compiled->eventTypes[ 0 ] : 0;
+   compiled->numEventIdSlots = range;
+   compiled->eventIds = calloc( range, sizeof( *compiled->eventIds ) );
+   if ( !compiled->eventIds )
+      return false;
+
+   for ( i = 0; i < n; ++i )
+      compiled->eventIds[ (uint32_t)compiled->eventTypes[ i ] -
+         (uint32_t)compiled->minEventType ] = (uint32_t)i + 1;
+
+   return true;
+}
+
+static bool buildEventTable( struct compiledStateMachine *compiled,
+      size_t numEvents )
+{
+   size_t numStates = compiled->definition->numStates;
+   size_t i, j;
+
+   bool fits = !compiled->numEventTypes || numStates < SIZE_MAX /
+      compiled->numEventTypes;
+   size_t tableSize = fits ? numStates * compiled->numEventTypes : SIZE_MAX;
+
+   /* Hash the state and event type pairs instead if the table would be
+    * mostly empty: */
+   if ( STATEM_PERFECT_HASH_RATIO && tableSize > MIN_HASHED_TABLE_SIZE &&
+         tableSize / STATEM_PERFECT_HASH_RATIO > numEvents &&
+         buildPerfectHash( compiled, numEvents ) )
+      return true;
+
+   if ( !fits )
+      return false;
+
+   compiled->eventTable = calloc( numStates * compiled->numEventTypes + 1,
+         sizeof( *compiled->eventTable ) );
+   if ( !compiled->eventTable )
+      return false;
+
+   for ( i = 0; i < numStates; ++i )
+   {
+      struct compiledState *state = &compiled->states[ i ];
+
+      for ( j = 0; j < state->numEvents; ++j )
+         compiled->eventTable[ i * compiled->numEventTypes +
+            stateM_compiledEventId( compiled, state->events[ j ].eventType )
+            ] = (uint32_t)j + 1;
+   }
+
+   return true;
+}
+
+static bool buildPerfectHash( struct compiledStateMachine *compiled,
+      size_t numEvents )
+{
+   size_t numStates = compiled->definition->numStates;
+   size_t numSeeds = ( numEvents + PAIRS_PER_BUCKET - 1 ) / PAIRS_PER_BUCKET;
+   size_t i, j, k;
+
+   /* Slots hold indices into a state's events: */
+   for ( i = 0; i < numStates; ++i )
+      if ( compiled->states[ i ].numEvents > UINT16_MAX )
+         return false;
+
+   /* The pairs' keys and indices into their states' events by event index
+    * (the states' events are stored in order of state id): */
+   uint64_t *keys = malloc( numEvents * sizeof( *keys ) );
+   uint16_t *positions = malloc( numEvents * sizeof( *positions ) );
+   uint32_t *slotKeys = calloc( numEvents, sizeof( *slotKeys ) );
+   compiled->eventSeeds = calloc( numSeeds, sizeof( *compiled->eventSeeds ) );
+   compiled->eventSlots = calloc( numEvents, sizeof( *compiled->eventSlots ) );
+   bool success = keys && positions && slotKeys && compiled->eventSeeds &&
+      compiled->eventSlots;
+
+   for ( i = 0, k = 0; success && i < numStates; ++i )
+   {
+      struct compiledState *state = &compiled->states[ i ];
+
+      for ( j = 0; j < state->numEvents; ++j, ++k )
+      {
+         keys[ k ] = (uint64_t)i * compiled->numEventTypes +
+            stateM_compiledEventId( compiled, state->events[ j ].eventType );
+         positions[ k ] = (uint16_t)j;
+      }
+   }
+
+   success = success && placeKeys( keys, numEvents, compiled->eventSeeds,
+         numSeeds, slotKeys );
+
+   for ( i = 0; success && i < numEvents; ++i )
+      compiled->eventSlots[ i ] = positions[ slotKeys[ i ] - 1 ];
+
+   free( keys );
+   free( positions );
+   free( slotKeys );
+
+   if ( !success )
+   {
+      free( compiled->eventSeeds );
+      free( compiled->eventSlots );
+      compiled->eventSeeds = NULL;
+      compiled->eventSlots = NULL;
+      return false;
+   }
+
+   compiled->numEventSeeds = numSeeds;
+   compiled->numEventSlots = numEvents;
+   return true;
+}
+
+/* Hash and displace: the keys are hashed into buckets, and every bucket is
+ * given a seed that hashes its keys into free slots. There is one slot for
+ * every key, and the slots are filled with key indices plus one: */
+static bool placeKeys( const uint64_t *keys, size_t numKeys,
+      uint32_t *seeds, size_t numSeeds, uint32_t *slotKeys )
+{
+   size_t i, j, k;
+
+   if ( !numKeys || numKeys >= DIRECT_SLOT )
+      return false;
+
+   /* The key indices sorted by bucket: */
+   uint32_t *indices = malloc( numKeys * sizeof( *indices ) );
+   size_t *bucketStarts = calloc( numSeeds + 1, sizeof( *bucketStarts ) );
+   struct hashBucket *buckets = malloc( numSeeds * sizeof( *buckets ) );
+   bool success = indices && bucketStarts && buckets;
+
+   if ( success )
+   {
+      for ( k = 0; k < numKeys; ++k )
+         ++bucketStarts[ reduceHash( hashKey( keys[ k ], 0 ), numSeeds ) + 1 ];
+
+      for ( i = 0; i < numSeeds; ++i )
+      {
+         bucketStarts[ i + 1 ] += bucketStarts[ i ];
+         buckets[ i ] = (struct hashBucket){ (uint32_t)i, 0 };
+      }
+
+      for ( k = 0; k < numKeys; ++k )
+      {
+         uint32_t bucket = reduceHash( hashKey( keys[ k ], 0 ), numSeeds );
+         indices[ bucketStarts[ bucket ] + buckets[ bucket ].size++ ] =
+            (uint32_t)k;
+      }
+
+      qsort( buckets, numSeeds, sizeof( *buckets ), &compareBuckets );
+   }
+
+   /* Find seeds for the largest buckets first, while most slots are
+    * free: */
+   size_t nextFree = 0;
+   for ( i = 0; success && i < numSeeds && buckets[ i ].size; ++i )
+   {
+      uint32_t bucket = buckets[ i ].bucket;
+      uint32_t *bucketIndices = &indices[ bucketStarts[ bucket ] ];
+      uint32_t seed;
+
+      /* Single keys go into any free slot, which is found quickly since
+       * they come last: */
+      if ( buckets[ i ].size == 1 )
+      {
+         while ( slotKeys[ nextFree ] )
+            ++nextFree;
+
+         slotKeys[ nextFree ] = bucketIndices[ 0 ] + 1;
+         seeds[ bucket ] = (uint32_t)nextFree | DIRECT_SLOT;
+         continue;
+      }
+
+      for ( seed = 1; seed < MAX_SEEDS; ++seed )
+      {
+         for ( j = 0; j < buckets[ i ].size; ++j )
+         {
+            uint32_t slot = reduceHash( hashKey( keys[ bucketIndices[ j ] ],
+                     seed ), numKeys );
+            if ( slotKeys[ slot ] )
+               break;
+
+            slotKeys[ slot ] = bucketIndices[ j ] + 1;
+         }
+
+         if ( j == buckets[ i ].size )
+            break;
+
+         while ( j-- )
+            slotKeys[ reduceHash( hashKey( keys[ bucketIndices[ j ] ], seed ),
+                     numKeys ) ] = 0;
+      }
+
+      seeds[ bucket ] = seed;
+      success = seed < MAX_SEEDS;
+   }
+
+   free( indices );
+   free( bucketStarts );
+   free( buckets );
+
+   return success;
+}
+
+static int compareBuckets( const void *a, const void *b )
+{
+   const struct hashBucket *first = a;
+   const struct hashBucket *second = b;
+
+   /* Largest first, in order of buckets otherwise, so that the hash does
+    * not depend on qsort(): */
+   if ( first->size != second->size )
+      return first->size < second->size ? 1 : -1;
+
+   return ( first->bucket > second->bucket ) - ( first->bucket <
+         second->bucket );
+}
+
+/* Returns UINT32_MAX if the key's bucket is empty. Otherwise, the slot may
+ * belong to any other key: */
+static uint32_t findSlot( const uint32_t *seeds, size_t numSeeds,
+      size_t numSlots, uint64_t key )
+{
+   uint32_t seed = seeds[ reduceHash( hashKey( key, 0 ), numSeeds ) ];
+   if ( !seed )
+      return UINT32_MAX;
+
+   return seed & DIRECT_SLOT ? seed & ~DIRECT_SLOT : reduceHash( hashKey(
+            key, seed ), numSlots );
+}
+
+static uint64_t hashKey( uint64_t key, uint32_t seed )
+{
+   key ^= seed * UINT64_C( 0x9e3779b97f4a7c15 );
+   key = ( key ^ ( key >> 30 ) ) * UINT64_C( 0xbf58476d1ce4e5b9 );
+   key = ( key ^ ( key >> 27 ) ) * UINT64_C( 0x94d049bb133111eb );
+
+   return key ^ ( key >> 31 );
+}
+
+static uint32_t reduceHash( uint64_t hash, size_t range )
+{
+   /* Scale the upper 32 bits to the range instead of dividing: */
+   return (uint32_t)( ( hash >> 32 ) * range >> 32 );
+}
+
+static size_t countTableableGuards( struct compiledStateMachine *compiled,
+      struct compiledEventTransitions *events )
+{
+   size_t n;
+
+   /* Table indices must fit in an unsigned char (zero means no match): */
+   for ( n = 0; n < events->numGuarded && n < 255; ++n )
+      if ( compiled->guardedTransitions[ events->firstGuarded + n
+            ]->guardKind == stateM_guardFunction )
+         break;
+
+   return n >= STATEM_MIN_CLASS_TABLE_GUARDS ? n : 0;
+}
+
+static void buildClassTable( struct compiledStateMachine *compiled,
+      struct compiledEventTransitions *events, unsigned char *classTable )
+{
+   size_t numTabled = countTableableGuards( compiled, events );
+   struct event event = { .type = events->eventType };
+   size_t value, i;
+
+   /* Record the first transition whose guard holds for every value,
+    * preserving the order of the transitions: */
+   for ( value = 0; value < 256; ++value )
+   {
+      event.data = (void *)(intptr_t)value;
+      classTable[ value ] = 0;
+
+      for ( i = 0; i < numTabled; ++i )
+      {
+         if ( stateM_guardHolds( compiled->guardedTransitions[
+                  events->firstGuarded + i ], &event, NULL ) )
+         {
+            classTable[ value ] = i + 1;
+            break;
+         }
+      }
+   }
+
+   events->classTable = classTable;
+   events->numTabled = numTabled;
+}
@@ -0,0 +1,341 @@
+/* 
+ * Copyright (c) 2013 Andreas Misje
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+/**
+ * \addtogroup stateMachine
+ * @{
+ *
+ * \file
+ * \brief Compiled state machines
+ *
+ * A \ref stateMachineDefinition "state machine definition" may be compiled
+ * into lookup tables that let stateM_handleEvent() find the transitions for
+ * an event without scanning the states' transition arrays.
+ */
+
+#ifndef STATEMACHINE_COMPILE_H
+#define STATEMACHINE_COMPILE_H
+
+#include "stateMachine.h"
+#include <stdint.h>
+
+/**
+ * \brief Minimum number of leading declarative guards for which a class
+ * table is built
+ *
+ * Testing a single guard directly is cheaper than a table lookup. This
+ * macro may be defined by the user.
+ */
+#ifndef STATEM_MIN_CLASS_TABLE_GUARDS
+#define STATEM_MIN_CLASS_TABLE_GUARDS 2
+#endif
+
+/**
+ * \brief Ratio of table entries to transitions above which transitions are
+ * found through a perfect hash
+ *
+ * A state machine with many event types, each handled by only a few states,
+ * would need a large \ref compiledStateMachine::eventTable "event table"
+ * that is mostly empty. If the table has more than this many entries for
+ * every state's event type with transitions (and is not small anyway), a
+ * minimal perfect hash over these pairs is built instead, unless a state
+ * has transitions for more than UINT16_MAX event types. The hash takes about
+ * three bytes per pair: a 32-bit seed for every four pairs on average, and
+ * a 16-bit slot for every pair. Zero always builds the table. This macro
+ * may be defined by the user.
+ */
+#ifndef STATEM_PERFECT_HASH_RATIO
+#define STATEM_PERFECT_HASH_RATIO 16
+#endif
+
+/**
+ * \brief Returned by stateM_compiledEventId() for event types that no
+ * transition uses
+ */
+#define STATEM_NO_EVENT_ID SIZE_MAX
+
+/**
+ * \brief The transitions of a state for a single event type
+ *
+ * The transitions are partitioned into a chain of guarded transitions,
+ * which are tried in order, and an optional unguarded default transition,
+ * which is taken if none of the guards hold. Transitions following the
+ * first unguarded transition can never be taken and are left out. If there
+ * are no guarded transitions, the default transition is found without
+ * calling any guards.
+ *
+ * If the chain starts with at least #STATEM_MIN_CLASS_TABLE_GUARDS \ref
+ * stateM_guardKinds "declarative guards", a class table is built for them.
+ * The table maps every payload value from 0 to 255 to the first of these
+ * transitions whose guard holds, so that they can all be tested with a
+ * single lookup.
+ */
+struct compiledEventTransitions
+{
+   /** \brief The event type */
+   int eventType;
+   /**
+    * \brief Index of the first guarded transition in \ref
+    * compiledStateMachine::guardedTransitions
+    */
+   size_t firstGuarded;
+   /** \brief Number of guarded transitions */
+   size_t numGuarded;
+   /** \brief The first unguarded transition, or NULL */
+   struct transition *defaultTransition;
+   /**
+    * \brief Class table for the first #numTabled guarded transitions, or
+    * NULL
+    *
+    * Entry \c n is zero if none of the transitions' guards hold for the
+    * payload value \c n. Otherwise, it is the (one-based) index of the
+    * first transition whose guard holds.
+    */
+   unsigned char *classTable;
+   /** \brief Number of guarded transitions covered by #classTable */
+   size_t numTabled;
+};
+
+/**
+ * \brief A compiled state
+ */
+struct compiledState
+{
+   /**
+    * \brief The state's transitions, grouped by event type and sorted by
+    * event type
+    */
+   struct compiledEventTransitions *events;
+   /** \brief Number of event types in #events */
+   size_t numEvents;
+   /**
+    * \brief The \ref state::id "ids" of the state's ancestors, indexed by
+    * depth, followed by the state's own id
+    *
+    * Element 0 is the outermost ancestor (the state itself if it has no
+    * parent), and element #depth is the state. Two states' innermost common
+    * ancestor is the last element of their common prefix.
+    */
+   const uint32_t *ancestors;
+   /** \brief Number of ancestors (0 for states without a parent) */
+   size_t depth;
+};
+
+/**
+ * \brief Compiled state machine
+ *
+ * Created by stateM_compile(). There is no need to manipulate the members
+ * directly.
+ */
+struct compiledStateMachine
+{
+   /** \brief The definition that was compiled */
+   struct stateMachineDefinition *definition;
+   /** \brief Compiled states, indexed by \ref state::id "state id" */
+   struct compiledState *states;
+   /** \brief Storage for all states' \ref compiledState::events "events" */
+   struct compiledEventTransitions *events;
+   /** \brief All guarded transitions, grouped by state and event type */
+   struct transition **guardedTransitions;
+   /** \brief Storage for all \ref compiledEventTransitions::classTable
+    * "class tables" */
+   unsigned char *classTables;
+   /** \brief Storage for all states' \ref compiledState::ancestors
+    * "ancestors" */
+   uint32_t *ancestors;
+   /** \brief Number of distinct event types used by the transitions */
+   size_t numEventTypes;
+   /**
+    * \brief The distinct event types, in ascending order
+    *
+    * An event type's index in this array is its dense id.
+    */
+   int *eventTypes;
+   /**
+    * \brief Maps event types to dense ids plus one (zero for unused slots)
+    *
+    * If #eventIdSeeds is NULL, the table is indexed by the event type minus
+    * #minEventType. Otherwise, sparse event types are found through a
+    * minimal perfect hash, like the pairs in #eventSlots, with a slot for
+    * every event type. The key is the event type as an unsigned 32-bit
+    * value.
+    */
+   uint32_t *eventIds;
+   /** \brief Number of elements in #eventIds */
+   size_t numEventIdSlots;
+   /** \brief The smallest event type, if #eventIds is a direct table */
+   int minEventType;
+   /** \brief Number of elements in #eventIdSeeds */
+   size_t numEventIdSeeds;
+   /**
+    * \brief Hash seeds for buckets of event types, like #eventSeeds, or
+    * NULL if #eventIds is a direct table
+    */
+   uint32_t *eventIdSeeds;
+   /**
+    * \brief #numEventTypes entries for every state, indexed by \ref
+    * state::id "state id" and dense event id
+    *
+    * Every entry is zero if the state has no transitions for the event
+    * type, and otherwise one more than the index of the event type in the
+    * state's \ref compiledState::events "events".
+    *
+    * NULL if the transitions are found through #eventSlots instead (see
+    * #STATEM_PERFECT_HASH_RATIO).
+    */
+   uint32_t *eventTable;
+   /** \brief Number of elements in #eventSeeds */
+   size_t numEventSeeds;
+   /**
+    * \brief Hash seeds for buckets of state and event type pairs
+    *
+    * A pair's bucket, chosen by hashing the pair's key (the \ref state::id
+    * "state id" times #numEventTypes plus the dense event id), holds the
+    * seed with which the key is hashed again to find its slot in
+    * #eventSlots. Buckets with only a single pair have the slot itself with
+    * the highest bit set instead, and empty buckets hold zero.
+    */
+   uint32_t *eventSeeds;
+   /** \brief Number of elements in #eventSlots, one for every pair */
+   size_t numEventSlots;
+   /**
+    * \brief Indices into the states' \ref compiledState::events "events",
+    * or NULL if #eventTable is used
+    *
+    * Keys that are not a state's event type with transitions hash to an
+    * arbitrary slot, so the event type found must be checked.
+    */
+   uint16_t *eventSlots;
+};
+
+/**
+ * \brief Compile a state machine definition
+ *
+ * Every state in the definition is given its \ref state::id "id". The
+ * definition must have been successfully \ref stateM_validate() "validated",
+ * and it must not be modified while the compiled state machine is in use.
+ *
+ * \param definition the definition to compile.
+ *
+ * \returns the compiled state machine, which must be freed with
+ * stateM_freeCompiled(), or NULL if \pn{definition} is NULL or not verified,
+ * if it has more than UINT32_MAX states, or if memory could not be
+ * allocated.
+ */
+struct compiledStateMachine *stateM_compile(
+      struct stateMachineDefinition *definition );
+
+/**
+ * \brief Free a compiled state machine
+ *
+ * No state machine may use the compiled state machine after it has been
+ * freed.
+ *
+ * \param compiled the compiled state machine to free. May be NULL.
+ */
+void stateM_freeCompiled( struct compiledStateMachine *compiled );
+
+/**
+ * \brief Initialise a state machine from a compiled state machine
+ *
+ * This function works like stateM_initWithDefinition(), but
+ * stateM_handleEvent() looks up transitions in the compiled tables.
+ *
+ * \param stateMachine the state machine to initialise.
+ * \param compiled the compiled state machine.
+ */
+void stateM_initCompiled( struct stateMachine *stateMachine,
+      struct compiledStateMachine *compiled );
+
+/**
+ * \brief Find the transition a state takes on an event
+ *
+ * Only the given state's own transitions are considered, not those of its
+ * parents. Guards are called as necessary, in the order the transitions are
+ * defined.
+ *
+ * \param compiled the compiled state machine.
+ * \param state a state in the compiled state machine.
+ * \param event the event.
+ * \param memo see stateM_guardHolds(). May be NULL.
+ *
+ * \returns the first transition for the event whose guard holds, or NULL.
+ */
+struct transition *stateM_compiledTransition(
+      const struct compiledStateMachine *compiled, struct state *state,
+      struct event *event, struct guardMemo *memo );
+
+/**
+ * \brief Check if a state has any transitions for an event type
+ *
+ * Only the given state's own transitions are considered. No guards are
+ * called.
+ *
+ * \param compiled the compiled state machine.
+ * \param state a state in the compiled state machine.
+ * \param eventType the event type.
+ *
+ * \returns true if \pn{state} has at least one transition for
+ * \pn{eventType}.
+ */
+bool stateM_compiledHandles( const struct compiledStateMachine *compiled,
+      struct state *state, int eventType );
+
+/**
+ * \brief Get the dense id of an event type
+ *
+ * Event types may be any int values. The compiled tables are indexed by
+ * dense ids instead, numbered from zero in ascending order of the event
+ * types used by the definition's transitions.
+ *
+ * \param compiled the compiled state machine.
+ * \param eventType the event type.
+ *
+ * \returns the event type's index in \ref compiledStateMachine::eventTypes
+ * "eventTypes", or #STATEM_NO_EVENT_ID if no transition uses it.
+ */
+size_t stateM_compiledEventId( const struct compiledStateMachine *compiled,
+      int eventType );
+
+/**
+ * \brief Find the innermost state containing two states
+ *
+ * The states' \ref compiledState::ancestors "ancestor arrays" are compared
+ * from the outermost ancestor, so no parent pointers are followed.
+ *
+ * \param compiled the compiled state machine.
+ * \param first a state in the compiled state machine.
+ * \param second another state in the compiled state machine.
+ *
+ * \returns the innermost state that is, or is a parent of, both states,
+ * or NULL if they have no common ancestor. A state is its own common
+ * ancestor with itself and with its children.
+ */
+struct state *stateM_compiledCommonAncestor(
+      const struct compiledStateMachine *compiled, struct state *first,
+      struct state *second );
+
+#endif // STATEMACHINE_COMPILE_H
+
+/**
+ * @}
+ */
@@ -0,0 +1,90 @@
+/* 
+ * Copyright (c) 2013 Andreas Misje
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#include "stateMachineConcurrent.h"
+#include "stateMachineInternal.h"
+
+static void publish( struct concurrentStateMachine *fsm );
+
+void stateM_initConcurrent( struct concurrentStateMachine *fsm,
+      struct stateMachineDefinition *definition )
+{
+   size_t i;
+
+   if ( !fsm || !definition )
+      return;
+
+   for ( i = 0; i < definition->numStates; ++i )
+      definition->states[ i ]->id = i;
+
+   stateM_initWithDefinition( &fsm->stateMachine, definition );
+   publish( fsm );
+}
+
+int stateM_handleConcurrentEvent( struct concurrentStateMachine *fsm,
+      struct event *event )
+{
+   if ( !fsm )
+      return stateM_errArg;
+
+   int ret = stateM_handleEvent( &fsm->stateMachine, event );
+   publish( fsm );
+
+   return ret;
+}
+
+struct state *stateM_concurrentState( struct concurrentStateMachine *fsm,
+      struct state **previousState )
+{
+   if ( !fsm )
+      return NULL;
+
+   /* The definition is never modified, so only the published word needs to
+    * be read atomically: */
+   uint64_t published = __atomic_load_n( &fsm->published, __ATOMIC_ACQUIRE );
+   struct stateMachineDefinition *definition = fsm->stateMachine.definition;
+
+   if ( previousState )
+      *previousState = stateM_stateFromId( definition, (uint32_t)published );
+
+   return stateM_stateFromId( definition, (uint32_t)( published >> 32 ) );
+}
+
+bool stateM_concurrentStopped( struct concurrentStateMachine *fsm )
+{
+   struct state *state = stateM_concurrentState( fsm, NULL );
+
+   if ( !state )
+      return true;
+
+   return state->numTransitions == 0 && state->numRegions == 0;
+}
+
+static void publish( struct concurrentStateMachine *fsm )
+{
+   uint64_t published = (uint64_t)stateM_stateId(
+         fsm->stateMachine.currentState ) << 32 | stateM_stateId(
+         fsm->stateMachine.previousState );
+
+   __atomic_store_n( &fsm->published, published, __ATOMIC_RELEASE );
+}
+
@@ -0,0 +1,123 @@
+/* 
+ * Copyright (c) 2013 Andreas Misje
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+/**
+ * \addtogroup stateMachine
+ * @{
+ *
+ * \file
+ * \brief State machines whose state may be read by other threads
+ *
+ * Reading \ref stateMachine::currentState "currentState" while another
+ * thread is in stateM_handleEvent() is a data race. A concurrent state
+ * machine publishes its current and previous state, packed into a single
+ * word, after every event. Any number of threads may read a consistent
+ * snapshot of both without locking, and without slowing down the thread
+ * handling events.
+ */
+
+#ifndef STATEMACHINE_CONCURRENT_H
+#define STATEMACHINE_CONCURRENT_H
+
+#include "stateMachine.h"
+#include <stdint.h>
+
+/**
+ * \brief A state machine with a published state
+ *
+ * Only one thread may handle events, using stateM_handleConcurrentEvent().
+ * Other threads must only use stateM_concurrentState() and
+ * stateM_concurrentStopped().
+ */
+struct concurrentStateMachine
+{
+   /** \brief The state machine, only used by the thread handling events */
+   struct stateMachine stateMachine;
+   /**
+    * \brief The \ref state::id "ids" of the current state (upper 32 bits)
+    * and the previous state (lower 32 bits)
+    *
+    * All bits of an id are set if there is no such state.
+    */
+   uint64_t published;
+};
+
+/**
+ * \brief Initialise a concurrent state machine
+ *
+ * Every state in the definition is given its \ref state::id "id". The
+ * definition must not be modified while the state machine is in use.
+ *
+ * \param stateMachine the concurrent state machine to initialise.
+ * \param definition the definition. It must have fewer than \c UINT32_MAX
+ * states.
+ */
+void stateM_initConcurrent( struct concurrentStateMachine *stateMachine,
+      struct stateMachineDefinition *definition );
+
+/**
+ * \brief Pass an event to a concurrent state machine
+ *
+ * Works like stateM_handleEvent(), and publishes the resulting state.
+ * Intermediate states are never published.
+ *
+ * \param stateMachine the concurrent state machine.
+ * \param event the event.
+ *
+ * \returns the value stateM_handleEvent() returns.
+ */
+int stateM_handleConcurrentEvent(
+      struct concurrentStateMachine *stateMachine, struct event *event );
+
+/**
+ * \brief Get the published state of a concurrent state machine
+ *
+ * May be called from any thread.
+ *
+ * \param stateMachine the concurrent state machine.
+ * \param previousState if non-NULL, set to the previous state published
+ * together with the current state.
+ *
+ * \returns the current state, or NULL if \pn{stateMachine} is NULL.
+ */
+struct state *stateM_concurrentState(
+      struct concurrentStateMachine *stateMachine,
+      struct state **previousState );
+
+/**
+ * \brief Check if a concurrent state machine has stopped
+ *
+ * Works like stateM_stopped() on the published state. May be called from
+ * any thread.
+ *
+ * \param stateMachine the concurrent state machine.
+ *
+ * \returns true if the published state has no transitions or regions, or
+ * if \pn{stateMachine} is NULL.
+ */
+bool stateM_concurrentStopped( struct concurrentStateMachine *stateMachine );
+
+#endif // STATEMACHINE_CONCURRENT_H
+
+/**
+ * @}
+ */
@@ -0,0 +1,279 @@
+/* 
+ * Copyright (c) 2013 Andreas Misje
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+
+/**
+ * \addtogroup stateMachine
+ * @{
+ *
+ * \file
+ * \brief Coroutines as asynchronous actions (C++20)
+ *
+ * Actions are plain functions, so an action that needs to wait for I/O
+ * either blocks the thread handling events or has to be split into
+ * artificial waiting states. With this header, an action may be a C++20
+ * coroutine returning stateM::action. If the coroutine suspends, the state
+ * machine is \ref stateM_suspend() "suspended" until it has completed:
+ * the transition that started it completes as usual, but events passed to
+ * the state machine in the meantime are queued, and the thread is free to
+ * handle events for other state machines.
+ *
+ * ~~~{.cpp}
+ * stateM::action lookUp( void *stateData, struct event *event )
+ * {
+ *    struct session *session = static_cast<struct session *>( event->data );
+ *    session->record = co_await database.find( session->key );
+ *    stateM_postEvent( &session->stateMachine, &loadedEvent );
+ * }
+ *
+ * struct state loadingState = {
+ *    .entryAction = &stateM::asyncAction<&lookUp>,
+ * };
+ * ~~~
+ *
+ * The state machines must be passed events with stateM::handleEvent(),
+ * which records which state machine the coroutines belong to. The event
+ * passed to the coroutine is only valid until it first suspends. A
+ * suspended coroutine must be resumed by the thread that passes events to
+ * its state machine, and never while stateM::handleEvent() runs for the
+ * same state machine. Coroutines must not let exceptions escape.
+ */
+
+#ifndef STATEMACHINE_COROUTINE_HPP
+#define STATEMACHINE_COROUTINE_HPP
+
+#include <coroutine>
+#include <exception>
+
+extern "C" {
+#include "stateMachine.h"
+}
+
+namespace stateM
+{
+   namespace detail
+   {
+      /** \brief The state machine handling an event in this thread */
+      inline thread_local struct stateMachine *running = nullptr;
+
+      /** \brief Sets #running for as long as it exists */
+      class runningScope
+      {
+      public:
+         explicit runningScope( struct stateMachine *stateMachine )
+            : previous( running )
+         {
+            running = stateMachine;
+         }
+
+         ~runningScope()
+         {
+            running = previous;
+         }
+
+         runningScope( const runningScope & ) = delete;
+         runningScope &operator=( const runningScope & ) = delete;
+
+      private:
+         struct stateMachine *previous;
+      };
+   }
+
+   /**
+    * \brief Pass an event to a state machine whose actions may be
+    * coroutines
+    *
+    * \sa stateM_handleEvent()
+    */
+   inline int handleEvent( struct stateMachine *stateMachine,
+         struct event *event )
+   {
+      detail::runningScope scope( stateMachine );
+      return stateM_handleEvent( stateMachine, event );
+   }
+
+   /**
+    * \brief Handle the events queued while an asynchronous action was
+    * running
+    *
+    * Called when a coroutine has completed. There is no need to call this
+    * function directly.
+    *
+    * \sa stateM_resume()
+    */
+   inline int resume( struct stateMachine *stateMachine )
+   {
+      detail::runningScope scope( stateMachine );
+      return stateM_resume( stateMachine );
+   }
+
+   /**
+    * \brief The return type of actions that are coroutines
+    *
+    * The coroutine starts running when the action is called. If it
+    * completes without suspending, nothing else happens. Otherwise, its
+    * state machine is resumed when it completes.
+    */
+   class action
+   {
+   public:
+      class promise_type;
+      using handle = std::coroutine_handle<promise_type>;
+
+      /** \brief Completes a coroutine that outlived its action */
+      struct finalAwaiter
+      {
+         bool await_ready() noexcept
+         {
+            return false;
+         }
+
+         void await_suspend( handle coroutine ) noexcept
+         {
+            promise_type &promise = coroutine.promise();
+
+            /* The action has not returned yet, and destroys the coroutine
+             * itself: */
+            if ( !promise.released )
+               return;
+
+            struct stateMachine *stateMachine = promise.stateMachine;
+            bool suspended = promise.suspended;
+            coroutine.destroy();
+            if ( suspended )
+               stateM::resume( stateMachine );
+         }
+
+         void await_resume() noexcept
+         {
+         }
+      };
+
+      class promise_type
+      {
+      public:
+         action get_return_object()
+         {
+            return action( handle::from_promise( *this ) );
+         }
+
+         std::suspend_never initial_suspend() noexcept
+         {
+            return {};
+         }
+
+         finalAwaiter final_suspend() noexcept
+         {
+            return {};
+         }
+
+         void return_void()
+         {
+         }
+
+         void unhandled_exception()
+         {
+            std::terminate();
+         }
+
+      private:
+         friend class action;
+         friend struct finalAwaiter;
+
+         /** \brief The state machine whose action started the coroutine */
+         struct stateMachine *stateMachine = detail::running;
+         /** \brief Set if the state machine has been suspended */
+         bool suspended = false;
+         /** \brief Set once the action has returned */
+         bool released = false;
+      };
+
+      action( action &&other ) noexcept
+         : coroutine( other.coroutine )
+      {
+         other.coroutine = nullptr;
+      }
+
+      action( const action & ) = delete;
+      action &operator=( const action & ) = delete;
+      action &operator=( action && ) = delete;
+
+      /**
+       * \brief Suspend the state machine if the coroutine has not
+       * completed, and hand the coroutine over to itself
+       */
+      ~action()
+      {
+         if ( !coroutine )
+            return;
+
+         if ( coroutine.done() )
+         {
+            coroutine.destroy();
+            return;
+         }
+
+         promise_type &promise = coroutine.promise();
+         promise.released = true;
+         if ( promise.stateMachine )
+         {
+            promise.suspended = true;
+            stateM_suspend( promise.stateMachine );
+         }
+      }
+
+   private:
+      explicit action( handle coroutine )
+         : coroutine( coroutine )
+      {
+      }
+
+      handle coroutine;
+   };
+
+   /**
+    * \brief An \ref state::entryAction "entry" or \ref state::exitAction
+    * "exit action" running the coroutine \pn{Action}
+    */
+   template<action ( *Action )( void *, struct event * )>
+   void asyncAction( void *stateData, struct event *event )
+   {
+      Action( stateData, event );
+   }
+
+   /**
+    * \brief A \ref transition::action "transition action" running the
+    * coroutine \pn{Action}
+    */
+   template<action ( *Action )( void *, struct event *, void * )>
+   void asyncTransition( void *currentStateData, struct event *event,
+         void *newStateData )
+   {
+      Action( currentStateData, event, newStateData );
+   }
+}
+
+#endif // STATEMACHINE_COROUTINE_HPP
+
+/**
+ * @}
+ */
@@ -0,0 +1,256 @@
+/* 
+ * Copyright (c) 2013 Andreas Misje
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+/**
+ * \addtogroup stateMachine
+ * @{
+ *
+ * \file
+ * \brief Declaring state machines once, with a specialised dispatcher
+ *
+ * A state machine written as \ref state structs is only known to the
+ * compiler as data, so every event goes through the generic lookups in
+ * stateM_handleEvent(). With the macros in this file, the states and
+ * transitions of a flat state machine (without parent states, regions or
+ * history) are listed once in an X-macro, and STATEM_DSL_DEFINE() turns the
+ * list into both:
+ *
+ * - the usual \ref state structs and a \ref stateMachineDefinition, for
+ *   use with stateM_handleEvent() and the rest of the library, and
+ * - an enum of state ids and a dispatch function, a switch over the
+ *   current state, in which guards and actions are called directly (and
+ *   may be inlined).
+ *
+ * The list takes the machine's name and two macros, and calls the first,
+ * `STATE( m, name, data, entryAction, exitAction, transitions )`, for every
+ * state. \c transitions is a sequence of calls to the second,
+ * `TRANSITION( m, eventType, condition, guard, action, nextState )`, which
+ * is left empty for states without transitions. Names of states are given
+ * without the machine's name. Anything that is not used may be NULL:
+ *
+ * ~~~{.c}
+ * #define DOOR( m, STATE, TRANSITION ) \
+ *    STATE( m, closed, NULL, NULL, NULL, \
+ *       TRANSITION( m, Event_open, NULL, NULL, &creak, open ) \
+ *       TRANSITION( m, Event_lock, NULL, &hasKey, NULL, locked ) ) \
+ *    STATE( m, open, NULL, &turnOnLight, &turnOffLight, \
+ *       TRANSITION( m, Event_close, NULL, NULL, NULL, closed ) ) \
+ *    STATE( m, locked, NULL, NULL, NULL, \
+ *       TRANSITION( m, Event_unlock, NULL, &hasKey, NULL, closed ) ) \
+ *    STATE( m, error, "error", NULL, NULL, )
+ *
+ * STATEM_DSL_DEFINE( door, DOOR, closed, error )
+ * ~~~
+ *
+ * This defines, with internal linkage:
+ *
+ * - `enum door_stateIds` with `door_closed`, `door_open`, `door_locked`
+ *   and `door_error` (in list order, equal to the states' \ref state::id
+ *   "ids"), `door_numStates`, `door_initialStateId` and
+ *   `door_errorStateId`,
+ * - `struct state door_closedState` (and so on),
+ * - `struct stateMachineDefinition *door_getDefinition( void )`, and
+ * - `int door_dispatch( enum door_stateIds *state, struct event *event )`.
+ *
+ * door_dispatch() passes an event to a state machine whose current state
+ * is \pn{*state}, and returns what stateM_handleEvent() would for the same
+ * state machine (except that there is no event queue and no deferral). A
+ * state without transitions is a final state.
+ */
+
+#ifndef STATEMACHINE_DSL_H
+#define STATEMACHINE_DSL_H
+
+#include "stateMachine.h"
+
+/**
+ * \brief Define a state machine from an X-macro list
+ *
+ * \param m the name of the state machine, used as a prefix for everything
+ * defined.
+ * \param list the list of states, as described in stateMachineDsl.h.
+ * \param initial the name of the initial state.
+ * \param error the name of the error state.
+ */
+#define STATEM_DSL_DEFINE( m, list, initial, error ) \
+   enum m##_stateIds \
+   { \
+      list( m, STATEM_DSL_ID_, STATEM_DSL_IGNORE_ ) \
+      m##_numStates, \
+      m##_initialStateId = m##_##initial, \
+      m##_errorStateId = m##_##error, \
+   }; \
+   list( m, STATEM_DSL_DECLARE_, STATEM_DSL_IGNORE_ ) \
+   list( m, STATEM_DSL_TRANSITIONS_, STATEM_DSL_TRANSITION_ ) \
+   list( m, STATEM_DSL_STATE_, STATEM_DSL_IGNORE_ ) \
+   static struct state *m##_states[] = { \
+      list( m, STATEM_DSL_POINTER_, STATEM_DSL_IGNORE_ ) \
+   }; \
+   static struct stateMachineDefinition m##_definition = { \
+      .states = m##_states, \
+      .numStates = m##_numStates, \
+      .initialState = &m##_##initial##State, \
+      .errorState = &m##_##error##State, \
+   }; \
+   static inline struct stateMachineDefinition *m##_getDefinition( void ) \
+   { \
+      return &m##_definition; \
+   } \
+   list( m, STATEM_DSL_ACCESSORS_, STATEM_DSL_IGNORE_ ) \
+   static inline int m##_dispatch( enum m##_stateIds *state, \
+         struct event *event ) \
+   { \
+      enum m##_stateIds current = *state; \
+      switch ( current ) \
+      { \
+         list( m, STATEM_DSL_CASE_, STATEM_DSL_IF_ ) \
+         default: \
+            break; \
+      } \
+      return stateM_noStateChange; \
+   }
+
+/* The macros below are passed to the list by STATEM_DSL_DEFINE(): */
+
+#define STATEM_DSL_IGNORE_( ... )
+
+#define STATEM_DSL_ID_( m, name, data_, entryAction_, exitAction_, \
+      transitions_ ) \
+   m##_##name,
+
+#define STATEM_DSL_DECLARE_( m, name, data_, entryAction_, exitAction_, \
+      transitions_ ) \
+   static struct state m##_##name##State;
+
+/* Every list of transitions ends with an unused entry, as arrays cannot be
+ * empty: */
+#define STATEM_DSL_TRANSITIONS_( m, name, data_, entryAction_, exitAction_, \
+      transitions_ ) \
+   static struct transition m##_##name##Transitions[] = { \
+      transitions_ \
+      { 0 } \
+   };
+
+#define STATEM_DSL_TRANSITION_( m, eventType_, condition_, guard_, \
+      action_, nextState_ ) \
+   { \
+      .eventType = (eventType_), \
+      .condition = (condition_), \
+      .guard = (guard_), \
+      .action = (action_), \
+      .nextState = &m##_##nextState_##State, \
+   },
+
+#define STATEM_DSL_STATE_( m, name, data_, entryAction_, exitAction_, \
+      transitions_ ) \
+   static struct state m##_##name##State = { \
+      .transitions = m##_##name##Transitions, \
+      .numTransitions = sizeof( m##_##name##Transitions ) / sizeof( \
+            struct transition ) - 1, \
+      .data = (data_), \
+      .entryAction = (entryAction_), \
+      .exitAction = (exitAction_), \
+      .id = m##_##name, \
+   };
+
+#define STATEM_DSL_POINTER_( m, name, data_, entryAction_, exitAction_, \
+      transitions_ ) \
+   &m##_##name##State,
+
+#define STATEM_DSL_ACCESSORS_( m, name, data_, entryAction_, exitAction_, \
+      transitions_ ) \
+   static inline void *m##_##name##Data( void ) \
+   { \
+      return (data_); \
+   } \
+   static inline void m##_##name##Enter( struct event *event ) \
+   { \
+      stateM_dslStateAction( (entryAction_), (data_), event ); \
+   } \
+   static inline bool m##_##name##Final( void ) \
+   { \
+      return sizeof( m##_##name##Transitions ) == sizeof( \
+            struct transition ); \
+   }
+
+#define STATEM_DSL_CASE_( m, name, data_, entryAction_, exitAction_, \
+      transitions_ ) \
+   case m##_##name: \
+   { \
+      void *stateData = (data_); \
+      void ( *exitAction )( void *, struct event * ) = (exitAction_); \
+      (void)stateData; \
+      (void)exitAction; \
+      transitions_ \
+      break; \
+   }
+
+#define STATEM_DSL_IF_( m, eventType_, condition_, guard_, action_, \
+      nextState_ ) \
+   if ( event->type == (eventType_) && stateM_dslGuardHolds( (guard_), \
+            (condition_), event ) ) \
+   { \
+      bool loop = current == m##_##nextState_; \
+      if ( !loop ) \
+         stateM_dslStateAction( exitAction, stateData, event ); \
+      stateM_dslAction( (action_), stateData, event, \
+            m##_##nextState_##Data() ); \
+      if ( !loop ) \
+         m##_##nextState_##Enter( event ); \
+      *state = m##_##nextState_; \
+      if ( loop ) \
+         return stateM_stateLoopSelf; \
+      if ( m##_##nextState_ == m##_errorStateId ) \
+         return stateM_errorStateReached; \
+      if ( m##_##nextState_##Final() ) \
+         return stateM_finalStateReached; \
+      return stateM_stateChanged; \
+   }
+
+/* Helpers that let NULL guards and actions be passed as constants: */
+
+static inline bool stateM_dslGuardHolds( bool ( *guard )( void *,
+         struct event * ), void *condition, struct event *event )
+{
+   return !guard || guard( condition, event );
+}
+
+static inline void stateM_dslStateAction( void ( *action )( void *,
+         struct event * ), void *stateData, struct event *event )
+{
+   if ( action )
+      action( stateData, event );
+}
+
+static inline void stateM_dslAction( void ( *action )( void *,
+         struct event *, void * ), void *currentStateData,
+      struct event *event, void *newStateData )
+{
+   if ( action )
+      action( currentStateData, event, newStateData );
+}
+
+#endif // STATEMACHINE_DSL_H
+
+/**
+ * @}
+ */
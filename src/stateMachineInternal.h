@@ -0,0 +1,51 @@
+/* 
+ * Copyright (c) 2013 Andreas Misje
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+/* Helpers shared by the implementation files. This header is not part of
+ * the public interface and is not installed.
+ */
+
+#ifndef STATEMACHINE_INTERNAL_H
+#define STATEMACHINE_INTERNAL_H
+
+#include "stateMachine.h"
+#include <stdint.h>
+
+/* Stands for a NULL state where states are stored by id (equal to
+ * STATEM_SHARED_NO_STATE): */
+#define STATEM_NO_STATE_ID UINT32_MAX
+
+/* The id of a state (see state::id), or STATEM_NO_STATE_ID for NULL: */
+static inline uint32_t stateM_stateId( struct state *state )
+{
+   return state ? (uint32_t)state->id : STATEM_NO_STATE_ID;
+}
+
+/* The state with the given id, or NULL if no state in the definition has
+ * it: */
+static inline struct state *stateM_stateFromId(
+      struct stateMachineDefinition *definition, uint32_t id )
+{
+   return id < definition->numStates ? definition->states[ id ] : NULL;
+}
+
+#endif // STATEMACHINE_INTERNAL_H
@@ -0,0 +1,253 @@
+/* 
+ * Copyright (c) 2013 Andreas Misje
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#include "stateMachineLayout.h"
+#include <stdlib.h>
+#include <string.h>
+
+#define NO_STATE SIZE_MAX
+
+static size_t *depthFirstOrder( struct stateMachineDefinition *definition );
+static size_t alignUp( size_t offset, size_t alignment );
+static uint64_t maskBit( int eventType );
+
+struct relocatedStateMachine *stateM_relocate(
+      struct stateMachineDefinition *definition )
+{
+   if ( !definition || !definition->verified )
+      return NULL;
+
+   size_t numStates = definition->numStates;
+   size_t numTransitions = 0, numRegions = 0, numDeferred = 0;
+   size_t i, j;
+
+   for ( i = 0; i < numStates; ++i )
+   {
+      struct state *state = definition->states[ i ];
+
+      state->id = i;
+      numTransitions += state->numTransitions;
+      numRegions += state->numRegions;
+      numDeferred += state->numDeferredEvents;
+   }
+
+   if ( numStates >= STATEM_NO_PARENT || numTransitions > UINT32_MAX )
+      return NULL;
+
+   /* The hot states, states and transitions each start on a new cache
+    * line. The pointer arrays and deferred events are cold, and follow: */
+   size_t statesOffset = alignUp( numStates * sizeof( struct hotState ),
+         STATEM_CACHE_LINE_SIZE );
+   size_t transitionsOffset = alignUp( statesOffset + numStates * sizeof(
+            struct state ), STATEM_CACHE_LINE_SIZE );
+   size_t pointersOffset = alignUp( transitionsOffset + numTransitions *
+         sizeof( struct transition ), sizeof( struct state * ) );
+   size_t deferredOffset = alignUp( pointersOffset + ( numStates +
+            numRegions ) * sizeof( struct state * ), sizeof( int ) );
+   size_t size = deferredOffset + numDeferred * sizeof( int );
+
+   struct relocatedStateMachine *relocated = calloc( 1, sizeof(
+            *relocated ) );
+   size_t *order = depthFirstOrder( definition );
+
+   if ( !relocated || !order )
+      goto fail;
+
+   relocated->stateMap = calloc( numStates + 1, sizeof( size_t ) );
+   relocated->block = calloc( 1, size + STATEM_CACHE_LINE_SIZE );
+   if ( !relocated->stateMap || !relocated->block )
+      goto fail;
+
+   char *base = (char *)alignUp( (uintptr_t)relocated->block,
+         STATEM_CACHE_LINE_SIZE );
+   relocated->hotStates = (struct hotState *)base;
+   relocated->states = (struct state *)( base + statesOffset );
+   relocated->transitions = (struct transition *)( base +
+         transitionsOffset );
+   relocated->definition.states = (struct state **)( base +
+         pointersOffset );
+   struct state **regions = relocated->definition.states + numStates;
+   int *deferredEvents = (int *)( base + deferredOffset );
+
+   for ( i = 0; i < numStates; ++i )
+      relocated->stateMap[ order[ i ] ] = i;
+
+#define RELOCATED( state ) ( ( state ) ? &relocated->states[ \
+         relocated->stateMap[ ( state )->id ] ] : NULL )
+
+   size_t numCopied = 0;
+   for ( i = 0; i < numStates; ++i )
+   {
+      struct state *original = definition->states[ order[ i ] ];
+      struct state *state = &relocated->states[ i ];
+      struct hotState *hot = &relocated->hotStates[ i ];
+
+      *state = *original;
+      state->id = i;
+      state->parentState = RELOCATED( original->parentState );
+      state->entryState = RELOCATED( original->entryState );
+
+      hot->parent = original->parentState ? (uint32_t)relocated->stateMap[
+         original->parentState->id ] : STATEM_NO_PARENT;
+      hot->firstTransition = (uint32_t)numCopied;
+      hot->numTransitions = (uint32_t)original->numTransitions;
+      hot->numDeferredEvents = (uint32_t)original->numDeferredEvents;
+
+      state->transitions = &relocated->transitions[ numCopied ];
+      for ( j = 0; j < original->numTransitions; ++j )
+      {
+         struct transition *transition = &relocated->transitions[
+            numCopied++ ];
+
+         *transition = original->transitions[ j ];
+         transition->nextState = RELOCATED( transition->nextState );
+         hot->eventMask |= maskBit( transition->eventType );
+      }
+
+      state->deferredEvents = deferredEvents;
+      for ( j = 0; j < original->numDeferredEvents; ++j )
+      {
+         deferredEvents[ j ] = original->deferredEvents[ j ];
+         hot->deferredMask |= maskBit( deferredEvents[ j ] );
+      }
+      deferredEvents += original->numDeferredEvents;
+
+      state->regions = regions;
+      for ( j = 0; j < original->numRegions; ++j )
+         regions[ j ] = RELOCATED( original->regions[ j ] );
+      regions += original->numRegions;
+
+      relocated->definition.states[ i ] = state;
+   }
+
+   relocated->definition.numStates = numStates;
+   relocated->definition.initialState = RELOCATED(
+         definition->initialState );
+   relocated->definition.errorState = RELOCATED( definition->errorState );
+   relocated->definition.verified = definition->verified;
+
+#undef RELOCATED
+
+   free( order );
+   return relocated;
+
+fail:
+   free( order );
+   stateM_freeRelocated( relocated );
+   return NULL;
+}
+
+void stateM_freeRelocated( struct relocatedStateMachine *relocated )
+{
+   if ( !relocated )
+      return;
+
+   free( relocated->stateMap );
+   free( relocated->block );
+   free( relocated );
+}
+
+void stateM_initRelocated( struct stateMachine *fsm,
+      struct relocatedStateMachine *relocated )
+{
+   if ( !fsm || !relocated )
+      return;
+
+   stateM_initWithDefinition( fsm, &relocated->definition );
+   fsm->relocated = relocated;
+}
+
+static size_t *depthFirstOrder( struct stateMachineDefinition *definition )
+{
+   size_t numStates = definition->numStates;
+   /* Children of every state, grouped by parent (a stable counting sort).
+    * The roots are grouped under the extra index numStates: */
+   size_t *firstChild = calloc( numStates + 2, sizeof( size_t ) );
+   size_t *children = calloc( numStates + 1, sizeof( size_t ) );
+   size_t *stack = calloc( numStates + 1, sizeof( size_t ) );
+   size_t *order = calloc( numStates + 1, sizeof( size_t ) );
+   size_t numOrdered = 0, stackSize = 0;
+   size_t i;
+
+   if ( !firstChild || !children || !stack || !order )
+   {
+      free( order );
+      order = NULL;
+      goto cleanup;
+   }
+
+#define PARENT( index ) ( definition->states[ index ]->parentState ? \
+      definition->states[ index ]->parentState->id : numStates )
+
+   for ( i = 0; i < numStates; ++i )
+      ++firstChild[ PARENT( i ) + 1 ];
+
+   for ( i = 0; i <= numStates; ++i )
+      firstChild[ i + 1 ] += firstChild[ i ];
+
+   /* Use the stack to keep track of where to put the next child: */
+   memcpy( stack, firstChild, ( numStates + 1 ) * sizeof( size_t ) );
+   for ( i = 0; i < numStates; ++i )
+      children[ stack[ PARENT( i ) ]++ ] = i;
+
+#undef PARENT
+
+   /* Start with the tree containing the initial state: */
+   struct state *initialRoot = definition->initialState;
+   while ( initialRoot && initialRoot->parentState )
+      initialRoot = initialRoot->parentState;
+
+   for ( i = firstChild[ numStates + 1 ]; i > firstChild[ numStates ]; --i )
+      if ( !initialRoot || children[ i - 1 ] != initialRoot->id )
+         stack[ stackSize++ ] = children[ i - 1 ];
+
+   if ( initialRoot )
+      stack[ stackSize++ ] = initialRoot->id;
+
+   while ( stackSize )
+   {
+      size_t index = stack[ --stackSize ];
+
+      order[ numOrdered++ ] = index;
+
+      /* Push the children in reverse, so that they are visited in order: */
+      for ( i = firstChild[ index + 1 ]; i > firstChild[ index ]; --i )
+         stack[ stackSize++ ] = children[ i - 1 ];
+   }
+
+cleanup:
+   free( firstChild );
+   free( children );
+   free( stack );
+
+   return order;
+}
+
+static size_t alignUp( size_t offset, size_t alignment )
+{
+   return ( offset + alignment - 1 ) / alignment * alignment;
+}
+
+static uint64_t maskBit( int eventType )
+{
+   return (uint64_t)1 << ( (unsigned)eventType % 64 );
+}
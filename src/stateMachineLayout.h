@@ -0,0 +1,170 @@
+/* 
+ * Copyright (c) 2013 Andreas Misje
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+/**
+ * \addtogroup stateMachine
+ * @{
+ *
+ * \file
+ * \brief Cache-line-aware state machine layout
+ *
+ * States and their transition arrays are usually scattered across memory
+ * wherever the compiler places them. stateM_relocate() copies a \ref
+ * stateMachineDefinition "definition" into a single cache-line-aligned
+ * block, with the states in depth-first order of the state hierarchy, and
+ * separates the fields read while searching for a transition from the rest.
+ */
+
+#ifndef STATEMACHINE_LAYOUT_H
+#define STATEMACHINE_LAYOUT_H
+
+#include "stateMachine.h"
+#include <stdint.h>
+
+/**
+ * \brief Size of a cache line
+ *
+ * The relocated block and each of its arrays start on a multiple of this
+ * size. This macro may be defined by the user.
+ */
+#ifndef STATEM_CACHE_LINE_SIZE
+#define STATEM_CACHE_LINE_SIZE 64
+#endif
+
+/** \brief \ref hotState::parent "parent" of states without a parent */
+#define STATEM_NO_PARENT UINT32_MAX
+
+/**
+ * \brief The fields of a relocated state needed to search for a transition
+ *
+ * A hot state is 32 bytes, so two share a cache line and none straddle
+ * two. stateM_handleEvent() walks up the hierarchy using only these
+ * records, and only reads a state's transitions if its #eventMask matches
+ * the event.
+ */
+struct hotState
+{
+   /** \brief Index of the parent state, or #STATEM_NO_PARENT */
+   uint32_t parent;
+   /**
+    * \brief Index of the state's first transition in \ref
+    * relocatedStateMachine::transitions
+    */
+   uint32_t firstTransition;
+   /** \brief Number of transitions */
+   uint32_t numTransitions;
+   /** \brief Number of deferred event types */
+   uint32_t numDeferredEvents;
+   /**
+    * \brief Event types handled by the state's own transitions
+    *
+    * Bit \c n is set if the state has a transition for an event type that
+    * equals \c n modulo 64.
+    */
+   uint64_t eventMask;
+   /** \brief Deferred event types, in the same form as #eventMask */
+   uint64_t deferredMask;
+};
+
+/**
+ * \brief Relocated state machine
+ *
+ * Created by stateM_relocate(). #hotStates, #states and #transitions are
+ * parts of the same cache-line-aligned block, and all three are indexed in
+ * the same depth-first order. The relocated states and transitions share
+ * their \ref state::data "data" and \ref transition::condition
+ * "conditions" with the original definition.
+ */
+struct relocatedStateMachine
+{
+   /**
+    * \brief The relocated definition
+    *
+    * It is \ref stateMachineDefinition::verified "verified" if the original
+    * definition was. It may be compiled with stateM_compile().
+    */
+   struct stateMachineDefinition definition;
+   /** \brief Hot fields of every state, indexed by \ref state::id "id" */
+   struct hotState *hotStates;
+   /** \brief The relocated states, indexed by \ref state::id "id" */
+   struct state *states;
+   /** \brief The transitions of all states, grouped by state */
+   struct transition *transitions;
+   /**
+    * \brief Maps the index of every state in the original definition to the
+    * index of its copy
+    */
+   size_t *stateMap;
+   /** \brief The allocated block (before alignment) */
+   void *block;
+};
+
+/**
+ * \brief Copy a definition into a cache-line-aligned block
+ *
+ * The states are ordered depth-first: every state is followed by its
+ * children (in definition order) and their descendants. The tree of the
+ * initial state comes first. Every state's transitions, deferred events and
+ * region array are copied as well, so that the relocated definition does
+ * not refer to the original states.
+ *
+ * Every state in the original definition is given its \ref state::id "id".
+ *
+ * \param definition the definition to relocate. It must have been
+ * successfully \ref stateM_validate() "validated".
+ *
+ * \returns the relocated state machine, which must be freed with
+ * stateM_freeRelocated(), or NULL if \pn{definition} is NULL or not
+ * verified, if it has more than \c UINT32_MAX states or transitions, or if
+ * memory could not be allocated.
+ */
+struct relocatedStateMachine *stateM_relocate(
+      struct stateMachineDefinition *definition );
+
+/**
+ * \brief Free a relocated state machine
+ *
+ * No state machine may use the relocated state machine after it has been
+ * freed.
+ *
+ * \param relocated the relocated state machine to free. May be NULL.
+ */
+void stateM_freeRelocated( struct relocatedStateMachine *relocated );
+
+/**
+ * \brief Initialise a state machine from a relocated state machine
+ *
+ * This function works like stateM_initWithDefinition(), but
+ * stateM_handleEvent() searches for transitions using the \ref hotState
+ * "hot states".
+ *
+ * \param stateMachine the state machine to initialise.
+ * \param relocated the relocated state machine.
+ */
+void stateM_initRelocated( struct stateMachine *stateMachine,
+      struct relocatedStateMachine *relocated );
+
+#endif // STATEMACHINE_LAYOUT_H
+
+/**
+ * @}
+ */
@@ -0,0 +1,440 @@
+/* 
+ * Copyright (c) 2013 Andreas Misje
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#include "stateMachineMinimise.h"
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* A state's current class and the hash of its signature, used to sort the
+ * states so that candidates for the same new class are adjacent: */
+struct classKey
+{
+   size_t class;
+   uint64_t hash;
+   size_t index;
+};
+
+struct refinement
+{
+   struct stateMachineDefinition *definition;
+   /* Class of every state: */
+   size_t *classes;
+   /* Class of every state after the current round: */
+   size_t *newClasses;
+   /* States that must not be merged: */
+   bool *unique;
+   struct classKey *keys;
+   /* A member of every new class: */
+   size_t *representatives;
+};
+
+static void findUniqueStates( struct refinement *refinement );
+static bool separateInternalTransitions( struct refinement *refinement );
+static size_t refine( struct refinement *refinement );
+static uint64_t hashState( struct refinement *refinement, size_t index );
+static bool equivalent( struct refinement *refinement, size_t a, size_t b );
+static size_t classOf( struct refinement *refinement, struct state *state );
+static size_t targetOf( struct refinement *refinement, struct state *state,
+      struct transition *transition );
+static uint64_t mix( uint64_t hash, uint64_t value );
+static int compareClassKeys( const void *a, const void *b );
+static struct minimisedStateMachine *buildMinimised(
+      struct refinement *refinement, size_t numClasses );
+
+struct minimisedStateMachine *stateM_minimise(
+      struct stateMachineDefinition *definition )
+{
+   if ( !definition || !definition->verified )
+      return NULL;
+
+   size_t numStates = definition->numStates;
+   struct minimisedStateMachine *minimised = NULL;
+   struct refinement refinement = {
+      .definition = definition,
+      .classes = calloc( numStates + 1, sizeof( size_t ) ),
+      .newClasses = calloc( numStates + 1, sizeof( size_t ) ),
+      .unique = calloc( numStates + 1, sizeof( bool ) ),
+      .keys = calloc( numStates + 1, sizeof( struct classKey ) ),
+      .representatives = calloc( numStates + 1, sizeof( size_t ) ),
+   };
+   size_t i;
+
+   if ( !refinement.classes || !refinement.newClasses || !refinement.unique
+         || !refinement.keys || !refinement.representatives )
+      goto cleanup;
+
+   for ( i = 0; i < numStates; ++i )
+      definition->states[ i ]->id = i;
+
+   findUniqueStates( &refinement );
+
+   /* All states start out in the same class. Classes are split until a
+    * round does not create any new classes: */
+   size_t numClasses = numStates ? 1 : 0;
+   for ( ;; )
+   {
+      size_t numNewClasses = refine( &refinement );
+      size_t *classes = refinement.classes;
+
+      refinement.classes = refinement.newClasses;
+      refinement.newClasses = classes;
+
+      if ( numNewClasses != numClasses )
+      {
+         numClasses = numNewClasses;
+         continue;
+      }
+
+      if ( !separateInternalTransitions( &refinement ) )
+         break;
+   }
+
+   minimised = buildMinimised( &refinement, numClasses );
+
+cleanup:
+   free( refinement.classes );
+   free( refinement.newClasses );
+   free( refinement.unique );
+   free( refinement.keys );
+   free( refinement.representatives );
+
+   return minimised;
+}
+
+void stateM_freeMinimised( struct minimisedStateMachine *minimised )
+{
+   if ( !minimised )
+      return;
+
+   free( minimised->definition.states );
+   free( minimised->stateMap );
+   free( minimised->states );
+   free( minimised->transitions );
+   free( minimised->regions );
+   free( minimised );
+}
+
+static void findUniqueStates( struct refinement *refinement )
+{
+   struct stateMachineDefinition *definition = refinement->definition;
+   size_t i, j;
+
+   for ( i = 0; i < definition->numStates; ++i )
+   {
+      struct state *state = definition->states[ i ];
+
+      if ( state == definition->errorState || state->numRegions ||
+            state->historySlot || state->historyType != stateM_noHistory )
+         refinement->unique[ i ] = true;
+
+      /* Regions are identified by their address: */
+      for ( j = 0; j < state->numRegions; ++j )
+         refinement->unique[ state->regions[ j ]->id ] = true;
+   }
+}
+
+/* Merging a state with the target of one of its transitions would turn the
+ * transition into a self-loop, which neither exits nor enters the state.
+ * Such states are kept apart, and refinement continues from the current
+ * classes: */
+static bool separateInternalTransitions( struct refinement *refinement )
+{
+   struct stateMachineDefinition *definition = refinement->definition;
+   bool separated = false;
+   size_t i, j;
+
+   for ( i = 0; i < definition->numStates; ++i )
+   {
+      struct state *state = definition->states[ i ];
+
+      if ( refinement->unique[ i ] )
+         continue;
+
+      for ( j = 0; j < state->numTransitions; ++j )
+      {
+         struct state *nextState = state->transitions[ j ].nextState;
+
+         if ( nextState && nextState != state && classOf( refinement,
+                  nextState ) == refinement->classes[ i ] )
+         {
+            refinement->unique[ i ] = true;
+            separated = true;
+            break;
+         }
+      }
+   }
+
+   return separated;
+}
+
+static size_t refine( struct refinement *refinement )
+{
+   size_t numStates = refinement->definition->numStates;
+   size_t numNewClasses = 0;
+   size_t i, j;
+
+   for ( i = 0; i < numStates; ++i )
+   {
+      refinement->keys[ i ].class = refinement->classes[ i ];
+      refinement->keys[ i ].hash = hashState( refinement, i );
+      refinement->keys[ i ].index = i;
+   }
+
+   qsort( refinement->keys, numStates, sizeof( *refinement->keys ),
+         &compareClassKeys );
+
+   /* States that are in the same class and have the same hash are most
+    * likely equivalent. Compare them properly, and split them into new
+    * classes if they are not: */
+   size_t runStart = 0;
+   for ( i = 0; i < numStates; ++i )
+   {
+      size_t index = refinement->keys[ i ].index;
+
+      if ( i && ( refinement->keys[ i ].class != refinement->keys[ i - 1
+               ].class || refinement->keys[ i ].hash != refinement->keys[ i
+               - 1 ].hash ) )
+         runStart = numNewClasses;
+
+      for ( j = runStart; j < numNewClasses; ++j )
+         if ( equivalent( refinement, index, refinement->representatives[ j
+                  ] ) )
+            break;
+
+      if ( j == numNewClasses )
+         refinement->representatives[ numNewClasses++ ] = index;
+
+      refinement->newClasses[ index ] = j;
+   }
+
+   return numNewClasses;
+}
+
+static uint64_t hashState( struct refinement *refinement, size_t index )
+{
+   struct state *state = refinement->definition->states[ index ];
+   uint64_t hash = 0xcbf29ce484222325ULL;
+   size_t i;
+
+   if ( refinement->unique[ index ] )
+      return mix( hash, index );
+
+   hash = mix( hash, (uintptr_t)state->data );
+   hash = mix( hash, (uintptr_t)state->entryAction );
+   hash = mix( hash, (uintptr_t)state->exitAction );
+   hash = mix( hash, classOf( refinement, state->parentState ) );
+   hash = mix( hash, classOf( refinement, state->entryState ) );
+   hash = mix( hash, state->numDeferredEvents );
+   hash = mix( hash, state->numTransitions );
+
+   for ( i = 0; i < state->numDeferredEvents; ++i )
+      hash = mix( hash, (unsigned)state->deferredEvents[ i ] );
+
+   for ( i = 0; i < state->numTransitions; ++i )
+   {
+      struct transition *t = &state->transitions[ i ];
+
+      hash = mix( hash, (unsigned)t->eventType );
+      hash = mix( hash, (uintptr_t)t->condition );
+      hash = mix( hash, (uintptr_t)t->guard );
+      hash = mix( hash, (uintptr_t)t->action );
+      hash = mix( hash, t->guardKind );
+      hash = mix( hash, targetOf( refinement, state, t ) );
+   }
+
+   return hash;
+}
+
+static bool equivalent( struct refinement *refinement, size_t a, size_t b )
+{
+   struct state *stateA = refinement->definition->states[ a ];
+   struct state *stateB = refinement->definition->states[ b ];
+   size_t i;
+
+   if ( refinement->unique[ a ] || refinement->unique[ b ] )
+      return a == b;
+
+   if ( stateA->data != stateB->data || stateA->entryAction !=
+         stateB->entryAction || stateA->exitAction != stateB->exitAction ||
+         classOf( refinement, stateA->parentState ) != classOf( refinement,
+            stateB->parentState ) || classOf( refinement,
+            stateA->entryState ) != classOf( refinement, stateB->entryState )
+         || stateA->numDeferredEvents != stateB->numDeferredEvents ||
+         stateA->numTransitions != stateB->numTransitions )
+      return false;
+
+   if ( stateA->numDeferredEvents && memcmp( stateA->deferredEvents,
+            stateB->deferredEvents, stateA->numDeferredEvents * sizeof(
+               *stateA->deferredEvents ) ) )
+      return false;
+
+   for ( i = 0; i < stateA->numTransitions; ++i )
+   {
+      struct transition *tA = &stateA->transitions[ i ];
+      struct transition *tB = &stateB->transitions[ i ];
+
+      if ( tA->eventType != tB->eventType || tA->condition != tB->condition
+            || tA->guard != tB->guard || tA->action != tB->action ||
+            tA->guardKind != tB->guardKind || tA->pureGuard != tB->pureGuard
+            || targetOf( refinement, stateA, tA ) != targetOf( refinement,
+               stateB, tB ) )
+         return false;
+   }
+
+   return true;
+}
+
+static size_t classOf( struct refinement *refinement, struct state *state )
+{
+   return state ? refinement->classes[ state->id ] : SIZE_MAX;
+}
+
+/* Self-loops are told apart from transitions to other members of the
+ * state's class: */
+static size_t targetOf( struct refinement *refinement, struct state *state,
+      struct transition *transition )
+{
+   if ( transition->nextState == state )
+      return SIZE_MAX - 1;
+
+   return classOf( refinement, transition->nextState );
+}
+
+static uint64_t mix( uint64_t hash, uint64_t value )
+{
+   /* FNV-1a, one 64-bit word at a time: */
+   return ( hash ^ value ) * 0x100000001b3ULL;
+}
+
+static int compareClassKeys( const void *a, const void *b )
+{
+   const struct classKey *keyA = a;
+   const struct classKey *keyB = b;
+
+   if ( keyA->class != keyB->class )
+      return keyA->class < keyB->class ? -1 : 1;
+
+   if ( keyA->hash != keyB->hash )
+      return keyA->hash < keyB->hash ? -1 : 1;
+
+   return ( keyA->index > keyB->index ) - ( keyA->index < keyB->index );
+}
+
+static struct minimisedStateMachine *buildMinimised(
+      struct refinement *refinement, size_t numClasses )
+{
+   struct stateMachineDefinition *definition = refinement->definition;
+   size_t numStates = definition->numStates;
+   struct minimisedStateMachine *minimised = calloc( 1, sizeof(
+            *minimised ) );
+   size_t numTransitions = 0, numRegions = 0;
+   size_t i, j;
+
+   if ( !minimised )
+      return NULL;
+
+   /* Number the new states in the order their first member appears in the
+    * original definition. The first member serves as a template: */
+   size_t *newIndices = refinement->newClasses;
+   for ( i = 0; i < numClasses; ++i )
+      newIndices[ i ] = SIZE_MAX;
+
+   size_t numNewStates = 0;
+   for ( i = 0; i < numStates; ++i )
+   {
+      size_t class = refinement->classes[ i ];
+
+      if ( newIndices[ class ] == SIZE_MAX )
+      {
+         struct state *state = definition->states[ i ];
+
+         refinement->representatives[ numNewStates ] = i;
+         newIndices[ class ] = numNewStates++;
+         numTransitions += state->numTransitions;
+         numRegions += state->numRegions;
+      }
+   }
+
+   minimised->numOriginalStates = numStates;
+   minimised->stateMap = calloc( numStates + 1, sizeof( size_t ) );
+   minimised->definition.states = calloc( numClasses + 1, sizeof(
+            struct state * ) );
+   minimised->states = calloc( numClasses + 1, sizeof( struct state ) );
+   minimised->transitions = calloc( numTransitions + 1, sizeof(
+            struct transition ) );
+   minimised->regions = calloc( numRegions + 1, sizeof( struct state * ) );
+
+   if ( !minimised->stateMap || !minimised->definition.states ||
+         !minimised->states || !minimised->transitions ||
+         !minimised->regions )
+   {
+      stateM_freeMinimised( minimised );
+      return NULL;
+   }
+
+   for ( i = 0; i < numStates; ++i )
+      minimised->stateMap[ i ] = newIndices[ refinement->classes[ i ] ];
+
+#define NEW_STATE( state ) ( ( state ) ? &minimised->states[ \
+         minimised->stateMap[ ( state )->id ] ] : NULL )
+
+   struct transition *transitions = minimised->transitions;
+   struct state **regions = minimised->regions;
+
+   for ( i = 0; i < numClasses; ++i )
+   {
+      struct state *original = definition->states[
+         refinement->representatives[ i ] ];
+      struct state *state = &minimised->states[ i ];
+
+      *state = *original;
+      state->id = i;
+      state->parentState = NEW_STATE( original->parentState );
+      state->entryState = NEW_STATE( original->entryState );
+
+      state->transitions = transitions;
+      for ( j = 0; j < original->numTransitions; ++j )
+      {
+         transitions[ j ] = original->transitions[ j ];
+         transitions[ j ].nextState = NEW_STATE(
+               original->transitions[ j ].nextState );
+      }
+      transitions += original->numTransitions;
+
+      state->regions = regions;
+      for ( j = 0; j < original->numRegions; ++j )
+         regions[ j ] = NEW_STATE( original->regions[ j ] );
+      regions += original->numRegions;
+
+      minimised->definition.states[ i ] = state;
+   }
+
+   minimised->definition.numStates = numClasses;
+   minimised->definition.initialState = NEW_STATE( definition->initialState );
+   minimised->definition.errorState = NEW_STATE( definition->errorState );
+   minimised->definition.verified = definition->verified;
+
+#undef NEW_STATE
+
+   return minimised;
+}
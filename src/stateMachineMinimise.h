@@ -0,0 +1,117 @@
+/* 
+ * Copyright (c) 2013 Andreas Misje
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+/**
+ * \addtogroup stateMachine
+ * @{
+ *
+ * \file
+ * \brief State machine minimisation
+ *
+ * Generated state machines often contain states that behave identically.
+ * stateM_minimise() finds such states and creates an equivalent definition
+ * in which they are merged.
+ */
+
+#ifndef STATEMACHINE_MINIMISE_H
+#define STATEMACHINE_MINIMISE_H
+
+#include "stateMachine.h"
+
+/**
+ * \brief Minimised state machine
+ *
+ * Created by stateM_minimise(). The minimised states and transitions are
+ * copies of the originals, but they share their \ref state::data "data",
+ * \ref transition::condition "conditions" and \ref state::deferredEvents
+ * "deferred event" arrays with the original definition.
+ */
+struct minimisedStateMachine
+{
+   /**
+    * \brief The minimised definition
+    *
+    * It is \ref stateMachineDefinition::verified "verified" if the original
+    * definition was.
+    */
+   struct stateMachineDefinition definition;
+   /**
+    * \brief Maps the index of every state in the original definition to the
+    * index of the state it was merged into in #definition
+    *
+    * This can be used to migrate stored \ref state::id "state ids".
+    */
+   size_t *stateMap;
+   /** \brief Number of elements in #stateMap */
+   size_t numOriginalStates;
+   /** \brief Storage for the minimised states */
+   struct state *states;
+   /** \brief Storage for the minimised states' transitions */
+   struct transition *transitions;
+   /** \brief Storage for the minimised states' region arrays */
+   struct state **regions;
+};
+
+/**
+ * \brief Merge behaviourally equivalent states
+ *
+ * Two states are equivalent if they have the same \ref state::data "data",
+ * entry and exit actions and deferred events, if their parent and entry
+ * states are equivalent, and if their transitions are pairwise identical
+ * (same event type, guard, condition and action) and lead to equivalent
+ * states. Equivalence is found by partition refinement: all states start
+ * out in the same class, and classes are split until every class contains
+ * only equivalent states.
+ *
+ * A self-loop is only equivalent to a self-loop, and a state is never
+ * merged with the target of one of its transitions, since that would turn
+ * the transition into a self-loop, skipping the states' exit and entry
+ * actions.
+ *
+ * The error state, states with \ref state::regions "regions" or \ref
+ * state::historySlot "history", history pseudo-states and states that are
+ * regions are never merged.
+ *
+ * Every state in the original definition is given its \ref state::id "id".
+ *
+ * \param definition the definition to minimise. It must have been
+ * successfully \ref stateM_validate() "validated".
+ *
+ * \returns the minimised state machine, which must be freed with
+ * stateM_freeMinimised(), or NULL if \pn{definition} is NULL or not
+ * verified, or if memory could not be allocated.
+ */
+struct minimisedStateMachine *stateM_minimise(
+      struct stateMachineDefinition *definition );
+
+/**
+ * \brief Free a minimised state machine
+ *
+ * \param minimised the minimised state machine to free. May be NULL.
+ */
+void stateM_freeMinimised( struct minimisedStateMachine *minimised );
+
+#endif // STATEMACHINE_MINIMISE_H
+
+/**
+ * @}
+ */
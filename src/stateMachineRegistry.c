@@ -0,0 +1,441 @@
+/* 
+ * Copyright (c) 2013 Andreas Misje
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+/* sched_yield() is not part of C99: */
+#define _GNU_SOURCE
+
+#include "stateMachineRegistry.h"
+#include <sched.h>
+#include <stdlib.h>
+
+#if STATEM_REGISTRY_SHARDS & ( STATEM_REGISTRY_SHARDS - 1 )
+#error STATEM_REGISTRY_SHARDS must be a power of two
+#endif
+
+#define MIN_CAPACITY 16
+/* Attempts to take a shard's lock before giving up the processor: */
+#define MAX_SPINS 64
+
+static uint64_t hashKey( uint64_t key );
+static size_t shardIndex( uint64_t hash );
+static void lockShard( struct registryShard *shard );
+static void unlockShard( struct registryShard *shard );
+static void waitForDispatches( struct registryShard *shard, uint64_t key,
+      size_t maxDispatching );
+static size_t findDispatch( struct registryShard *shard, uint64_t key );
+static struct registryEntry *findEntry( struct registryShard *shard,
+      uint64_t key, uint64_t hash );
+static bool insertEntry( struct registryShard *shard, uint64_t key,
+      uint64_t hash, struct stateMachine *stateMachine );
+static bool growShard( struct registryShard *shard );
+static struct stateMachine *removeEntry( struct registryShard *shard,
+      uint64_t key, uint64_t hash );
+static size_t *groupByShard( const uint64_t *keys, size_t count,
+      size_t *firstInShard );
+
+struct stateMachineRegistry *stateM_createRegistry( void )
+{
+   return calloc( 1, sizeof( struct stateMachineRegistry ) );
+}
+
+void stateM_freeRegistry( struct stateMachineRegistry *registry )
+{
+   size_t i;
+
+   if ( !registry )
+      return;
+
+   for ( i = 0; i < STATEM_REGISTRY_SHARDS; ++i )
+      free( registry->shards[ i ].entries );
+
+   free( registry );
+}
+
+bool stateM_registryInsert( struct stateMachineRegistry *registry,
+      uint64_t key, struct stateMachine *fsm )
+{
+   if ( !registry || !fsm )
+      return false;
+
+   uint64_t hash = hashKey( key );
+   struct registryShard *shard = &registry->shards[ shardIndex( hash ) ];
+
+   lockShard( shard );
+   bool inserted = insertEntry( shard, key, hash, fsm );
+   unlockShard( shard );
+
+   return inserted;
+}
+
+size_t stateM_registryInsertMany( struct stateMachineRegistry *registry,
+      const uint64_t *keys, struct stateMachine *const *fsms,
+      size_t count )
+{
+   size_t firstInShard[ STATEM_REGISTRY_SHARDS + 1 ];
+   size_t numInserted = 0;
+   size_t i, j;
+
+   if ( !registry || !keys || !fsms )
+      return 0;
+
+   size_t *order = groupByShard( keys, count, firstInShard );
+   if ( !order )
+      return 0;
+
+   for ( i = 0; i < STATEM_REGISTRY_SHARDS; ++i )
+   {
+      struct registryShard *shard = &registry->shards[ i ];
+
+      if ( firstInShard[ i ] == firstInShard[ i + 1 ] )
+         continue;
+
+      lockShard( shard );
+      for ( j = firstInShard[ i ]; j < firstInShard[ i + 1 ]; ++j )
+      {
+         size_t index = order[ j ];
+
+         if ( fsms[ index ] && insertEntry( shard, keys[ index ], hashKey(
+                     keys[ index ] ), fsms[ index ] ) )
+            ++numInserted;
+      }
+      unlockShard( shard );
+   }
+
+   free( order );
+   return numInserted;
+}
+
+struct stateMachine *stateM_registryRemove(
+      struct stateMachineRegistry *registry, uint64_t key )
+{
+   if ( !registry )
+      return NULL;
+
+   uint64_t hash = hashKey( key );
+   struct registryShard *shard = &registry->shards[ shardIndex( hash ) ];
+
+   lockShard( shard );
+   waitForDispatches( shard, key, SIZE_MAX );
+   struct stateMachine *fsm = removeEntry( shard, key, hash );
+   unlockShard( shard );
+
+   return fsm;
+}
+
+size_t stateM_registryRemoveMany( struct stateMachineRegistry *registry,
+      const uint64_t *keys, size_t count )
+{
+   size_t firstInShard[ STATEM_REGISTRY_SHARDS + 1 ];
+   size_t numRemoved = 0;
+   size_t i, j;
+
+   if ( !registry || !keys )
+      return 0;
+
+   size_t *order = groupByShard( keys, count, firstInShard );
+   if ( !order )
+      return 0;
+
+   for ( i = 0; i < STATEM_REGISTRY_SHARDS; ++i )
+   {
+      struct registryShard *shard = &registry->shards[ i ];
+
+      if ( firstInShard[ i ] == firstInShard[ i + 1 ] )
+         continue;
+
+      lockShard( shard );
+      for ( j = firstInShard[ i ]; j < firstInShard[ i + 1 ]; ++j )
+      {
+         waitForDispatches( shard, keys[ order[ j ] ], SIZE_MAX );
+         if ( removeEntry( shard, keys[ order[ j ] ], hashKey( keys[
+                     order[ j ] ] ) ) )
+            ++numRemoved;
+      }
+      unlockShard( shard );
+   }
+
+   free( order );
+   return numRemoved;
+}
+
+struct stateMachine *stateM_registryFind(
+      struct stateMachineRegistry *registry, uint64_t key )
+{
+   if ( !registry )
+      return NULL;
+
+   uint64_t hash = hashKey( key );
+   struct registryShard *shard = &registry->shards[ shardIndex( hash ) ];
+
+   lockShard( shard );
+   struct registryEntry *entry = findEntry( shard, key, hash );
+   struct stateMachine *fsm = entry ? entry->stateMachine : NULL;
+   unlockShard( shard );
+
+   return fsm;
+}
+
+int stateM_registryHandleEvent( struct stateMachineRegistry *registry,
+      uint64_t key, struct event *event )
+{
+   if ( !registry || !event )
+      return stateM_errArg;
+
+   uint64_t hash = hashKey( key );
+   struct registryShard *shard = &registry->shards[ shardIndex( hash ) ];
+   struct stateMachine *fsm = NULL;
+
+   /* Mark the state machine as busy, and handle the event without holding
+    * the lock: */
+   lockShard( shard );
+   waitForDispatches( shard, key, STATEM_REGISTRY_MAX_DISPATCHES );
+   struct registryEntry *entry = findEntry( shard, key, hash );
+   if ( entry )
+   {
+      fsm = entry->stateMachine;
+      shard->dispatching[ shard->numDispatching++ ] = key;
+   }
+   unlockShard( shard );
+
+   if ( !fsm )
+      return stateM_errArg;
+
+   int ret = stateM_handleEvent( fsm, event );
+
+   lockShard( shard );
+   shard->dispatching[ findDispatch( shard, key ) ] = shard->dispatching[
+      --shard->numDispatching ];
+   unlockShard( shard );
+
+   return ret;
+}
+
+size_t stateM_registrySize( struct stateMachineRegistry *registry )
+{
+   size_t size = 0;
+   size_t i;
+
+   if ( !registry )
+      return 0;
+
+   for ( i = 0; i < STATEM_REGISTRY_SHARDS; ++i )
+      size += __atomic_load_n( &registry->shards[ i ].numEntries,
+            __ATOMIC_RELAXED );
+
+   return size;
+}
+
+static uint64_t hashKey( uint64_t key )
+{
+   /* The splitmix64 finaliser. Sequential keys are spread over all shards
+    * and slots: */
+   key ^= key >> 30;
+   key *= 0xbf58476d1ce4e5b9ULL;
+   key ^= key >> 27;
+   key *= 0x94d049bb133111ebULL;
+   key ^= key >> 31;
+
+   return key;
+}
+
+static size_t shardIndex( uint64_t hash )
+{
+   /* The upper bits select the shard, and the lower bits the slot: */
+   return (size_t)( hash >> 32 ) & ( STATEM_REGISTRY_SHARDS - 1 );
+}
+
+static void lockShard( struct registryShard *shard )
+{
+   unsigned spins = 0;
+
+   /* Shards are only locked briefly, but the thread holding the lock may
+    * have been preempted: */
+   while ( __atomic_test_and_set( &shard->locked, __ATOMIC_ACQUIRE ) )
+      while ( __atomic_load_n( &shard->locked, __ATOMIC_RELAXED ) )
+         if ( ++spins % MAX_SPINS == 0 )
+            sched_yield();
+}
+
+static void unlockShard( struct registryShard *shard )
+{
+   __atomic_clear( &shard->locked, __ATOMIC_RELEASE );
+}
+
+/* Called with the shard locked. Waits until the state machine registered
+ * with the key is not handling an event, and until fewer than
+ * 'maxDispatching' events are handled in the shard: */
+static void waitForDispatches( struct registryShard *shard, uint64_t key,
+      size_t maxDispatching )
+{
+   while ( findDispatch( shard, key ) < shard->numDispatching ||
+         shard->numDispatching >= maxDispatching )
+   {
+      unlockShard( shard );
+      sched_yield();
+      lockShard( shard );
+   }
+}
+
+static size_t findDispatch( struct registryShard *shard, uint64_t key )
+{
+   size_t i;
+
+   for ( i = 0; i < shard->numDispatching; ++i )
+      if ( shard->dispatching[ i ] == key )
+         break;
+
+   return i;
+}
+
+static struct registryEntry *findEntry( struct registryShard *shard,
+      uint64_t key, uint64_t hash )
+{
+   size_t mask = shard->capacity - 1;
+   size_t i;
+
+   if ( !shard->capacity )
+      return NULL;
+
+   for ( i = (size_t)hash & mask; shard->entries[ i ].stateMachine; i = ( i
+            + 1 ) & mask )
+      if ( shard->entries[ i ].key == key )
+         return &shard->entries[ i ];
+
+   return NULL;
+}
+
+static bool insertEntry( struct registryShard *shard, uint64_t key,
+      uint64_t hash, struct stateMachine *fsm )
+{
+   /* Keep the table at most three quarters full: */
+   if ( ( shard->numEntries + 1 ) * 4 > shard->capacity * 3 && !growShard(
+            shard ) )
+      return false;
+
+   size_t mask = shard->capacity - 1;
+   size_t i;
+
+   for ( i = (size_t)hash & mask; shard->entries[ i ].stateMachine; i = ( i
+            + 1 ) & mask )
+      if ( shard->entries[ i ].key == key )
+         return false;
+
+   shard->entries[ i ].key = key;
+   shard->entries[ i ].stateMachine = fsm;
+   __atomic_store_n( &shard->numEntries, shard->numEntries + 1,
+         __ATOMIC_RELAXED );
+
+   return true;
+}
+
+static bool growShard( struct registryShard *shard )
+{
+   size_t capacity = shard->capacity ? shard->capacity * 2 : MIN_CAPACITY;
+   struct registryEntry *entries = calloc( capacity, sizeof( *entries ) );
+   size_t i, j;
+
+   if ( !entries )
+      return false;
+
+   for ( i = 0; i < shard->capacity; ++i )
+   {
+      struct registryEntry *entry = &shard->entries[ i ];
+
+      if ( !entry->stateMachine )
+         continue;
+
+      for ( j = (size_t)hashKey( entry->key ) & ( capacity - 1 );
+            entries[ j ].stateMachine; j = ( j + 1 ) & ( capacity - 1 ) )
+         ;
+
+      entries[ j ] = *entry;
+   }
+
+   free( shard->entries );
+   shard->entries = entries;
+   shard->capacity = capacity;
+
+   return true;
+}
+
+static struct stateMachine *removeEntry( struct registryShard *shard,
+      uint64_t key, uint64_t hash )
+{
+   struct registryEntry *entry = findEntry( shard, key, hash );
+
+   if ( !entry )
+      return NULL;
+
+   struct stateMachine *fsm = entry->stateMachine;
+   size_t mask = shard->capacity - 1;
+   size_t hole = (size_t)( entry - shard->entries );
+   size_t i;
+
+   /* Move back the following entries of the same probe sequence that would
+    * otherwise no longer be found: */
+   for ( i = ( hole + 1 ) & mask; shard->entries[ i ].stateMachine; i = ( i
+            + 1 ) & mask )
+   {
+      size_t home = (size_t)hashKey( shard->entries[ i ].key ) & mask;
+
+      /* The entry may stay if its home slot is cyclically in (hole, i]: */
+      if ( ( hole < i && hole < home && home <= i ) || ( i < hole && ( hole <
+                  home || home <= i ) ) )
+         continue;
+
+      shard->entries[ hole ] = shard->entries[ i ];
+      hole = i;
+   }
+
+   shard->entries[ hole ].stateMachine = NULL;
+   __atomic_store_n( &shard->numEntries, shard->numEntries - 1,
+         __ATOMIC_RELAXED );
+
+   return fsm;
+}
+
+static size_t *groupByShard( const uint64_t *keys, size_t count,
+      size_t *firstInShard )
+{
+   size_t next[ STATEM_REGISTRY_SHARDS ] = { 0 };
+   size_t *order = malloc( ( count + 1 ) * sizeof( size_t ) );
+   size_t i;
+
+   if ( !order )
+      return NULL;
+
+   /* A counting sort of the keys' indices by shard: */
+   for ( i = 0; i < count; ++i )
+      ++next[ shardIndex( hashKey( keys[ i ] ) ) ];
+
+   firstInShard[ 0 ] = 0;
+   for ( i = 0; i < STATEM_REGISTRY_SHARDS; ++i )
+   {
+      firstInShard[ i + 1 ] = firstInShard[ i ] + next[ i ];
+      next[ i ] = firstInShard[ i ];
+   }
+
+   for ( i = 0; i < count; ++i )
+      order[ next[ shardIndex( hashKey( keys[ i ] ) ) ]++ ] = i;
+
+   return order;
+}
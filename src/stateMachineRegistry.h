@@ -0,0 +1,243 @@
+/* 
+ * Copyright (c) 2013 Andreas Misje
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+/**
+ * \addtogroup stateMachine
+ * @{
+ *
+ * \file
+ * \brief Registry of state machines by key
+ *
+ * A registry maps 64-bit keys (session ids, for instance) to state
+ * machines, so that events can be dispatched by key. The registry is a hash
+ * table split into #STATEM_REGISTRY_SHARDS shards, each an open-addressing
+ * table with its own lock, so that threads working on different keys rarely
+ * wait for each other. Every entry takes 16 bytes, and tables are kept at
+ * most three quarters full.
+ *
+ * The registry does not own the state machines.
+ */
+
+#ifndef STATEMACHINE_REGISTRY_H
+#define STATEMACHINE_REGISTRY_H
+
+#include "stateMachine.h"
+#include <stdint.h>
+
+/**
+ * \brief Number of shards in a registry
+ *
+ * Must be a power of two. This macro may be defined by the user.
+ */
+#ifndef STATEM_REGISTRY_SHARDS
+#define STATEM_REGISTRY_SHARDS 64
+#endif
+
+/**
+ * \brief Number of events that may be handled at the same time by state
+ * machines in the same shard
+ *
+ * Further events passed to stateM_registryHandleEvent() wait for one of
+ * them to be handled. This macro may be defined by the user.
+ */
+#ifndef STATEM_REGISTRY_MAX_DISPATCHES
+#define STATEM_REGISTRY_MAX_DISPATCHES 8
+#endif
+
+/**
+ * \brief A registry entry
+ *
+ * Empty entries have a NULL #stateMachine.
+ */
+struct registryEntry
+{
+   /** \brief The key */
+   uint64_t key;
+   /** \brief The state machine registered with #key */
+   struct stateMachine *stateMachine;
+};
+
+/**
+ * \brief A shard of a registry
+ *
+ * Keys are placed by linear probing. Entries are removed by moving
+ * following entries back, so no tombstones are needed.
+ */
+struct registryShard
+{
+   /** \brief Set while a thread uses the shard */
+   bool locked;
+   /**
+    * \brief Keys of the state machines handling events passed through the
+    * registry
+    *
+    * Kept apart from the entries, so that entries stay small. The shard is
+    * not locked while the events are handled.
+    */
+   uint64_t dispatching[ STATEM_REGISTRY_MAX_DISPATCHES ];
+   /** \brief Number of keys in #dispatching */
+   size_t numDispatching;
+   /** \brief Number of registered state machines */
+   size_t numEntries;
+   /** \brief Size of #entries (a power of two, or zero) */
+   size_t capacity;
+   /** \brief The hash table */
+   struct registryEntry *entries;
+};
+
+/**
+ * \brief State machine registry
+ *
+ * Created by stateM_createRegistry(). There is no need to manipulate the
+ * members directly.
+ */
+struct stateMachineRegistry
+{
+   /** \brief The shards, selected by the upper bits of a key's hash */
+   struct registryShard shards[ STATEM_REGISTRY_SHARDS ];
+};
+
+/**
+ * \brief Create an empty registry
+ *
+ * \returns the registry, which must be freed with stateM_freeRegistry(), or
+ * NULL if memory could not be allocated.
+ */
+struct stateMachineRegistry *stateM_createRegistry( void );
+
+/**
+ * \brief Free a registry
+ *
+ * The registered state machines are not affected.
+ *
+ * \param registry the registry to free. May be NULL.
+ */
+void stateM_freeRegistry( struct stateMachineRegistry *registry );
+
+/**
+ * \brief Register a state machine
+ *
+ * \param registry the registry.
+ * \param key the key.
+ * \param stateMachine the state machine.
+ *
+ * \returns true if the state machine was registered, or false if an
+ * argument is NULL, if \pn{key} is already registered, or if memory could
+ * not be allocated.
+ */
+bool stateM_registryInsert( struct stateMachineRegistry *registry,
+      uint64_t key, struct stateMachine *stateMachine );
+
+/**
+ * \brief Register many state machines
+ *
+ * The keys are grouped by shard, so that every shard is only locked once.
+ *
+ * \param registry the registry.
+ * \param keys the keys.
+ * \param stateMachines the state machines to register with \pn{keys}.
+ * \param count the number of keys and state machines.
+ *
+ * \returns the number of state machines registered. Keys that are already
+ * registered (or repeated) are skipped.
+ */
+size_t stateM_registryInsertMany( struct stateMachineRegistry *registry,
+      const uint64_t *keys, struct stateMachine *const *stateMachines,
+      size_t count );
+
+/**
+ * \brief Unregister a state machine
+ *
+ * If the state machine is handling an event passed through
+ * stateM_registryHandleEvent(), this function waits until it is done.
+ *
+ * \param registry the registry.
+ * \param key the key.
+ *
+ * \returns the state machine that was registered with \pn{key}, or NULL.
+ */
+struct stateMachine *stateM_registryRemove(
+      struct stateMachineRegistry *registry, uint64_t key );
+
+/**
+ * \brief Unregister many state machines
+ *
+ * The keys are grouped by shard, so that every shard is only locked once,
+ * unless a state machine is handling an event passed through
+ * stateM_registryHandleEvent(), which is waited for.
+ *
+ * \param registry the registry.
+ * \param keys the keys.
+ * \param count the number of keys.
+ *
+ * \returns the number of state machines unregistered.
+ */
+size_t stateM_registryRemoveMany( struct stateMachineRegistry *registry,
+      const uint64_t *keys, size_t count );
+
+/**
+ * \brief Find a state machine
+ *
+ * \param registry the registry.
+ * \param key the key.
+ *
+ * \returns the state machine registered with \pn{key}, or NULL.
+ */
+struct stateMachine *stateM_registryFind(
+      struct stateMachineRegistry *registry, uint64_t key );
+
+/**
+ * \brief Pass an event to the state machine registered with a key
+ *
+ * The state machine is marked as busy while the event is handled, so it
+ * cannot be unregistered, or handle another event passed through the
+ * registry, in the meantime. The key's shard is only locked while the
+ * state machine is looked up and marked, so other state machines in the
+ * shard are not held up, and actions may use the registry. Actions must
+ * not pass events to, or unregister, the state machine handling the event,
+ * however, since that waits for the action itself.
+ *
+ * \param registry the registry.
+ * \param key the key.
+ * \param event the event.
+ *
+ * \returns #stateM_errArg if an argument is NULL or no state machine is
+ * registered with \pn{key}, otherwise the value stateM_handleEvent()
+ * returns.
+ */
+int stateM_registryHandleEvent( struct stateMachineRegistry *registry,
+      uint64_t key, struct event *event );
+
+/**
+ * \brief Get the number of registered state machines
+ *
+ * \param registry the registry.
+ *
+ * \returns the number of state machines in \pn{registry}.
+ */
+size_t stateM_registrySize( struct stateMachineRegistry *registry );
+
+#endif // STATEMACHINE_REGISTRY_H
+
+/**
+ * @}
+ */
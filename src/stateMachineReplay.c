@@ -0,0 +1,514 @@
+/* 
+ * Copyright (c) 2013 Andreas Misje
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#include "stateMachineReplay.h"
+#include <pthread.h>
+#include <stdlib.h>
+
+/* Number of buckets per thread. More buckets even out the work between
+ * threads, at the cost of more hash tables: */
+#define BUCKETS_PER_THREAD 8
+
+#if STATEM_MAX_REPLAY_THREADS > UINT32_MAX / BUCKETS_PER_THREAD
+#error "Bucket indices do not fit in 32 bits"
+#endif
+
+/* The events for the state machines whose ids hash to the same bucket */
+struct bucket
+{
+   /* The bucket's events in the sorted journal: */
+   size_t begin;
+   size_t end;
+   size_t numMachines;
+   uint64_t *machineIds;
+   struct stateMachine *machines;
+};
+
+struct replay;
+
+struct worker
+{
+   struct replay *replay;
+   unsigned index;
+   /* The part of the journal this worker sorts into buckets: */
+   size_t first;
+   size_t last;
+   /* The number of the worker's journal entries in every bucket, and later
+    * where the next one goes in the sorted journal: */
+   size_t *bucketPositions;
+   /* The buckets left to replay, the first in the upper 32 bits and the
+    * end in the lower. Other workers take buckets from the end: */
+   uint64_t buckets;
+   uint64_t *numVisits;
+   bool failed;
+};
+
+struct replay
+{
+   struct compiledStateMachine *compiled;
+   const struct journalEntry *journal;
+   struct journalEntry *sorted;
+   struct bucket *buckets;
+   size_t numBuckets;
+   struct worker *workers;
+   unsigned numWorkers;
+};
+
+/* A state machine's id together with its final state, for sorting: */
+struct finalState
+{
+   uint64_t machineId;
+   struct state *state;
+};
+
+static bool runWorkers( struct replay *replay,
+      void *( *phase )( void *worker ) );
+static void *countEntries( void *worker );
+static void *sortEntries( void *worker );
+static void *replayBuckets( void *worker );
+static bool replayBucket( struct replay *replay, struct bucket *bucket,
+      uint64_t *numVisits );
+static bool takeBucket( struct replay *replay, unsigned worker,
+      size_t *bucket );
+static bool takeFirst( uint64_t *buckets, size_t *bucket );
+static bool takeLast( uint64_t *buckets, size_t *bucket );
+static size_t bucketOf( uint64_t machineId, size_t numBuckets );
+static uint64_t hash( uint64_t machineId );
+static bool visited( int handleEventRet );
+static int compareFinalStates( const void *first, const void *second );
+static struct replayResult *collectResult( struct replay *replay );
+static void freeReplay( struct replay *replay );
+
+struct replayResult *stateM_replay( struct compiledStateMachine *compiled,
+      const struct journalEntry *journal, size_t numEntries,
+      unsigned numThreads )
+{
+   struct replayResult *result = NULL;
+   size_t numStates, b;
+   unsigned w;
+
+   /* The buckets are indexed with 32 bits (see worker::buckets): */
+   if ( !compiled || ( !journal && numEntries ) || numThreads >
+         STATEM_MAX_REPLAY_THREADS )
+      return NULL;
+
+   if ( !numThreads )
+      numThreads = 1;
+
+   numStates = compiled->definition->numStates;
+   struct replay replay = {
+      .compiled = compiled,
+      .journal = journal,
+      .numBuckets = (size_t)numThreads * BUCKETS_PER_THREAD,
+      .numWorkers = numThreads,
+   };
+
+   replay.sorted = malloc( numEntries * sizeof( *replay.sorted ) + 1 );
+   replay.buckets = calloc( replay.numBuckets, sizeof( *replay.buckets ) );
+   replay.workers = calloc( numThreads, sizeof( *replay.workers ) );
+   if ( !replay.sorted || !replay.buckets || !replay.workers )
+      goto done;
+
+   for ( w = 0; w < numThreads; ++w )
+   {
+      struct worker *worker = &replay.workers[ w ];
+      size_t firstBucket = w * replay.numBuckets / numThreads;
+      size_t endBucket = ( w + 1 ) * replay.numBuckets / numThreads;
+
+      worker->replay = &replay;
+      worker->index = w;
+      worker->first = w * numEntries / numThreads;
+      worker->last = ( w + 1 ) * numEntries / numThreads;
+      worker->buckets = (uint64_t)firstBucket << 32 | endBucket;
+      worker->bucketPositions = calloc( replay.numBuckets, sizeof(
+               *worker->bucketPositions ) );
+      worker->numVisits = calloc( numStates + 1, sizeof(
+               *worker->numVisits ) );
+      if ( !worker->bucketPositions || !worker->numVisits )
+         goto done;
+   }
+
+   /* Sort the journal into buckets. Every worker's entries go after those
+    * of the workers before it, so every state machine's events stay in
+    * journal order: */
+   runWorkers( &replay, &countEntries );
+
+   size_t position = 0;
+   for ( b = 0; b < replay.numBuckets; ++b )
+   {
+      replay.buckets[ b ].begin = position;
+      for ( w = 0; w < numThreads; ++w )
+      {
+         size_t count = replay.workers[ w ].bucketPositions[ b ];
+         replay.workers[ w ].bucketPositions[ b ] = position;
+         position += count;
+      }
+      replay.buckets[ b ].end = position;
+   }
+
+   runWorkers( &replay, &sortEntries );
+
+   if ( runWorkers( &replay, &replayBuckets ) )
+      result = collectResult( &replay );
+
+done:
+   freeReplay( &replay );
+   return result;
+}
+
+void stateM_freeReplay( struct replayResult *result )
+{
+   if ( !result )
+      return;
+
+   free( result->machineIds );
+   free( result->finalStates );
+   free( result->numVisits );
+   free( result );
+}
+
+static bool runWorkers( struct replay *replay,
+      void *( *phase )( void *worker ) )
+{
+   pthread_t *threads = calloc( replay->numWorkers, sizeof( *threads ) );
+   bool *started = calloc( replay->numWorkers, sizeof( *started ) );
+   bool failed = false;
+   unsigned w;
+
+   /* Workers whose threads could not be started (or all of them, if
+    * memory is short) run in this thread. The result is the same: */
+   for ( w = 1; threads && started && w < replay->numWorkers; ++w )
+      started[ w ] = !pthread_create( &threads[ w ], NULL, phase,
+            &replay->workers[ w ] );
+
+   phase( &replay->workers[ 0 ] );
+
+   for ( w = 1; w < replay->numWorkers; ++w )
+   {
+      if ( started && started[ w ] )
+         pthread_join( threads[ w ], NULL );
+      else
+         phase( &replay->workers[ w ] );
+   }
+
+   for ( w = 0; w < replay->numWorkers; ++w )
+      failed |= replay->workers[ w ].failed;
+
+   free( threads );
+   free( started );
+
+   return !failed;
+}
+
+static void *countEntries( void *arg )
+{
+   struct worker *worker = arg;
+   struct replay *replay = worker->replay;
+   size_t i;
+
+   for ( i = worker->first; i < worker->last; ++i )
+      ++worker->bucketPositions[ bucketOf( replay->journal[ i ].machineId,
+            replay->numBuckets ) ];
+
+   return NULL;
+}
+
+static void *sortEntries( void *arg )
+{
+   struct worker *worker = arg;
+   struct replay *replay = worker->replay;
+   size_t i;
+
+   for ( i = worker->first; i < worker->last; ++i )
+   {
+      size_t bucket = bucketOf( replay->journal[ i ].machineId,
+            replay->numBuckets );
+      replay->sorted[ worker->bucketPositions[ bucket ]++ ] =
+         replay->journal[ i ];
+   }
+
+   return NULL;
+}
+
+static void *replayBuckets( void *arg )
+{
+   struct worker *worker = arg;
+   struct replay *replay = worker->replay;
+   size_t bucket;
+
+   while ( takeBucket( replay, worker->index, &bucket ) )
+      if ( !replayBucket( replay, &replay->buckets[ bucket ],
+               worker->numVisits ) )
+         worker->failed = true;
+
+   return NULL;
+}
+
+static bool replayBucket( struct replay *replay, struct bucket *bucket,
+      uint64_t *numVisits )
+{
+   size_t numEvents = bucket->end - bucket->begin;
+   struct journalEntry *entries = &replay->sorted[ bucket->begin ];
+   size_t capacity = 1, i;
+   bool ok = false;
+
+   if ( !numEvents )
+      return true;
+
+   if ( numEvents >= UINT32_MAX )
+      return false;
+
+   /* Find the bucket's state machines with a hash table from machine id
+    * to index (plus one, so that zero marks empty slots). Every event is
+    * given the index of its state machine, so that the table is only
+    * needed once: */
+   while ( capacity < 2 * numEvents )
+      capacity *= 2;
+
+   uint64_t *slotIds = malloc( capacity * sizeof( *slotIds ) );
+   uint32_t *slotIndices = calloc( capacity, sizeof( *slotIndices ) );
+   uint32_t *machineOf = malloc( numEvents * sizeof( *machineOf ) );
+   if ( !slotIds || !slotIndices || !machineOf )
+      goto done;
+
+   for ( i = 0; i < numEvents; ++i )
+   {
+      uint64_t machineId = entries[ i ].machineId;
+      size_t slot = hash( machineId ) & ( capacity - 1 );
+
+      while ( slotIndices[ slot ] && slotIds[ slot ] != machineId )
+         slot = ( slot + 1 ) & ( capacity - 1 );
+
+      if ( !slotIndices[ slot ] )
+      {
+         slotIds[ slot ] = machineId;
+         slotIndices[ slot ] = (uint32_t)++bucket->numMachines;
+      }
+
+      machineOf[ i ] = slotIndices[ slot ] - 1;
+   }
+
+   bucket->machineIds = malloc( bucket->numMachines * sizeof(
+            *bucket->machineIds ) );
+   bucket->machines = malloc( bucket->numMachines * sizeof(
+            *bucket->machines ) );
+   if ( !bucket->machineIds || !bucket->machines )
+      goto done;
+
+   for ( i = 0; i < capacity; ++i )
+      if ( slotIndices[ i ] )
+         bucket->machineIds[ slotIndices[ i ] - 1 ] = slotIds[ i ];
+
+   struct state **states = replay->compiled->definition->states;
+   size_t numStates = replay->compiled->definition->numStates;
+
+   for ( i = 0; i < bucket->numMachines; ++i )
+   {
+      stateM_initCompiled( &bucket->machines[ i ], replay->compiled );
+
+      struct state *state = bucket->machines[ i ].currentState;
+      if ( state && state->id < numStates && states[ state->id ] == state )
+         ++numVisits[ state->id ];
+   }
+
+   for ( i = 0; i < numEvents; ++i )
+   {
+      struct stateMachine *fsm = &bucket->machines[ machineOf[ i ] ];
+      struct event event = entries[ i ].event;
+
+      if ( visited( stateM_handleEvent( fsm, &event ) ) &&
+            fsm->currentState )
+         ++numVisits[ fsm->currentState->id ];
+   }
+
+   ok = true;
+
+done:
+   free( slotIds );
+   free( slotIndices );
+   free( machineOf );
+   return ok;
+}
+
+static bool takeBucket( struct replay *replay, unsigned worker,
+      size_t *bucket )
+{
+   unsigned i;
+
+   if ( takeFirst( &replay->workers[ worker ].buckets, bucket ) )
+      return true;
+
+   /* Out of work. Steal from the others, starting with the next one: */
+   for ( i = 1; i < replay->numWorkers; ++i )
+      if ( takeLast( &replay->workers[ ( worker + i ) %
+               replay->numWorkers ].buckets, bucket ) )
+         return true;
+
+   return false;
+}
+
+static bool takeFirst( uint64_t *buckets, size_t *bucket )
+{
+   uint64_t range = __atomic_load_n( buckets, __ATOMIC_ACQUIRE );
+
+   do
+   {
+      uint64_t first = range >> 32, end = range & UINT32_MAX;
+      if ( first == end )
+         return false;
+
+      *bucket = (size_t)first;
+   } while ( !__atomic_compare_exchange_n( buckets, &range, range + (
+               (uint64_t)1 << 32 ), false, __ATOMIC_ACQ_REL,
+            __ATOMIC_ACQUIRE ) );
+
+   return true;
+}
+
+static bool takeLast( uint64_t *buckets, size_t *bucket )
+{
+   uint64_t range = __atomic_load_n( buckets, __ATOMIC_ACQUIRE );
+
+   do
+   {
+      uint64_t first = range >> 32, end = range & UINT32_MAX;
+      if ( first == end )
+         return false;
+
+      *bucket = (size_t)end - 1;
+   } while ( !__atomic_compare_exchange_n( buckets, &range, range - 1,
+            false, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE ) );
+
+   return true;
+}
+
+static size_t bucketOf( uint64_t machineId, size_t numBuckets )
+{
+   /* Scale the upper half of the hash to the number of buckets: */
+   return (size_t)( ( hash( machineId ) >> 32 ) * numBuckets >> 32 );
+}
+
+static uint64_t hash( uint64_t machineId )
+{
+   machineId ^= machineId >> 33;
+   machineId *= 0xff51afd7ed558ccdULL;
+   machineId ^= machineId >> 33;
+   return machineId;
+}
+
+static bool visited( int handleEventRet )
+{
+   return handleEventRet == stateM_stateChanged || handleEventRet ==
+      stateM_stateLoopSelf || handleEventRet == stateM_finalStateReached ||
+      handleEventRet == stateM_errorStateReached;
+}
+
+static int compareFinalStates( const void *first, const void *second )
+{
+   uint64_t firstId = ( (const struct finalState *)first )->machineId;
+   uint64_t secondId = ( (const struct finalState *)second )->machineId;
+
+   return ( firstId > secondId ) - ( firstId < secondId );
+}
+
+static struct replayResult *collectResult( struct replay *replay )
+{
+   size_t numStates = replay->compiled->definition->numStates;
+   size_t numMachines = 0, b, i, s;
+   unsigned w;
+
+   for ( b = 0; b < replay->numBuckets; ++b )
+      numMachines += replay->buckets[ b ].numMachines;
+
+   struct replayResult *result = calloc( 1, sizeof( *result ) );
+   struct finalState *finalStates = malloc( numMachines * sizeof(
+            *finalStates ) + 1 );
+   if ( !result || !finalStates )
+      goto fail;
+
+   result->numMachines = numMachines;
+   result->numStates = numStates;
+   result->machineIds = malloc( numMachines * sizeof( *result->machineIds )
+         + 1 );
+   result->finalStates = malloc( numMachines * sizeof(
+            *result->finalStates ) + 1 );
+   result->numVisits = calloc( numStates + 1, sizeof( *result->numVisits ) );
+   if ( !result->machineIds || !result->finalStates || !result->numVisits )
+      goto fail;
+
+   /* Machine ids are unique, so sorting makes the order independent of the
+    * number of threads: */
+   numMachines = 0;
+   for ( b = 0; b < replay->numBuckets; ++b )
+      for ( i = 0; i < replay->buckets[ b ].numMachines; ++i )
+         finalStates[ numMachines++ ] = (struct finalState){
+            replay->buckets[ b ].machineIds[ i ],
+               replay->buckets[ b ].machines[ i ].currentState };
+
+   qsort( finalStates, numMachines, sizeof( *finalStates ),
+         &compareFinalStates );
+   for ( i = 0; i < numMachines; ++i )
+   {
+      result->machineIds[ i ] = finalStates[ i ].machineId;
+      result->finalStates[ i ] = finalStates[ i ].state;
+   }
+
+   for ( w = 0; w < replay->numWorkers; ++w )
+      for ( s = 0; s < numStates; ++s )
+         result->numVisits[ s ] += replay->workers[ w ].numVisits[ s ];
+
+   free( finalStates );
+   return result;
+
+fail:
+   free( finalStates );
+   stateM_freeReplay( result );
+   return NULL;
+}
+
+static void freeReplay( struct replay *replay )
+{
+   size_t b;
+   unsigned w;
+
+   if ( replay->buckets )
+   {
+      for ( b = 0; b < replay->numBuckets; ++b )
+      {
+         free( replay->buckets[ b ].machineIds );
+         free( replay->buckets[ b ].machines );
+      }
+   }
+
+   if ( replay->workers )
+   {
+      for ( w = 0; w < replay->numWorkers; ++w )
+      {
+         free( replay->workers[ w ].bucketPositions );
+         free( replay->workers[ w ].numVisits );
+      }
+   }
+
+   free( replay->sorted );
+   free( replay->buckets );
+   free( replay->workers );
+}
@@ -0,0 +1,128 @@
+/* 
+ * Copyright (c) 2013 Andreas Misje
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+/**
+ * \addtogroup stateMachine
+ * @{
+ *
+ * \file
+ * \brief Replaying journals of events in parallel
+ *
+ * A journal records the events passed to many state machines, each
+ * identified by a machine id. State machines do not affect each other, so
+ * a journal can be replayed by several threads as long as every state
+ * machine's events are handled by one thread, in order.
+ *
+ * stateM_replay() splits the journal into buckets by machine id (keeping
+ * the order of every machine's events), and threads take buckets from
+ * each other when they run out of their own. The results are the same for
+ * any number of threads.
+ */
+
+#ifndef STATEMACHINE_REPLAY_H
+#define STATEMACHINE_REPLAY_H
+
+#include "stateMachine.h"
+#include "stateMachineCompile.h"
+#include <stdint.h>
+
+/**
+ * \brief Maximum number of threads stateM_replay() replays with
+ *
+ * The threads' ranges of buckets are stored in 32-bit halves, which limits
+ * the number of buckets, and with it the number of threads.
+ */
+#define STATEM_MAX_REPLAY_THREADS 65536u
+
+/**
+ * \brief An event passed to one of many state machines
+ */
+struct journalEntry
+{
+   /** \brief The id of the state machine the event was passed to */
+   uint64_t machineId;
+   /** \brief The event */
+   struct event event;
+};
+
+/**
+ * \brief The outcome of replaying a journal
+ *
+ * Returned by stateM_replay().
+ */
+struct replayResult
+{
+   /** \brief Number of state machines in the journal */
+   size_t numMachines;
+   /** \brief The ids of the state machines, in ascending order */
+   uint64_t *machineIds;
+   /** \brief The final state of every state machine in #machineIds */
+   struct state **finalStates;
+   /** \brief Number of states in the definition */
+   size_t numStates;
+   /**
+    * \brief The number of visits to every state, indexed by \ref state::id
+    * "state id"
+    *
+    * Every state machine visits its initial state. After that, every event
+    * that changes the state (or leads back to the same state) counts as a
+    * visit to the state the state machine ends up in.
+    */
+   uint64_t *numVisits;
+};
+
+/**
+ * \brief Replay a journal
+ *
+ * Every state machine in the journal is initialised with
+ * stateM_initCompiled() and passed its events in journal order. Actions
+ * are called from several threads, but never for the same state machine at
+ * once.
+ *
+ * \param compiled the compiled state machine.
+ * \param journal the events.
+ * \param numEntries the number of events in \pn{journal}.
+ * \param numThreads the number of threads to replay with. 0 is taken to
+ * mean 1.
+ *
+ * \returns the result, which must be freed with stateM_freeReplay(), or
+ * NULL if \pn{compiled} is NULL, if \pn{journal} is NULL while
+ * \pn{numEntries} is not zero, if \pn{numThreads} is greater than
+ * #STATEM_MAX_REPLAY_THREADS, or if memory could not be allocated or
+ * threads could not be created.
+ */
+struct replayResult *stateM_replay( struct compiledStateMachine *compiled,
+      const struct journalEntry *journal, size_t numEntries,
+      unsigned numThreads );
+
+/**
+ * \brief Free the result of a replay
+ *
+ * \param result the result to free. May be NULL.
+ */
+void stateM_freeReplay( struct replayResult *result );
+
+#endif // STATEMACHINE_REPLAY_H
+
+/**
+ * @}
+ */
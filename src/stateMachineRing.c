@@ -0,0 +1,248 @@
+/* 
+ * Copyright (c) 2013 Andreas Misje
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+/* syscall() is not part of C99: */
+#define _GNU_SOURCE
+
+#include "stateMachineRing.h"
+#include <errno.h>
+#include <linux/io_uring.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+static bool queueRequest( struct stateMachineRing *ring,
+      struct ringRequest *request, int opcode );
+static int enter( struct stateMachineRing *ring, unsigned minCompletions );
+static unsigned numQueued( struct stateMachineRing *ring );
+
+struct stateMachineRing *stateM_createRing( unsigned numEntries )
+{
+   struct io_uring_params params;
+   memset( &params, 0, sizeof( params ) );
+
+   struct stateMachineRing *ring = calloc( 1, sizeof( *ring ) );
+   if ( !ring )
+      return NULL;
+
+   ring->sqRing = MAP_FAILED;
+   ring->cqRing = MAP_FAILED;
+   ring->sqes = MAP_FAILED;
+   ring->fd = (int)syscall( __NR_io_uring_setup, numEntries, &params );
+   if ( ring->fd < 0 )
+      goto fail;
+
+   ring->sqRingSize = params.sq_off.array + params.sq_entries * sizeof(
+         unsigned );
+   ring->cqRingSize = params.cq_off.cqes + params.cq_entries * sizeof(
+         struct io_uring_cqe );
+
+   /* Newer kernels map both rings at once: */
+   if ( params.features & IORING_FEAT_SINGLE_MMAP )
+   {
+      if ( ring->cqRingSize > ring->sqRingSize )
+         ring->sqRingSize = ring->cqRingSize;
+      ring->cqRingSize = ring->sqRingSize;
+   }
+
+   ring->sqRing = mmap( NULL, ring->sqRingSize, PROT_READ | PROT_WRITE,
+         MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_SQ_RING );
+   if ( ring->sqRing == MAP_FAILED )
+      goto fail;
+
+   if ( params.features & IORING_FEAT_SINGLE_MMAP )
+      ring->cqRing = ring->sqRing;
+   else
+   {
+      ring->cqRing = mmap( NULL, ring->cqRingSize, PROT_READ | PROT_WRITE,
+            MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_CQ_RING );
+      if ( ring->cqRing == MAP_FAILED )
+         goto fail;
+   }
+
+   ring->sqes = mmap( NULL, params.sq_entries * sizeof( struct io_uring_sqe
+            ), PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring->fd,
+         IORING_OFF_SQES );
+   if ( ring->sqes == MAP_FAILED )
+      goto fail;
+
+   char *sq = ring->sqRing;
+   ring->sqHead = (unsigned *)( sq + params.sq_off.head );
+   ring->sqTail = (unsigned *)( sq + params.sq_off.tail );
+   ring->sqMask = *(unsigned *)( sq + params.sq_off.ring_mask );
+   ring->sqArray = (unsigned *)( sq + params.sq_off.array );
+   ring->numSqEntries = params.sq_entries;
+
+   char *cq = ring->cqRing;
+   ring->cqHead = (unsigned *)( cq + params.cq_off.head );
+   ring->cqTail = (unsigned *)( cq + params.cq_off.tail );
+   ring->cqMask = *(unsigned *)( cq + params.cq_off.ring_mask );
+   ring->cqes = (struct io_uring_cqe *)( cq + params.cq_off.cqes );
+   ring->numCqEntries = params.cq_entries;
+
+   return ring;
+
+fail:
+   {
+      int error = errno;
+      stateM_freeRing( ring );
+      errno = error;
+   }
+   return NULL;
+}
+
+void stateM_freeRing( struct stateMachineRing *ring )
+{
+   if ( !ring )
+      return;
+
+   if ( ring->sqes != MAP_FAILED )
+      munmap( ring->sqes, ring->numSqEntries * sizeof( struct io_uring_sqe
+               ) );
+   if ( ring->cqRing != MAP_FAILED && ring->cqRing != ring->sqRing )
+      munmap( ring->cqRing, ring->cqRingSize );
+   if ( ring->sqRing != MAP_FAILED )
+      munmap( ring->sqRing, ring->sqRingSize );
+   if ( ring->fd >= 0 )
+      close( ring->fd );
+
+   free( ring );
+}
+
+bool stateM_ringRead( struct stateMachineRing *ring,
+      struct ringRequest *request )
+{
+   return queueRequest( ring, request, IORING_OP_READ );
+}
+
+bool stateM_ringWrite( struct stateMachineRing *ring,
+      struct ringRequest *request )
+{
+   return queueRequest( ring, request, IORING_OP_WRITE );
+}
+
+int stateM_ringDispatch( struct stateMachineRing *ring,
+      unsigned minCompletions )
+{
+   int numDispatched = 0;
+
+   if ( !ring )
+   {
+      errno = EINVAL;
+      return -1;
+   }
+
+   /* Never wait for completions that cannot come: */
+   if ( minCompletions > ring->numInFlight )
+      minCompletions = ring->numInFlight;
+
+   if ( ( numQueued( ring ) || minCompletions ) && enter( ring,
+            minCompletions ) < 0 && errno != EINTR )
+      return -1;
+
+   unsigned head = *ring->cqHead;
+   unsigned tail = __atomic_load_n( ring->cqTail, __ATOMIC_ACQUIRE );
+
+   while ( head != tail )
+   {
+      struct io_uring_cqe *cqe = &ring->cqes[ head & ring->cqMask ];
+      struct ringRequest *request = (struct ringRequest *)(uintptr_t)
+         cqe->user_data;
+      request->result = cqe->res;
+
+      /* Free the entry before dispatching, since actions may submit
+       * requests: */
+      __atomic_store_n( ring->cqHead, ++head, __ATOMIC_RELEASE );
+      --ring->numInFlight;
+
+      struct event event = { request->eventType, request };
+      stateM_handleEvent( request->stateMachine, &event );
+      ++numDispatched;
+   }
+
+   return numDispatched;
+}
+
+static bool queueRequest( struct stateMachineRing *ring,
+      struct ringRequest *request, int opcode )
+{
+   if ( !ring || !request || !request->stateMachine )
+   {
+      errno = EINVAL;
+      return false;
+   }
+
+   if ( ring->numInFlight == ring->numCqEntries )
+   {
+      errno = EBUSY;
+      return false;
+   }
+
+   /* Make room by submitting what has been queued so far: */
+   if ( numQueued( ring ) == ring->numSqEntries )
+   {
+      if ( enter( ring, 0 ) < 0 )
+         return false;
+
+      if ( numQueued( ring ) == ring->numSqEntries )
+      {
+         errno = EBUSY;
+         return false;
+      }
+   }
+
+   unsigned tail = *ring->sqTail;
+   unsigned index = tail & ring->sqMask;
+   struct io_uring_sqe *sqe = &ring->sqes[ index ];
+
+   memset( sqe, 0, sizeof( *sqe ) );
+   sqe->opcode = (uint8_t)opcode;
+   sqe->fd = request->fd;
+   sqe->addr = (uintptr_t)request->buffer;
+   sqe->len = request->size;
+   /* Use (and update) the current file position: */
+   sqe->off = (uint64_t)-1;
+   sqe->user_data = (uintptr_t)request;
+   ring->sqArray[ index ] = index;
+
+   /* Publish the entry to the kernel: */
+   __atomic_store_n( ring->sqTail, tail + 1, __ATOMIC_RELEASE );
+   ++ring->numInFlight;
+
+   return true;
+}
+
+static int enter( struct stateMachineRing *ring, unsigned minCompletions )
+{
+   ++ring->numEnterCalls;
+   return (int)syscall( __NR_io_uring_enter, ring->fd, numQueued( ring ),
+         minCompletions, minCompletions ? IORING_ENTER_GETEVENTS : 0, NULL,
+         0 );
+}
+
+static unsigned numQueued( struct stateMachineRing *ring )
+{
+   return *ring->sqTail - __atomic_load_n( ring->sqHead, __ATOMIC_ACQUIRE );
+}
@@ -0,0 +1,203 @@
+/* 
+ * Copyright (c) 2013 Andreas Misje
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+/**
+ * \addtogroup stateMachine
+ * @{
+ *
+ * \file
+ * \brief Event loop feeding state machines from io_uring (Linux)
+ *
+ * An epoll-based loop makes at least two system calls per event: one to
+ * wait for readiness, and one to read or write. A ring submits reads and
+ * writes through the submission queue shared with the kernel, so actions
+ * can start I/O without any system call. stateM_ringDispatch() submits all
+ * of them and waits for completions with a single system call, and turns
+ * every completion into an event passed to the state machine that made the
+ * request.
+ *
+ * Reads and writes always use the current file position, which suits
+ * sockets, pipes and files read from or written to in sequence.
+ */
+
+#ifndef STATEMACHINE_RING_H
+#define STATEMACHINE_RING_H
+
+#include "stateMachine.h"
+
+struct io_uring_sqe;
+struct io_uring_cqe;
+
+/**
+ * \brief A read or write request
+ *
+ * The request is owned by the caller and must remain valid until its
+ * completion has been handled. It is passed as the \ref event::data
+ * "payload" of the completion event.
+ */
+struct ringRequest
+{
+   /** \brief The state machine to pass the completion event to */
+   struct stateMachine *stateMachine;
+   /** \brief The \ref event::type "type" of the completion event */
+   int eventType;
+   /** \brief The file descriptor to read from or write to */
+   int fd;
+   /** \brief The data to write, or where to put the data read */
+   void *buffer;
+   /** \brief The number of bytes to read or write */
+   unsigned size;
+   /**
+    * \brief Set when the request has completed to the number of bytes
+    * read or written (0 at the end of a file), or to a negative error
+    * number
+    */
+   int result;
+   /** \brief User data, not used by the ring */
+   void *data;
+};
+
+/**
+ * \brief An io_uring instance
+ *
+ * Created by stateM_createRing(). There is no need to manipulate the
+ * members directly.
+ */
+struct stateMachineRing
+{
+   /** \brief The io_uring file descriptor */
+   int fd;
+   /** \brief The mapped submission queue ring */
+   void *sqRing;
+   /** \brief Size of #sqRing */
+   size_t sqRingSize;
+   /** \brief The mapped completion queue ring, possibly the same as #sqRing */
+   void *cqRing;
+   /** \brief Size of #cqRing */
+   size_t cqRingSize;
+   /** \brief Index of the next submission the kernel will read */
+   unsigned *sqHead;
+   /** \brief Index of the next submission to write */
+   unsigned *sqTail;
+   /** \brief Mask turning an index into a position in #sqArray */
+   unsigned sqMask;
+   /** \brief Positions in #sqes of the queued submissions */
+   unsigned *sqArray;
+   /** \brief Number of entries in the submission queue */
+   unsigned numSqEntries;
+   /** \brief The submission queue entries */
+   struct io_uring_sqe *sqes;
+   /** \brief Index of the next completion to read */
+   unsigned *cqHead;
+   /** \brief Index of the next completion the kernel will write */
+   unsigned *cqTail;
+   /** \brief Mask turning an index into a position in #cqes */
+   unsigned cqMask;
+   /** \brief Number of entries in the completion queue */
+   unsigned numCqEntries;
+   /** \brief The completion queue entries */
+   struct io_uring_cqe *cqes;
+   /**
+    * \brief Number of requests submitted or queued that have not been
+    * dispatched yet
+    *
+    * Limited to #numCqEntries, so that the completion queue cannot
+    * overflow.
+    */
+   unsigned numInFlight;
+   /** \brief Number of system calls made to submit and wait */
+   size_t numEnterCalls;
+};
+
+/**
+ * \brief Create a ring
+ *
+ * \param numEntries the size of the submission queue, rounded up to a
+ * power of two by the kernel. Up to twice as many requests may be in
+ * flight.
+ *
+ * \returns the ring, which must be freed with stateM_freeRing(), or NULL
+ * with errno set if io_uring is not supported (ENOSYS), not permitted
+ * (EPERM) or could not be set up.
+ */
+struct stateMachineRing *stateM_createRing( unsigned numEntries );
+
+/**
+ * \brief Free a ring
+ *
+ * The ring should not have any requests in flight.
+ *
+ * \param ring the ring to free. May be NULL.
+ */
+void stateM_freeRing( struct stateMachineRing *ring );
+
+/**
+ * \brief Queue a read request
+ *
+ * The request is submitted by the next call to stateM_ringDispatch(),
+ * unless the submission queue is full, in which case the queued requests
+ * are submitted at once. Actions may call this function.
+ *
+ * \param ring the ring.
+ * \param request the request.
+ *
+ * \returns true if the request was queued, or false with errno set to
+ * EINVAL if an argument (or the request's state machine) is NULL, to EBUSY
+ * if too many requests are in flight, or to the reason the queued
+ * requests could not be submitted.
+ */
+bool stateM_ringRead( struct stateMachineRing *ring,
+      struct ringRequest *request );
+
+/**
+ * \brief Queue a write request
+ *
+ * Works like stateM_ringRead().
+ */
+bool stateM_ringWrite( struct stateMachineRing *ring,
+      struct ringRequest *request );
+
+/**
+ * \brief Submit the queued requests and dispatch completions
+ *
+ * All queued requests are submitted, and the function waits for at least
+ * \pn{minCompletions} of the requests in flight to complete, with a single
+ * system call (none if nothing is queued and \pn{minCompletions} is zero).
+ * Every completion available is then passed to its request's state machine
+ * with stateM_handleEvent(), in the order the requests completed. Requests
+ * queued by the actions are submitted by the next call.
+ *
+ * \param ring the ring.
+ * \param minCompletions the number of completions to wait for. Limited to
+ * the number of requests in flight.
+ *
+ * \returns the number of completion events dispatched, or -1 with errno
+ * set if \pn{ring} is NULL (EINVAL) or if the system call failed.
+ */
+int stateM_ringDispatch( struct stateMachineRing *ring,
+      unsigned minCompletions );
+
+#endif // STATEMACHINE_RING_H
+
+/**
+ * @}
+ */
@@ -0,0 +1,431 @@
+/* 
+ * Copyright (c) 2013 Andreas Misje
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+/* memfd_create() and the POSIX shared memory functions are not part of
+ * C99: */
+#define _GNU_SOURCE
+
+#include "stateMachineShared.h"
+#include "stateMachineInternal.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <sched.h>
+#include <signal.h>
+#include <stdlib.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+/* "stateMSM" */
+#define SEGMENT_MAGIC 0x73746174654d534dULL
+
+static struct sharedStateMachines *attach( int fd,
+      struct stateMachineDefinition *definition );
+static uint64_t fingerprint( struct stateMachineDefinition *definition );
+static uint64_t mix( uint64_t hash, uint64_t value );
+static struct sharedSnapshot *findSnapshot(
+      struct sharedStateMachine *instance, uint32_t sequence );
+static void loadInstance( struct sharedStateMachines *shared,
+      struct sharedStateMachine *instance, struct stateMachine *fsm );
+static void saveInstance( struct sharedStateMachine *instance,
+      struct stateMachine *fsm );
+
+struct sharedStateMachines *stateM_createShared( const char *name,
+      struct stateMachineDefinition *definition, size_t numInstances )
+{
+   if ( !definition || !definition->verified || definition->numStates >=
+         STATEM_SHARED_NO_STATE || numInstances > ( SIZE_MAX - sizeof(
+               struct sharedSegment ) ) / sizeof( struct sharedStateMachine ) )
+   {
+      errno = EINVAL;
+      return NULL;
+   }
+
+   size_t size = sizeof( struct sharedSegment ) + numInstances * sizeof(
+         struct sharedStateMachine );
+   int fd = name ? shm_open( name, O_RDWR | O_CREAT | O_EXCL, 0600 ) :
+      memfd_create( "stateMachine", MFD_CLOEXEC );
+
+   if ( fd < 0 )
+      return NULL;
+
+   if ( ftruncate( fd, (off_t)size ) )
+      goto fail;
+
+   struct sharedSegment *segment = mmap( NULL, size, PROT_READ |
+         PROT_WRITE, MAP_SHARED, fd, 0 );
+   if ( segment == MAP_FAILED )
+      goto fail;
+
+   segment->fingerprint = fingerprint( definition );
+   segment->numInstances = numInstances;
+
+   size_t i;
+   for ( i = 0; i < numInstances; ++i )
+   {
+      struct stateMachine fsm;
+
+      stateM_initWithDefinition( &fsm, definition );
+      saveInstance( &segment->instances[ i ], &fsm );
+   }
+
+   /* The magic number is written last, so that processes opening the
+    * segment early do not see a partly initialised segment: */
+   __atomic_store_n( &segment->magic, SEGMENT_MAGIC, __ATOMIC_RELEASE );
+   munmap( segment, size );
+
+   struct sharedStateMachines *shared = attach( fd, definition );
+   if ( shared )
+      return shared;
+
+fail:
+   {
+      int error = errno;
+
+      close( fd );
+      if ( name )
+         shm_unlink( name );
+
+      errno = error;
+      return NULL;
+   }
+}
+
+struct sharedStateMachines *stateM_openShared( const char *name,
+      struct stateMachineDefinition *definition )
+{
+   if ( !name || !definition )
+   {
+      errno = EINVAL;
+      return NULL;
+   }
+
+   int fd = shm_open( name, O_RDWR, 0 );
+   if ( fd < 0 )
+      return NULL;
+
+   struct sharedStateMachines *shared = attach( fd, definition );
+   if ( !shared )
+   {
+      int error = errno;
+
+      close( fd );
+      errno = error;
+   }
+
+   return shared;
+}
+
+struct sharedStateMachines *stateM_mapShared( int fd,
+      struct stateMachineDefinition *definition )
+{
+   int copy = fcntl( fd, F_DUPFD_CLOEXEC, 0 );
+
+   if ( copy < 0 )
+      return NULL;
+
+   struct sharedStateMachines *shared = attach( copy, definition );
+   if ( !shared )
+   {
+      int error = errno;
+
+      close( copy );
+      errno = error;
+   }
+
+   return shared;
+}
+
+void stateM_closeShared( struct sharedStateMachines *shared )
+{
+   if ( !shared )
+      return;
+
+   munmap( shared->segment, shared->size );
+   close( shared->fd );
+   free( shared );
+}
+
+int stateM_handleSharedEvent( struct sharedStateMachines *shared,
+      size_t instance, struct event *event )
+{
+   if ( !shared || !event || instance >= shared->segment->numInstances )
+      return stateM_errArg;
+
+   struct sharedStateMachine *sharedFsm = &shared->segment->instances[
+      instance ];
+   uint32_t self = (uint32_t)getpid();
+   uint32_t owner = 0;
+
+   /* Wait for the process currently handling an event for this instance.
+    * The owner is a process ID, so threads of the same process cannot tell
+    * which of them owns the instance, but they still wait for each other: */
+   while ( !__atomic_compare_exchange_n( &sharedFsm->owner, &owner, self,
+            false, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED ) )
+   {
+      /* Take over from an owner that died while handling an event: */
+      if ( kill( (pid_t)owner, 0 ) == -1 && errno == ESRCH &&
+            __atomic_compare_exchange_n( &sharedFsm->owner, &owner, self,
+               false, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED ) )
+      {
+         /* If the owner died while saving the instance, the snapshot it
+          * was writing is discarded, and the instance's state is the one
+          * readers have been seeing all along: */
+         uint32_t sequence = __atomic_load_n( &sharedFsm->sequence,
+               __ATOMIC_RELAXED );
+         if ( sequence & 1 )
+            __atomic_store_n( &sharedFsm->sequence, sequence - 1,
+                  __ATOMIC_RELEASE );
+         break;
+      }
+
+      owner = 0;
+      sched_yield();
+   }
+
+   struct stateMachine fsm;
+   loadInstance( shared, sharedFsm, &fsm );
+   int ret = stateM_handleEvent( &fsm, event );
+   saveInstance( sharedFsm, &fsm );
+
+   __atomic_store_n( &sharedFsm->owner, 0, __ATOMIC_RELEASE );
+
+   return ret;
+}
+
+struct state *stateM_sharedState( struct sharedStateMachines *shared,
+      size_t instance, struct state **previousState )
+{
+   if ( !shared || instance >= shared->segment->numInstances )
+      return NULL;
+
+   struct sharedStateMachine *sharedFsm = &shared->segment->instances[
+      instance ];
+   uint32_t begin, end, current, previous;
+
+   /* While the sequence number is odd, the owner writes the snapshot that
+    * is not read. The read is only retried if the owner has since moved on
+    * to writing the snapshot that was read: */
+   for ( ;; )
+   {
+      begin = __atomic_load_n( &sharedFsm->sequence, __ATOMIC_ACQUIRE );
+      struct sharedSnapshot *snapshot = findSnapshot( sharedFsm, begin );
+      current = __atomic_load_n( &snapshot->currentState,
+            __ATOMIC_RELAXED );
+      previous = __atomic_load_n( &snapshot->previousState,
+            __ATOMIC_RELAXED );
+      __atomic_thread_fence( __ATOMIC_ACQUIRE );
+      end = __atomic_load_n( &sharedFsm->sequence, __ATOMIC_RELAXED );
+
+      if ( end - ( begin & ~1u ) <= 2 )
+         break;
+
+      sched_yield();
+   }
+
+   if ( previousState )
+      *previousState = stateM_stateFromId( shared->definition, previous );
+
+   return stateM_stateFromId( shared->definition, current );
+}
+
+static struct sharedStateMachines *attach( int fd,
+      struct stateMachineDefinition *definition )
+{
+   struct stat status;
+
+   if ( !definition || !definition->verified || fstat( fd, &status ) )
+   {
+      if ( !definition || !definition->verified )
+         errno = EINVAL;
+
+      return NULL;
+   }
+
+   size_t size = (size_t)status.st_size;
+   if ( size < sizeof( struct sharedSegment ) )
+   {
+      errno = EINVAL;
+      return NULL;
+   }
+
+   struct sharedSegment *segment = mmap( NULL, size, PROT_READ |
+         PROT_WRITE, MAP_SHARED, fd, 0 );
+   if ( segment == MAP_FAILED )
+      return NULL;
+
+   if ( __atomic_load_n( &segment->magic, __ATOMIC_ACQUIRE ) !=
+         SEGMENT_MAGIC || segment->fingerprint != fingerprint( definition )
+         || segment->numInstances > ( size - sizeof( *segment ) ) / sizeof(
+            struct sharedStateMachine ) )
+   {
+      munmap( segment, size );
+      errno = EINVAL;
+      return NULL;
+   }
+
+   struct sharedStateMachines *shared = calloc( 1, sizeof( *shared ) );
+   if ( !shared )
+   {
+      munmap( segment, size );
+      errno = ENOMEM;
+      return NULL;
+   }
+
+   shared->definition = definition;
+   shared->segment = segment;
+   shared->size = size;
+   shared->fd = fd;
+
+   return shared;
+}
+
+static uint64_t fingerprint( struct stateMachineDefinition *definition )
+{
+   uint64_t hash = 0xcbf29ce484222325ULL;
+   size_t i, j;
+
+   /* The ids are the states' indices, which are the same in every process
+    * using the same definition: */
+   for ( i = 0; i < definition->numStates; ++i )
+      definition->states[ i ]->id = i;
+
+   /* Only the structure is included. Pointers to data and functions differ
+    * between processes: */
+   hash = mix( hash, definition->numStates );
+   hash = mix( hash, stateM_stateId( definition->initialState ) );
+   hash = mix( hash, stateM_stateId( definition->errorState ) );
+
+   for ( i = 0; i < definition->numStates; ++i )
+   {
+      struct state *state = definition->states[ i ];
+
+      hash = mix( hash, stateM_stateId( state->parentState ) );
+      hash = mix( hash, stateM_stateId( state->entryState ) );
+      hash = mix( hash, state->historySlot );
+      hash = mix( hash, state->historyType );
+      hash = mix( hash, state->numTransitions );
+      hash = mix( hash, state->numDeferredEvents );
+      hash = mix( hash, state->numRegions );
+
+      for ( j = 0; j < state->numTransitions; ++j )
+      {
+         hash = mix( hash, (unsigned)state->transitions[ j ].eventType );
+         hash = mix( hash, stateM_stateId(
+                  state->transitions[ j ].nextState ) );
+      }
+
+      for ( j = 0; j < state->numDeferredEvents; ++j )
+         hash = mix( hash, (unsigned)state->deferredEvents[ j ] );
+
+      for ( j = 0; j < state->numRegions; ++j )
+         hash = mix( hash, stateM_stateId( state->regions[ j ] ) );
+   }
+
+   return hash;
+}
+
+static uint64_t mix( uint64_t hash, uint64_t value )
+{
+   /* FNV-1a, one 64-bit word at a time: */
+   return ( hash ^ value ) * 0x100000001b3ULL;
+}
+
+static struct sharedSnapshot *findSnapshot(
+      struct sharedStateMachine *sharedFsm, uint32_t sequence )
+{
+   return &sharedFsm->snapshots[ sequence >> 1 & 1 ];
+}
+
+static void loadInstance( struct sharedStateMachines *shared,
+      struct sharedStateMachine *sharedFsm, struct stateMachine *fsm )
+{
+   struct stateMachineDefinition *definition = shared->definition;
+   struct sharedSnapshot *snapshot = findSnapshot( sharedFsm,
+         sharedFsm->sequence );
+   size_t i;
+
+   /* Only the owner modifies the instance, so it is read without the
+    * sequence number: */
+   stateM_initWithDefinition( fsm, definition );
+   fsm->currentState = stateM_stateFromId( definition,
+         snapshot->currentState );
+   fsm->previousState = stateM_stateFromId( definition,
+         snapshot->previousState );
+
+   for ( i = 0; i < STATEM_MAX_REGIONS; ++i )
+   {
+      fsm->regionStates[ i ] = stateM_stateFromId( definition,
+            snapshot->regionStates[ i ] );
+      fsm->regionEventMasks[ i ] = snapshot->regionEventMasks[ i ];
+   }
+
+   for ( i = 0; i < STATEM_HISTORY_SLOTS; ++i )
+      fsm->history[ i ] = stateM_stateFromId( definition,
+            snapshot->history[ i ] );
+
+   fsm->deferQueueHead = snapshot->deferQueueHead;
+   fsm->numDeferredEvents = snapshot->numDeferredEvents;
+   for ( i = 0; i < STATEM_DEFERQUEUE_SIZE; ++i )
+      fsm->deferQueue[ i ] = snapshot->deferQueue[ i ];
+}
+
+static void saveInstance( struct sharedStateMachine *sharedFsm,
+      struct stateMachine *fsm )
+{
+   uint32_t sequence = sharedFsm->sequence;
+   struct sharedSnapshot *snapshot = findSnapshot( sharedFsm, sequence + 2 );
+   size_t i;
+
+   /* Make the sequence number odd before changing the snapshot that is not
+    * in use, and switch to that snapshot by making the number even again
+    * afterwards: */
+   __atomic_store_n( &sharedFsm->sequence, sequence + 1, __ATOMIC_RELAXED );
+   __atomic_thread_fence( __ATOMIC_RELEASE );
+
+   __atomic_store_n( &snapshot->currentState, stateM_stateId(
+            fsm->currentState ), __ATOMIC_RELAXED );
+   __atomic_store_n( &snapshot->previousState, stateM_stateId(
+            fsm->previousState ), __ATOMIC_RELAXED );
+
+   /* Region states are only valid for as many regions as the current state
+    * has: */
+   for ( i = 0; i < STATEM_MAX_REGIONS; ++i )
+   {
+      bool active = fsm->currentState && i < fsm->currentState->numRegions;
+
+      snapshot->regionStates[ i ] = active ? stateM_stateId(
+            fsm->regionStates[ i ] ) : STATEM_SHARED_NO_STATE;
+      snapshot->regionEventMasks[ i ] = active ? fsm->regionEventMasks[ i ]
+         : 0;
+   }
+
+   for ( i = 0; i < STATEM_HISTORY_SLOTS; ++i )
+      snapshot->history[ i ] = stateM_stateId( fsm->history[ i ] );
+
+   snapshot->deferQueueHead = (uint32_t)fsm->deferQueueHead;
+   snapshot->numDeferredEvents = (uint32_t)fsm->numDeferredEvents;
+   for ( i = 0; i < STATEM_DEFERQUEUE_SIZE; ++i )
+      snapshot->deferQueue[ i ] = fsm->deferQueue[ i ];
+
+   __atomic_store_n( &sharedFsm->sequence, sequence + 2, __ATOMIC_RELEASE );
+}
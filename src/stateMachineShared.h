@@ -0,0 +1,246 @@
+/* 
+ * Copyright (c) 2013 Andreas Misje
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+/**
+ * \addtogroup stateMachine
+ * @{
+ *
+ * \file
+ * \brief State machines shared between processes
+ *
+ * The state of shared state machines is stored in a shared-memory segment
+ * as \ref state::id "state ids" (indices into the \ref
+ * stateMachineDefinition "definition") instead of pointers. Every process
+ * loads the same definition, and maps the segment. One process at a time
+ * may handle an event for an instance, while any process may read the
+ * current state without locking.
+ *
+ * Event data pointers are only meaningful in the process that created
+ * them. Events \ref state::deferredEvents "deferred" by a shared state
+ * machine must therefore carry integer payloads, or pointers into memory
+ * shared by all processes.
+ */
+
+#ifndef STATEMACHINE_SHARED_H
+#define STATEMACHINE_SHARED_H
+
+#include "stateMachine.h"
+#include <stdint.h>
+
+/** \brief Stored instead of the id of a state that does not exist */
+#define STATEM_SHARED_NO_STATE UINT32_MAX
+
+/**
+ * \brief A copy of a shared state machine instance's state
+ *
+ * There is no need to manipulate the members directly.
+ */
+struct sharedSnapshot
+{
+   /** \brief Id of the current state */
+   uint32_t currentState;
+   /** \brief Id of the previous state */
+   uint32_t previousState;
+   /** \brief Ids of the active states in the current state's regions */
+   uint32_t regionStates[ STATEM_MAX_REGIONS ];
+   /** \brief See stateMachine::regionEventMasks */
+   unsigned long regionEventMasks[ STATEM_MAX_REGIONS ];
+   /** \brief Ids of the states in stateMachine::history */
+   uint32_t history[ STATEM_HISTORY_SLOTS ];
+   /** \brief Index of the oldest event in #deferQueue */
+   uint32_t deferQueueHead;
+   /** \brief Number of events in #deferQueue */
+   uint32_t numDeferredEvents;
+   /** \brief See stateMachine::deferQueue */
+   struct event deferQueue[ STATEM_DEFERQUEUE_SIZE ];
+};
+
+/**
+ * \brief A state machine instance in shared memory
+ *
+ * There is no need to manipulate the members directly.
+ */
+struct sharedStateMachine
+{
+   /**
+    * \brief Sequence number, odd while the instance is being updated
+    *
+    * Bit 1 selects the snapshot in #snapshots that holds the instance's
+    * state. The other snapshot is written while the number is odd, and
+    * becomes the instance's state when the number is made even again.
+    * Readers retry if the number changed while they read the instance.
+    */
+   uint32_t sequence;
+   /**
+    * \brief Process ID of the process handling an event, or 0
+    *
+    * Threads of the same process share the process ID, and wait for each
+    * other like other processes do.
+    */
+   uint32_t owner;
+   /** \brief The instance's state, and the state being written */
+   struct sharedSnapshot snapshots[ 2 ];
+};
+
+/**
+ * \brief Header of a shared-memory segment
+ *
+ * The instances follow the header.
+ */
+struct sharedSegment
+{
+   /** \brief Identifies the segment as a state machine segment */
+   uint64_t magic;
+   /**
+    * \brief Fingerprint of the definition's structure
+    *
+    * Processes mapping the segment must use a definition with the same
+    * states and transitions, in the same order.
+    */
+   uint64_t fingerprint;
+   /** \brief Number of instances in #instances */
+   uint64_t numInstances;
+   /** \brief The instances */
+   struct sharedStateMachine instances[];
+};
+
+/**
+ * \brief A process's view of a shared-memory segment
+ *
+ * Created by stateM_createShared(), stateM_openShared() or
+ * stateM_mapShared().
+ */
+struct sharedStateMachines
+{
+   /** \brief The definition used by this process */
+   struct stateMachineDefinition *definition;
+   /** \brief The mapped segment */
+   struct sharedSegment *segment;
+   /** \brief Size of the mapping */
+   size_t size;
+   /** \brief File descriptor of the segment */
+   int fd;
+};
+
+/**
+ * \brief Create a shared-memory segment
+ *
+ * All instances start in the definition's initial state. Every state in
+ * the definition is given its \ref state::id "id".
+ *
+ * \param name the name of a new POSIX shared memory object (see
+ * shm_open()), or NULL to create an anonymous segment with memfd_create().
+ * An anonymous segment can be shared with child processes, or with other
+ * processes by passing its \ref sharedStateMachines::fd "file descriptor".
+ * \param definition the definition. It must have been successfully \ref
+ * stateM_validate() "validated".
+ * \param numInstances the number of state machine instances.
+ *
+ * \returns the shared state machines, which must be closed with
+ * stateM_closeShared(), or NULL on error (\c errno is set).
+ */
+struct sharedStateMachines *stateM_createShared( const char *name,
+      struct stateMachineDefinition *definition, size_t numInstances );
+
+/**
+ * \brief Open a shared-memory segment created by another process
+ *
+ * \param name the name passed to stateM_createShared().
+ * \param definition the definition, which must match the one the segment
+ * was created with. It must have been successfully \ref stateM_validate()
+ * "validated".
+ *
+ * \returns the shared state machines, which must be closed with
+ * stateM_closeShared(), or NULL on error (\c errno is set, to \c EINVAL if
+ * the definitions differ).
+ */
+struct sharedStateMachines *stateM_openShared( const char *name,
+      struct stateMachineDefinition *definition );
+
+/**
+ * \brief Map a shared-memory segment from a file descriptor
+ *
+ * Works like stateM_openShared(). The file descriptor is duplicated.
+ *
+ * \param fd the segment's file descriptor.
+ * \param definition the definition.
+ */
+struct sharedStateMachines *stateM_mapShared( int fd,
+      struct stateMachineDefinition *definition );
+
+/**
+ * \brief Unmap a shared-memory segment
+ *
+ * The segment itself is destroyed once all processes have closed it (and
+ * a named segment has been removed with shm_unlink()).
+ *
+ * \param shared the shared state machines. May be NULL.
+ */
+void stateM_closeShared( struct sharedStateMachines *shared );
+
+/**
+ * \brief Pass an event to a shared state machine instance
+ *
+ * Waits until no other process is handling an event for the instance, and
+ * then works like stateM_handleEvent(). Events posted by actions are
+ * handled before this function returns. Readers see the instance change
+ * state atomically when the event has been handled.
+ *
+ * If the process handling an event for the instance no longer exists (it
+ * crashed, for instance), the instance is taken over and the event is
+ * handled from the state the instance was in before the dead process
+ * started saving it. Actions the dead process ran are not undone.
+ * Processes are identified by their ID, so all processes sharing the
+ * segment must be in the same PID namespace.
+ *
+ * \param shared the shared state machines.
+ * \param instance the index of the instance.
+ * \param event the event.
+ *
+ * \returns #stateM_errArg if an argument is invalid, otherwise the value
+ * stateM_handleEvent() returns.
+ */
+int stateM_handleSharedEvent( struct sharedStateMachines *shared,
+      size_t instance, struct event *event );
+
+/**
+ * \brief Get the current state of a shared state machine instance
+ *
+ * This function never blocks the process handling an event, and never
+ * observes an instance in the middle of a transition. It does not wait
+ * for the process handling an event either, so a process that died while
+ * saving the instance cannot block it.
+ *
+ * \param shared the shared state machines.
+ * \param instance the index of the instance.
+ * \param previousState if non-NULL, set to the previous state.
+ *
+ * \returns the current state, or NULL if an argument is invalid.
+ */
+struct state *stateM_sharedState( struct sharedStateMachines *shared,
+      size_t instance, struct state **previousState );
+
+#endif // STATEMACHINE_SHARED_H
+
+/**
+ * @}
+ */
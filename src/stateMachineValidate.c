@@ -0,0 +1,434 @@
+/* 
+ * Copyright (c) 2013 Andreas Misje
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#include "stateMachine.h"
+#include <stdint.h>
+#include <stdlib.h>
+
+/* A state and its index in the definition's states array. An array of these,
+ * sorted by address, is used to look up states: */
+struct stateIndex
+{
+   uintptr_t address;
+   size_t index;
+};
+
+struct validation
+{
+   struct stateMachineDefinition *definition;
+   void ( *report )( enum stateM_definitionErrors error, struct state *state,
+         struct transition *transition, void *userData );
+   void *userData;
+   int numErrors;
+   /* Set if states are missing or if there are cycles, in which case the
+    * states cannot be traversed safely: */
+   bool malformed;
+   struct stateIndex *index;
+   /* States that may be active, either as the current state or as a parent
+    * of the current state: */
+   bool *reachable;
+   /* States that are the target of a transition (or entry state, region
+    * etc.) and whose entry states have been followed: */
+   bool *entered;
+   /* States waiting to be entered: */
+   struct state **targets;
+   size_t numTargets;
+   /* Reachable states whose transitions have not yet been followed: */
+   size_t *pending;
+   size_t numPending;
+};
+
+static int compareStateIndices( const void *a, const void *b );
+static bool findState( struct validation *validation, struct state *state,
+      size_t *index );
+static void reportError( struct validation *validation,
+      enum stateM_definitionErrors error, struct state *state,
+      struct transition *transition );
+static void checkReferences( struct validation *validation,
+      struct state *state );
+static void checkChains( struct validation *validation, struct state *state );
+static void checkTransitions( struct validation *validation,
+      struct state *state );
+static bool isUnguarded( struct transition *transition );
+static void checkRegions( struct validation *validation,
+      struct state *state );
+static void checkHistory( struct validation *validation, size_t index );
+static void findReachableStates( struct validation *validation );
+
+int stateM_validate( struct stateMachineDefinition *definition,
+      void ( *report )( enum stateM_definitionErrors error,
+         struct state *state, struct transition *transition,
+         void *userData ), void *userData )
+{
+   if ( !definition || ( definition->numStates && !definition->states ) )
+      return -1;
+
+   struct validation validation = {
+      .definition = definition,
+      .report = report,
+      .userData = userData,
+   };
+   size_t numStates = definition->numStates;
+   size_t maxTargets = 2 + numStates;
+   size_t i;
+
+   for ( i = 0; i < numStates; ++i )
+      maxTargets += definition->states[ i ]->numTransitions + 2 *
+         definition->states[ i ]->numRegions;
+
+   validation.index = malloc( ( numStates + 1 ) * sizeof(
+            *validation.index ) );
+   validation.reachable = calloc( numStates + 1, sizeof(
+            *validation.reachable ) );
+   validation.entered = calloc( numStates + 1, sizeof(
+            *validation.entered ) );
+   validation.targets = malloc( maxTargets * sizeof(
+            *validation.targets ) );
+   validation.pending = malloc( ( numStates + 1 ) * sizeof(
+            *validation.pending ) );
+
+   if ( !validation.index || !validation.reachable || !validation.entered ||
+         !validation.targets || !validation.pending )
+   {
+      validation.numErrors = -1;
+      goto cleanup;
+   }
+
+   definition->verified = false;
+
+   for ( i = 0; i < numStates; ++i )
+   {
+      validation.index[ i ].address = (uintptr_t)definition->states[ i ];
+      validation.index[ i ].index = i;
+   }
+   qsort( validation.index, numStates, sizeof( *validation.index ),
+         &compareStateIndices );
+
+   if ( !definition->initialState || !definition->errorState )
+      reportError( &validation, stateM_missingState, NULL, NULL );
+
+   if ( definition->initialState && !findState( &validation,
+            definition->initialState, NULL ) )
+      reportError( &validation, stateM_unknownState,
+            definition->initialState, NULL );
+
+   if ( definition->errorState && !findState( &validation,
+            definition->errorState, NULL ) )
+      reportError( &validation, stateM_unknownState, definition->errorState,
+            NULL );
+
+   for ( i = 0; i < numStates; ++i )
+   {
+      struct state *state = definition->states[ i ];
+
+      checkReferences( &validation, state );
+      checkChains( &validation, state );
+      checkTransitions( &validation, state );
+      checkRegions( &validation, state );
+      checkHistory( &validation, i );
+   }
+
+   /* Looking for unreachable states only makes sense if the states form a
+    * proper hierarchy: */
+   if ( !validation.malformed && definition->initialState &&
+         definition->errorState )
+   {
+      findReachableStates( &validation );
+
+      for ( i = 0; i < numStates; ++i )
+      {
+         struct state *state = definition->states[ i ];
+
+         if ( !validation.reachable[ i ] && state != definition->errorState )
+            reportError( &validation, stateM_unreachableState, state, NULL );
+      }
+   }
+
+   definition->verified = !validation.numErrors;
+
+cleanup:
+   free( validation.index );
+   free( validation.reachable );
+   free( validation.entered );
+   free( validation.targets );
+   free( validation.pending );
+
+   return validation.numErrors;
+}
+
+static int compareStateIndices( const void *a, const void *b )
+{
+   uintptr_t addressA = ( (const struct stateIndex *)a )->address;
+   uintptr_t addressB = ( (const struct stateIndex *)b )->address;
+
+   return ( addressA > addressB ) - ( addressA < addressB );
+}
+
+static bool findState( struct validation *validation, struct state *state,
+      size_t *index )
+{
+   struct stateIndex key = { .address = (uintptr_t)state };
+   struct stateIndex *found = bsearch( &key, validation->index,
+         validation->definition->numStates, sizeof( *validation->index ),
+         &compareStateIndices );
+
+   if ( !found )
+      return false;
+
+   if ( index )
+      *index = found->index;
+
+   return true;
+}
+
+static void reportError( struct validation *validation,
+      enum stateM_definitionErrors error, struct state *state,
+      struct transition *transition )
+{
+   ++validation->numErrors;
+
+   if ( error == stateM_missingState || error == stateM_unknownState ||
+         error == stateM_entryStateCycle || error == stateM_parentStateCycle )
+      validation->malformed = true;
+
+   if ( validation->report )
+      validation->report( error, state, transition, validation->userData );
+}
+
+static void checkReferences( struct validation *validation,
+      struct state *state )
+{
+   size_t i;
+
+   if ( state->parentState && !findState( validation, state->parentState,
+            NULL ) )
+      reportError( validation, stateM_unknownState, state, NULL );
+
+   if ( state->entryState && !findState( validation, state->entryState,
+            NULL ) )
+      reportError( validation, stateM_unknownState, state, NULL );
+
+   for ( i = 0; i < state->numRegions; ++i )
+      if ( !findState( validation, state->regions[ i ], NULL ) )
+         reportError( validation, stateM_unknownState, state, NULL );
+
+   for ( i = 0; i < state->numTransitions; ++i )
+   {
+      struct transition *transition = &state->transitions[ i ];
+
+      if ( !transition->nextState )
+         reportError( validation, stateM_nullNextState, state, transition );
+      else if ( !findState( validation, transition->nextState, NULL ) )
+         reportError( validation, stateM_unknownState, state, transition );
+   }
+}
+
+static void checkChains( struct validation *validation, struct state *state )
+{
+   size_t numStates = validation->definition->numStates;
+   struct state *next;
+   size_t steps;
+
+   /* A chain longer than the number of states must contain a cycle (which
+    * may or may not include the state itself. If it does not, the cycle is
+    * reported for the states in it): */
+   for ( next = state->parentState, steps = 0; next && steps <= numStates;
+         next = next->parentState, ++steps )
+   {
+      if ( next == state )
+      {
+         reportError( validation, stateM_parentStateCycle, state, NULL );
+         break;
+      }
+   }
+
+   for ( next = state->entryState, steps = 0; next && steps <= numStates;
+         next = next->entryState, ++steps )
+   {
+      if ( next == state )
+      {
+         reportError( validation, stateM_entryStateCycle, state, NULL );
+         break;
+      }
+   }
+}
+
+static void checkTransitions( struct validation *validation,
+      struct state *state )
+{
+   size_t i, j;
+
+   for ( j = 1; j < state->numTransitions; ++j )
+   {
+      struct transition *transition = &state->transitions[ j ];
+
+      for ( i = 0; i < j; ++i )
+      {
+         struct transition *earlier = &state->transitions[ i ];
+
+         if ( earlier->eventType == transition->eventType && (
+                  isUnguarded( earlier ) || ( earlier->guardKind ==
+                     transition->guardKind && earlier->guard ==
+                     transition->guard && earlier->condition ==
+                     transition->condition ) ) )
+         {
+            reportError( validation, stateM_shadowedTransition, state,
+                  transition );
+            break;
+         }
+      }
+   }
+}
+
+static bool isUnguarded( struct transition *transition )
+{
+   return transition->guardKind == stateM_guardFunction &&
+      !transition->guard;
+}
+
+static void checkRegions( struct validation *validation,
+      struct state *state )
+{
+   size_t numStates = validation->definition->numStates;
+   struct state *parent;
+   size_t i, steps;
+
+   if ( !state->numRegions )
+      return;
+
+   if ( state->numRegions > STATEM_MAX_REGIONS )
+      reportError( validation, stateM_tooManyRegions, state, NULL );
+
+   for ( i = 0; i < state->numRegions; ++i )
+   {
+      /* Unknown regions (including NULL) have already been reported: */
+      if ( !findState( validation, state->regions[ i ], NULL ) )
+         continue;
+
+      if ( state->regions[ i ]->parentState != state )
+      {
+         reportError( validation, stateM_invalidRegion, state, NULL );
+         return;
+      }
+   }
+
+   for ( parent = state->parentState, steps = 0; parent && steps <=
+         numStates; parent = parent->parentState, ++steps )
+   {
+      if ( parent->numRegions )
+      {
+         reportError( validation, stateM_invalidRegion, state, NULL );
+         return;
+      }
+   }
+}
+
+static void checkHistory( struct validation *validation, size_t index )
+{
+   struct state **states = validation->definition->states;
+   struct state *state = states[ index ];
+   size_t i;
+
+   if ( state->historyType != stateM_noHistory && !state->parentState )
+      reportError( validation, stateM_orphanHistoryState, state, NULL );
+
+   if ( !state->historySlot )
+      return;
+
+   if ( state->historySlot > STATEM_HISTORY_SLOTS )
+   {
+      reportError( validation, stateM_invalidHistorySlot, state, NULL );
+      return;
+   }
+
+   for ( i = 0; i < index; ++i )
+   {
+      if ( states[ i ]->historySlot == state->historySlot )
+      {
+         reportError( validation, stateM_invalidHistorySlot, state, NULL );
+         return;
+      }
+   }
+}
+
+static void findReachableStates( struct validation *validation )
+{
+   struct stateMachineDefinition *definition = validation->definition;
+   size_t i;
+
+   validation->targets[ validation->numTargets++ ] =
+      definition->initialState;
+
+   while ( validation->numTargets || validation->numPending )
+   {
+      /* Enter all targets, following entry states and regions. The target
+       * and all its parents may be active: */
+      while ( validation->numTargets )
+      {
+         struct state *state = validation->targets[ --validation->numTargets
+            ];
+         struct state *parent;
+         size_t index;
+
+         findState( validation, state, &index );
+         if ( validation->entered[ index ] )
+            continue;
+
+         validation->entered[ index ] = true;
+
+         for ( parent = state; parent; parent = parent->parentState )
+         {
+            findState( validation, parent, &index );
+            if ( validation->reachable[ index ] )
+               break;
+
+            validation->reachable[ index ] = true;
+            validation->pending[ validation->numPending++ ] = index;
+         }
+
+         if ( state->entryState )
+            validation->targets[ validation->numTargets++ ] =
+               state->entryState;
+
+         for ( i = 0; i < state->numRegions; ++i )
+            validation->targets[ validation->numTargets++ ] =
+               state->regions[ i ];
+      }
+
+      /* Follow the transitions of a state that may be active. If it has
+       * regions, they are all active: */
+      if ( validation->numPending )
+      {
+         struct state *state = definition->states[ validation->pending[
+            --validation->numPending ] ];
+
+         for ( i = 0; i < state->numTransitions; ++i )
+            if ( state->transitions[ i ].nextState )
+               validation->targets[ validation->numTargets++ ] =
+                  state->transitions[ i ].nextState;
+
+         for ( i = 0; i < state->numRegions; ++i )
+            validation->targets[ validation->numTargets++ ] =
+               state->regions[ i ];
+      }
+   }
+}
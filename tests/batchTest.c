@@ -0,0 +1,285 @@
+/* 
+ * Copyright (c) 2013 Andreas Misje
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#include "stateMachine.h"
+#include "stateMachineBatch.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* State machines of two definitions are passed a batch of events in random
+ * order. Every state machine must see its events in the same order as when
+ * they are handled one by one, while the events in a round are handled
+ * grouped by definition and state.
+ */
+
+#define NUM_MACHINES 200
+#define NUM_EVENTS 4000
+
+enum eventTypes
+{
+   Event_toggle,
+   Event_reset,
+   Event_lock,
+   Event_unlock,
+   Event_numTypes,
+};
+
+struct eventData
+{
+   size_t machine;
+   size_t sequence;
+};
+
+static void record( void *currentStateData, struct event *event,
+      void *newStateData );
+
+static struct state even, odd, closed, open, locked, errorState;
+
+static struct state
+
+even =
+{
+   .transitions = (struct transition[]) {
+      { Event_toggle, NULL, NULL, &record, &odd },
+   },
+   .numTransitions = 1,
+   .data = "even",
+},
+
+   odd =
+{
+   .transitions = (struct transition[]) {
+      { Event_toggle, NULL, NULL, &record, &even },
+      { Event_reset, NULL, NULL, &record, &even },
+   },
+   .numTransitions = 2,
+   .data = "odd",
+},
+
+   closed =
+{
+   .transitions = (struct transition[]) {
+      { Event_toggle, NULL, NULL, &record, &open },
+      { Event_lock, NULL, NULL, &record, &locked },
+   },
+   .numTransitions = 2,
+   .data = "closed",
+},
+
+   open =
+{
+   .transitions = (struct transition[]) {
+      { Event_toggle, NULL, NULL, &record, &closed },
+   },
+   .numTransitions = 1,
+   .data = "open",
+},
+
+   locked =
+{
+   .transitions = (struct transition[]) {
+      { Event_unlock, NULL, NULL, &record, &closed },
+   },
+   .numTransitions = 1,
+   .data = "locked",
+},
+
+   errorState =
+{
+   .data = "error",
+};
+
+static struct stateMachineDefinition counter = {
+   .states = (struct state *[]){ &even, &odd, &errorState },
+   .numStates = 3,
+   .initialState = &even,
+   .errorState = &errorState,
+};
+
+static struct stateMachineDefinition door = {
+   .states = (struct state *[]){ &closed, &open, &locked, &errorState },
+   .numStates = 4,
+   .initialState = &closed,
+   .errorState = &errorState,
+};
+
+/* The events every state machine has seen, one log for handling the
+ * events one by one and one for handling them in a batch: */
+static size_t logs[ 2 ][ NUM_MACHINES ][ NUM_EVENTS ];
+static size_t logLengths[ 2 ][ NUM_MACHINES ];
+static int currentLog;
+
+/* The states the batch's events were handled in, in order: */
+static const char *handledIn[ NUM_EVENTS ];
+static size_t numHandled;
+
+static void record( void *currentStateData, struct event *event,
+      void *newStateData )
+{
+   struct eventData *data = event->data;
+
+   logs[ currentLog ][ data->machine ][ logLengths[ currentLog ][
+      data->machine ]++ ] = data->sequence;
+   handledIn[ numHandled++ ] = currentStateData;
+}
+
+static void initMachines( struct stateMachine *machines )
+{
+   size_t i;
+
+   for ( i = 0; i < NUM_MACHINES; ++i )
+      stateM_initWithDefinition( &machines[ i ], i % 2 ? &door : &counter );
+}
+
+static void testOrder( void )
+{
+   static struct stateMachine sequential[ NUM_MACHINES ],
+                              batched[ NUM_MACHINES ];
+   static struct eventData data[ NUM_EVENTS ];
+   static struct batchEntry batch[ NUM_EVENTS ];
+   static int results[ NUM_EVENTS ];
+   unsigned random = 1;
+   size_t i;
+
+   initMachines( sequential );
+   initMachines( batched );
+
+   for ( i = 0; i < NUM_EVENTS; ++i )
+   {
+      random = random * 1103515245 + 12345;
+      data[ i ] = (struct eventData){ random / 65536 % NUM_MACHINES, i };
+      batch[ i ] = (struct batchEntry){ &batched[ data[ i ].machine ],
+         { (int)( random / 16 % Event_numTypes ), &data[ i ] }, -1 };
+   }
+
+   currentLog = 0;
+   for ( i = 0; i < NUM_EVENTS; ++i )
+      results[ i ] = stateM_handleEvent( &sequential[ data[ i ].machine ],
+            &batch[ i ].event );
+
+   currentLog = 1;
+   numHandled = 0;
+   if ( !stateM_dispatchBatch( batch, NUM_EVENTS ) )
+   {
+      fputs( "Could not dispatch batch\n", stderr );
+      exit( 2 );
+   }
+
+   for ( i = 0; i < NUM_MACHINES; ++i )
+      if ( stateM_currentState( &sequential[ i ] ) != stateM_currentState(
+               &batched[ i ] ) || logLengths[ 0 ][ i ] != logLengths[ 1 ][ i ]
+            || memcmp( logs[ 0 ][ i ], logs[ 1 ][ i ], logLengths[ 0 ][ i ] *
+               sizeof( logs[ 0 ][ i ][ 0 ] ) ) )
+      {
+         fprintf( stderr, "State machine %zu saw its events out of order\n",
+               i );
+         exit( 3 );
+      }
+
+   for ( i = 0; i < NUM_EVENTS; ++i )
+      if ( batch[ i ].result != results[ i ] )
+      {
+         fprintf( stderr, "Event %zu returned %d instead of %d\n", i,
+               batch[ i ].result, results[ i ] );
+         exit( 4 );
+      }
+
+   puts( "Every state machine saw its events in order" );
+}
+
+static void testGrouping( void )
+{
+   static struct stateMachine machines[ NUM_MACHINES ];
+   static struct eventData data[ NUM_MACHINES ];
+   static struct batchEntry batch[ NUM_MACHINES ];
+   size_t i, j;
+
+   initMachines( machines );
+
+   /* Mix the states up: */
+   currentLog = 0;
+   for ( i = 0; i < NUM_MACHINES; i += 3 )
+      stateM_handleEvent( &machines[ i ], &(struct event){ Event_toggle,
+            &(struct eventData){ i, 0 } } );
+
+   /* A single round, with the state machines interleaved: */
+   for ( i = 0; i < NUM_MACHINES; ++i )
+   {
+      size_t machine = i * 7 % NUM_MACHINES;
+
+      data[ i ] = (struct eventData){ machine, 1 };
+      batch[ i ] = (struct batchEntry){ &machines[ machine ], {
+         Event_toggle, &data[ i ] }, -1 };
+   }
+
+   numHandled = 0;
+   if ( !stateM_dispatchBatch( batch, NUM_MACHINES ) ||
+         numHandled != NUM_MACHINES )
+   {
+      fputs( "Could not dispatch batch\n", stderr );
+      exit( 5 );
+   }
+
+   /* Every state's events must have been handled together, and the
+    * counter's states before or after the door's: */
+   for ( i = 1; i < numHandled; ++i )
+      for ( j = 0; j + 1 < i; ++j )
+         if ( handledIn[ j ] == handledIn[ i ] && handledIn[ j + 1 ] !=
+               handledIn[ i ] )
+         {
+            fprintf( stderr, "Events in state '%s' not grouped\n",
+                  handledIn[ i ] );
+            exit( 6 );
+         }
+
+   bool counterFirst = handledIn[ 0 ] == even.data || handledIn[ 0 ] ==
+      odd.data;
+   for ( i = 0; i < numHandled; ++i )
+   {
+      bool isCounter = handledIn[ i ] == even.data || handledIn[ i ] ==
+         odd.data;
+      bool inFirstHalf = i < NUM_MACHINES / 2;
+
+      if ( isCounter != ( inFirstHalf == counterFirst ) )
+      {
+         fputs( "Definitions not grouped\n", stderr );
+         exit( 7 );
+      }
+   }
+
+   puts( "Events grouped by definition and state" );
+}
+
+int main()
+{
+   testOrder();
+   testGrouping();
+
+   if ( stateM_dispatchBatch( NULL, 1 ) || !stateM_dispatchBatch( NULL, 0 ) )
+   {
+      fputs( "Unexpected result for an empty batch\n", stderr );
+      exit( 8 );
+   }
+
+   return 0;
+}
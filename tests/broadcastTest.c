@@ -0,0 +1,171 @@
+/* 
+ * Copyright (c) 2013 Andreas Misje
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#include "stateMachine.h"
+#include "stateMachineBroadcast.h"
+#include "stateMachineCompile.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+/* A group of sessions receives timer ticks. Only sessions waiting for a
+ * reply handle ticks (they time out after two), so the ticks must only be
+ * passed to them. Sessions move between the per-state lists as they change
+ * state.
+ */
+
+#define NUM_SESSIONS 1000
+
+enum eventTypes
+{
+   Event_tick,
+   Event_request,
+   Event_reply,
+   Event_fail,
+};
+
+static size_t numTicksHandled;
+
+static void countTick( void *currentStateData, struct event *event,
+      void *newStateData )
+{
+   ++numTicksHandled;
+}
+
+static struct state idle, waiting, waitingLong, errorState;
+
+static struct state
+
+idle =
+{
+   .transitions = (struct transition[]) {
+      { Event_request, NULL, NULL, NULL, &waiting },
+      { Event_fail, NULL, NULL, NULL, &errorState },
+   },
+   .numTransitions = 2,
+},
+
+   waiting =
+{
+   .transitions = (struct transition[]) {
+      { Event_tick, NULL, NULL, &countTick, &waitingLong },
+      { Event_reply, NULL, NULL, NULL, &idle },
+   },
+   .numTransitions = 2,
+},
+
+   waitingLong =
+{
+   .transitions = (struct transition[]) {
+      { Event_tick, NULL, NULL, &countTick, &idle },
+      { Event_reply, NULL, NULL, NULL, &idle },
+   },
+   .numTransitions = 2,
+},
+
+   errorState =
+{
+   .data = "error",
+};
+
+int main()
+{
+   struct stateMachineDefinition definition = {
+      .states = (struct state *[]){ &idle, &waiting, &waitingLong,
+         &errorState },
+      .numStates = 4,
+      .initialState = &idle,
+      .errorState = &errorState,
+   };
+   static struct stateMachine sessions[ NUM_SESSIONS ];
+   struct compiledStateMachine *compiled;
+   struct stateMachineGroup *group;
+   size_t n;
+
+   stateM_validate( &definition, NULL, NULL );
+   compiled = stateM_compile( &definition );
+   group = stateM_createGroup( compiled );
+   if ( !compiled || !group )
+   {
+      fputs( "Could not create group\n", stderr );
+      exit( 1 );
+   }
+
+   for ( n = 0; n < NUM_SESSIONS; ++n )
+   {
+      stateM_initCompiled( &sessions[ n ], compiled );
+      stateM_groupAdd( group, &sessions[ n ] );
+   }
+
+   /* Every tenth session sends a request: */
+   for ( n = 0; n < NUM_SESSIONS; n += 10 )
+      stateM_handleEvent( &sessions[ n ], &(struct event){ Event_request,
+            NULL } );
+
+   if ( stateM_broadcastEvent( group, &(struct event){ Event_tick, NULL } )
+         != NUM_SESSIONS / 10 || numTicksHandled != NUM_SESSIONS / 10 )
+   {
+      fputs( "Tick not passed to waiting sessions only\n", stderr );
+      exit( 2 );
+   }
+
+   /* Half of the waiting sessions get a reply, and one idle session
+    * fails: */
+   for ( n = 0; n < NUM_SESSIONS; n += 20 )
+      stateM_handleEvent( &sessions[ n ], &(struct event){ Event_reply,
+            NULL } );
+   stateM_handleEvent( &sessions[ 1 ], &(struct event){ Event_fail, NULL } );
+   if ( stateM_currentState( &sessions[ 1 ] ) != &errorState )
+   {
+      fputs( "Expected the error state\n", stderr );
+      exit( 3 );
+   }
+
+   numTicksHandled = 0;
+   if ( stateM_broadcastEvent( group, &(struct event){ Event_tick, NULL } )
+         != NUM_SESSIONS / 20 || numTicksHandled != NUM_SESSIONS / 20 )
+   {
+      fputs( "Tick not passed to remaining waiting sessions\n", stderr );
+      exit( 4 );
+   }
+
+   /* Every session is idle (or failed) now: */
+   if ( stateM_broadcastEvent( group, &(struct event){ Event_tick, NULL } ) )
+   {
+      fputs( "Tick passed to idle sessions\n", stderr );
+      exit( 5 );
+   }
+   puts( "Ticks only passed to waiting sessions" );
+
+   stateM_freeGroup( group );
+   for ( n = 0; n < NUM_SESSIONS; ++n )
+   {
+      if ( sessions[ n ].group )
+      {
+         fputs( "Session still in freed group\n", stderr );
+         exit( 6 );
+      }
+   }
+
+   stateM_freeCompiled( compiled );
+
+   return 0;
+}
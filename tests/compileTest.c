@@ -0,0 +1,616 @@
+/* 
+ * Copyright (c) 2013 Andreas Misje
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#include "stateMachine.h"
+#include "stateMachineCompile.h"
+#include <limits.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+/* This test runs the state machine from stateMachineExample.c (extended with
+ * a 'tick' event) both compiled and uncompiled, and checks that both
+ * behave identically. It also checks that unguarded transitions are found
+ * without calling any guards, and that common ancestors are found from the
+ * compiled ancestor arrays.
+ *
+ * A second state machine classifies bytes using declarative guards (and a
+ * guard function) and is checked in the same way for all byte values and
+ * a few values outside the byte range.
+ *
+ * A third state machine handles sparse protocol opcodes, which have to be
+ * remapped to dense event ids through a hash rather than a direct table.
+ *
+ * A method dispatcher with thousands of event types, each handled by a
+ * single state, is compiled into a perfect hash instead of a mostly empty
+ * event table.
+ *
+ * Finally, thousands of random 31-bit event types must be remapped through
+ * a hash whose size grows linearly with the number of event types.
+ */
+
+enum eventTypes
+{
+   Event_keyboard,
+   Event_tick,
+};
+
+static bool compareKeyboardChar( void *ch, struct event *event );
+
+static struct state group, idle, h, i, a, errorState;
+
+static struct state
+
+group =
+{
+   .entryState = &idle,
+   .transitions = (struct transition[]) {
+      { Event_keyboard, (void *)(intptr_t)'!', &compareKeyboardChar, NULL,
+         &idle },
+      { Event_keyboard, NULL, NULL, NULL, &idle },
+      /* Shadowed by the previous transition: */
+      { Event_keyboard, (void *)(intptr_t)'?', &compareKeyboardChar, NULL,
+         &h },
+      { Event_tick, NULL, NULL, NULL, &idle },
+   },
+   .numTransitions = 4,
+},
+
+   idle =
+{
+   .parentState = &group,
+   .transitions = (struct transition[]) {
+      { Event_keyboard, (void *)(intptr_t)'h', &compareKeyboardChar, NULL,
+         &h },
+   },
+   .numTransitions = 1,
+},
+
+   h =
+{
+   .parentState = &group,
+   .transitions = (struct transition[]) {
+      { Event_keyboard, (void *)(intptr_t)'a', &compareKeyboardChar, NULL,
+         &a },
+      { Event_keyboard, (void *)(intptr_t)'i', &compareKeyboardChar, NULL,
+         &i },
+   },
+   .numTransitions = 2,
+},
+
+   i =
+{
+   .parentState = &group,
+   .transitions = (struct transition[]) {
+      { Event_keyboard, (void *)(intptr_t)'\n', &compareKeyboardChar, NULL,
+         &idle },
+   },
+   .numTransitions = 1,
+},
+
+   a =
+{
+   .parentState = &group,
+   .transitions = (struct transition[]) {
+      { Event_keyboard, (void *)(intptr_t)'\n', &compareKeyboardChar, NULL,
+         &idle },
+   },
+   .numTransitions = 1,
+},
+
+   errorState =
+{
+   .data = "error",
+};
+
+static struct guardSet hexLetters = { .members = {
+   /* 'A'-'F' and 'a'-'f': */
+   [ 'A' / 8 ] = 0x7e, [ 'a' / 8 ] = 0x7e } };
+
+static bool isSpace( void *condition, struct event *event );
+
+static struct state classify, digit, hex, colon, space, other;
+
+static struct transition classifyTransitions[] = {
+   { Event_keyboard, &(struct guardRange){ '0', '9' }, NULL, NULL, &digit,
+      stateM_guardRange },
+   { Event_keyboard, &hexLetters, NULL, NULL, &hex, stateM_guardSet },
+   /* Overlaps the previous range. Only '8' and '9' are taken by this one: */
+   { Event_keyboard, &(struct guardRange){ '8', 'F' }, NULL, NULL, &colon,
+      stateM_guardRange },
+   { Event_keyboard, (void *)(intptr_t)':', NULL, NULL, &colon,
+      stateM_guardEquals },
+   { Event_keyboard, (void *)(intptr_t)1000, NULL, NULL, &colon,
+      stateM_guardEquals },
+   { Event_keyboard, NULL, &isSpace, NULL, &space },
+   { Event_keyboard, &(struct guardRange){ -5, -1 }, NULL, NULL, &space,
+      stateM_guardRange },
+   { Event_keyboard, NULL, NULL, NULL, &other },
+};
+
+static struct state
+
+classify =
+{
+   .transitions = classifyTransitions,
+   .numTransitions = sizeof( classifyTransitions ) / sizeof(
+         classifyTransitions[ 0 ] ),
+},
+
+   digit =
+{
+   .parentState = &classify,
+},
+
+   hex =
+{
+   .parentState = &classify,
+},
+
+   colon =
+{
+   .parentState = &classify,
+},
+
+   space =
+{
+   .parentState = &classify,
+},
+
+   other =
+{
+   .parentState = &classify,
+};
+
+enum opcodes
+{
+   Opcode_close = -7,
+   Opcode_hello = 0x10,
+   Opcode_data = 0x1234,
+   Opcode_ping = 0xFFFF,
+};
+
+static struct state listening, connected, closed;
+
+static struct state
+
+listening =
+{
+   .transitions = (struct transition[]) {
+      { Opcode_hello, NULL, NULL, NULL, &connected },
+      { Opcode_close, NULL, NULL, NULL, &closed },
+   },
+   .numTransitions = 2,
+},
+
+   connected =
+{
+   .transitions = (struct transition[]) {
+      { Opcode_data, NULL, NULL, NULL, &connected },
+      { Opcode_ping, NULL, NULL, NULL, &connected },
+      { Opcode_close, NULL, NULL, NULL, &closed },
+   },
+   .numTransitions = 3,
+},
+
+   closed =
+{
+   .transitions = (struct transition[]) {
+      { Opcode_hello, NULL, NULL, NULL, &listening },
+   },
+   .numTransitions = 1,
+};
+
+static size_t numGuardCalls;
+
+static void testClassTable( void )
+{
+   struct stateMachineDefinition definition = {
+      .states = (struct state *[]){ &classify, &digit, &hex, &colon, &space,
+         &other, &errorState },
+      .numStates = 7,
+      .initialState = &classify,
+      .errorState = &errorState,
+   };
+   struct compiledStateMachine *compiled;
+   struct stateMachine plain, fast;
+   intptr_t value;
+
+   if ( stateM_validate( &definition, NULL, NULL ) || !( compiled =
+            stateM_compile( &definition ) ) )
+   {
+      fputs( "Could not compile byte classifier\n", stderr );
+      exit( 6 );
+   }
+
+   if ( compiled->states[ classify.id ].events[ 0 ].numTabled != 5 )
+   {
+      fputs( "Expected a class table for five guards\n", stderr );
+      exit( 7 );
+   }
+
+   for ( value = -10; value < 1010; ++value )
+   {
+      struct event event = { Event_keyboard, (void *)value };
+
+      stateM_init( &plain, &classify, &errorState );
+      stateM_initCompiled( &fast, compiled );
+
+      stateM_handleEvent( &plain, &event );
+      stateM_handleEvent( &fast, &event );
+
+      if ( stateM_currentState( &plain ) != stateM_currentState( &fast ) )
+      {
+         fprintf( stderr, "Value %d classified differently when compiled\n",
+               (int)value );
+         exit( 8 );
+      }
+   }
+
+   stateM_freeCompiled( compiled );
+   puts( "Class table classifies like guards" );
+}
+
+static void testSparseOpcodes( void )
+{
+   struct stateMachineDefinition definition = {
+      .states = (struct state *[]){ &listening, &connected, &closed,
+         &errorState },
+      .numStates = 4,
+      .initialState = &listening,
+      .errorState = &errorState,
+   };
+   static const int opcodes[] = { Opcode_close, Opcode_hello, Opcode_data,
+      Opcode_ping };
+   static const int unused[] = { 0, -8, Opcode_hello + 1, Opcode_data - 1,
+      Opcode_ping + 1, INT_MIN, INT_MAX };
+   static const int sequence[] = { Opcode_data, Opcode_hello, 0, Opcode_data,
+      Opcode_hello, Opcode_ping, Opcode_close, Opcode_ping, Opcode_hello,
+      INT_MIN, Opcode_close, Opcode_hello, Opcode_close };
+   struct compiledStateMachine *compiled;
+   struct stateMachine plain, fast;
+   size_t j;
+
+   if ( stateM_validate( &definition, NULL, NULL ) || !( compiled =
+            stateM_compile( &definition ) ) )
+   {
+      fputs( "Could not compile opcode handler\n", stderr );
+      exit( 10 );
+   }
+
+   bool remapped = compiled->numEventTypes == 4 && compiled->eventIdSeeds;
+   for ( j = 0; j < 4; ++j )
+      remapped = remapped && stateM_compiledEventId( compiled, opcodes[ j ] )
+         == j;
+   for ( j = 0; j < sizeof( unused ) / sizeof( unused[ 0 ] ); ++j )
+      remapped = remapped && stateM_compiledEventId( compiled, unused[ j ] )
+         == STATEM_NO_EVENT_ID;
+   if ( !remapped )
+   {
+      fputs( "Opcodes not remapped to dense ids\n", stderr );
+      exit( 11 );
+   }
+
+   stateM_init( &plain, &listening, &errorState );
+   stateM_initCompiled( &fast, compiled );
+   for ( j = 0; j < sizeof( sequence ) / sizeof( sequence[ 0 ] ); ++j )
+   {
+      struct event event = { sequence[ j ], NULL };
+
+      if ( stateM_handleEvent( &plain, &event ) != stateM_handleEvent( &fast,
+               &event ) || stateM_currentState( &plain ) !=
+            stateM_currentState( &fast ) )
+      {
+         fprintf( stderr, "Opcode %d handled differently when compiled\n",
+               sequence[ j ] );
+         exit( 12 );
+      }
+   }
+
+   stateM_freeCompiled( compiled );
+   puts( "Sparse opcodes remapped to dense ids" );
+}
+
+static void testPerfectHash( void )
+{
+   enum { numSessions = 30, numMethods = 3000, numCommon = 3 };
+   struct state *states[ numSessions + 2 ];
+   struct state *dispatcher = calloc( numSessions + 1, sizeof( *dispatcher ) );
+   struct transition *transitions = calloc( numMethods + numCommon, sizeof(
+            *transitions ) );
+   struct stateMachineDefinition definition = {
+      .states = states,
+      .numStates = numSessions + 2,
+      .initialState = &dispatcher[ 1 ],
+      .errorState = &errorState,
+   };
+   struct compiledStateMachine *compiled;
+   struct stateMachine plain, fast;
+   size_t j;
+
+   if ( !dispatcher || !transitions )
+   {
+      fputs( "Could not allocate method dispatcher\n", stderr );
+      exit( 13 );
+   }
+
+   /* Method 'j' (with a sparse event type) moves session 'j % numSessions'
+    * to the next session. The dispatcher itself handles a few common
+    * methods: */
+   for ( j = 0; j < numMethods; ++j )
+      transitions[ j ] = (struct transition){ .eventType = 1000 + 7 * (int)j,
+         .nextState = &dispatcher[ ( j + 1 ) % numSessions + 1 ] };
+   for ( j = 0; j < numCommon; ++j )
+      transitions[ numMethods + j ] = (struct transition){ .eventType = -1 -
+         (int)j, .nextState = &dispatcher[ j + 1 ] };
+
+   dispatcher[ 0 ].transitions = &transitions[ numMethods ];
+   dispatcher[ 0 ].numTransitions = numCommon;
+   states[ 0 ] = &dispatcher[ 0 ];
+   for ( j = 0; j < numSessions; ++j )
+   {
+      struct state *session = &dispatcher[ j + 1 ];
+      size_t k;
+
+      session->parentState = &dispatcher[ 0 ];
+      session->transitions = malloc( numMethods / numSessions * sizeof(
+               *session->transitions ) );
+      if ( !session->transitions )
+      {
+         fputs( "Could not allocate method dispatcher\n", stderr );
+         exit( 13 );
+      }
+
+      for ( k = 0; k < numMethods / numSessions; ++k )
+         session->transitions[ k ] = transitions[ k * numSessions + j ];
+      session->numTransitions = numMethods / numSessions;
+      states[ j + 1 ] = session;
+   }
+   states[ numSessions + 1 ] = &errorState;
+
+   if ( stateM_validate( &definition, NULL, NULL ) || !( compiled =
+            stateM_compile( &definition ) ) )
+   {
+      fputs( "Could not compile method dispatcher\n", stderr );
+      exit( 13 );
+   }
+
+   if ( compiled->eventTable || !compiled->eventSlots ||
+         compiled->numEventSlots != numMethods + numCommon )
+   {
+      fputs( "Expected a perfect hash for the method dispatcher\n", stderr );
+      exit( 14 );
+   }
+
+   /* Send every method to every session, as well as unused event types: */
+   stateM_init( &plain, &dispatcher[ 1 ], &errorState );
+   stateM_initCompiled( &fast, compiled );
+   for ( j = 0; j < 4 * ( numMethods + numCommon ); ++j )
+   {
+      int type = (int)( j * 2654435761u % ( 7 * numMethods + 1100 ) ) - 50;
+      struct event event = { type, NULL };
+
+      if ( stateM_handleEvent( &plain, &event ) != stateM_handleEvent( &fast,
+               &event ) || stateM_currentState( &plain ) !=
+            stateM_currentState( &fast ) )
+      {
+         fprintf( stderr, "Method %d dispatched differently when compiled\n",
+               type );
+         exit( 15 );
+      }
+   }
+
+   stateM_freeCompiled( compiled );
+   for ( j = 0; j < numSessions; ++j )
+      free( dispatcher[ j + 1 ].transitions );
+   free( transitions );
+   free( dispatcher );
+   puts( "Perfect hash dispatches like transition arrays" );
+}
+
+static void testRandomEventTypes( void )
+{
+   enum { numTypes = 10000 };
+   struct state toggle[ 2 ] = { { 0 } };
+   struct transition *transitions = calloc( 2 * numTypes, sizeof(
+            *transitions ) );
+   struct stateMachineDefinition definition = {
+      .states = (struct state *[]){ &toggle[ 0 ], &toggle[ 1 ], &errorState },
+      .numStates = 3,
+      .initialState = &toggle[ 0 ],
+      .errorState = &errorState,
+   };
+   struct compiledStateMachine *compiled;
+   struct stateMachine plain, fast;
+   uint32_t random = 12345;
+   size_t j;
+
+   if ( !transitions )
+   {
+      fputs( "Could not allocate random event types\n", stderr );
+      exit( 16 );
+   }
+
+   /* Both states toggle to the other on any of the event types, which may
+    * repeat: */
+   for ( j = 0; j < numTypes; ++j )
+   {
+      random = random * 1103515245u + 12345u;
+      int type = (int)( random & 0x7fffffff );
+
+      transitions[ j ] = (struct transition){ .eventType = type,
+         .nextState = &toggle[ 1 ] };
+      transitions[ numTypes + j ] = (struct transition){ .eventType = type,
+         .nextState = &toggle[ 0 ] };
+   }
+   toggle[ 0 ].transitions = transitions;
+   toggle[ 0 ].numTransitions = numTypes;
+   toggle[ 1 ].transitions = &transitions[ numTypes ];
+   toggle[ 1 ].numTransitions = numTypes;
+
+   stateM_validate( &definition, NULL, NULL );
+   /* Repeated event types only shadow each other: */
+   definition.verified = true;
+   if ( !( compiled = stateM_compile( &definition ) ) )
+   {
+      fputs( "Could not compile random event types\n", stderr );
+      exit( 16 );
+   }
+
+   bool remapped = compiled->eventIdSeeds && compiled->numEventIdSlots +
+      compiled->numEventIdSeeds <= 2 * compiled->numEventTypes;
+   for ( j = 0; j < compiled->numEventTypes; ++j )
+      remapped = remapped && stateM_compiledEventId( compiled,
+            compiled->eventTypes[ j ] ) == j;
+   if ( !remapped )
+   {
+      fprintf( stderr, "Unexpected event id hash size: %zu slots and %zu "
+            "seeds for %zu event types\n", compiled->numEventIdSlots,
+            compiled->numEventIdSeeds, compiled->numEventTypes );
+      exit( 17 );
+   }
+
+   /* Used and (most likely) unused event types: */
+   stateM_init( &plain, &toggle[ 0 ], &errorState );
+   stateM_initCompiled( &fast, compiled );
+   for ( j = 0; j < 2 * numTypes; ++j )
+   {
+      struct event event = { j % 2 ? transitions[ j / 2 ].eventType : (int)(
+               j * 2654435761u & 0x7fffffff ), NULL };
+
+      if ( stateM_handleEvent( &plain, &event ) != stateM_handleEvent( &fast,
+               &event ) || stateM_currentState( &plain ) !=
+            stateM_currentState( &fast ) )
+      {
+         fprintf( stderr, "Event type %d handled differently when "
+               "compiled\n", event.type );
+         exit( 18 );
+      }
+   }
+
+   stateM_freeCompiled( compiled );
+   free( transitions );
+   puts( "Random event types hashed in linear space" );
+}
+
+int main()
+{
+   struct stateMachineDefinition definition = {
+      .states = (struct state *[]){ &group, &idle, &h, &i, &a, &errorState },
+      .numStates = 6,
+      .initialState = &idle,
+      .errorState = &errorState,
+   };
+   struct compiledStateMachine *compiled;
+   struct stateMachine plain, fast;
+   const char *input = "hi\nha\nhx!h!hh?\n";
+   size_t n;
+
+   if ( stateM_validate( &definition, NULL, NULL ) != 1 )
+   {
+      fputs( "Expected the shadowed transition to be reported\n", stderr );
+      exit( 1 );
+   }
+   /* Shadowed transitions are harmless, and are left out when compiled: */
+   definition.verified = true;
+
+   compiled = stateM_compile( &definition );
+   if ( !compiled )
+   {
+      fputs( "Could not compile state machine\n", stderr );
+      exit( 2 );
+   }
+
+   stateM_init( &plain, &idle, &errorState );
+   stateM_initCompiled( &fast, compiled );
+
+   for ( n = 0; input[ n ]; ++n )
+   {
+      struct event event = { Event_keyboard, (void *)(intptr_t)input[ n ] };
+      int plainRes = stateM_handleEvent( &plain, &event );
+      int fastRes = stateM_handleEvent( &fast, &event );
+
+      if ( plainRes != fastRes || stateM_currentState( &plain ) !=
+            stateM_currentState( &fast ) )
+      {
+         fprintf( stderr, "Compiled state machine differs at '%c'\n",
+               input[ n ] );
+         exit( 3 );
+      }
+   }
+   puts( "Compiled state machine behaves identically" );
+
+   /* 'tick' is handled by a single unguarded transition in 'group': */
+   numGuardCalls = 0;
+   if ( stateM_handleEvent( &fast, &(struct event){ Event_tick, NULL } ) ==
+         stateM_noStateChange || numGuardCalls )
+   {
+      fputs( "Unguarded transition called guards\n", stderr );
+      exit( 4 );
+   }
+
+   struct compiledState *compiledGroup = &compiled->states[ group.id ];
+   if ( compiledGroup->numEvents != 2 || compiledGroup->events[ 0 ].numGuarded
+         != 1 || compiledGroup->events[ 0 ].defaultTransition !=
+         &group.transitions[ 1 ] )
+   {
+      fputs( "Unexpected compiled transitions\n", stderr );
+      exit( 5 );
+   }
+   puts( "Unguarded transitions found directly" );
+
+   struct compiledState *compiledH = &compiled->states[ h.id ];
+   if ( compiledH->depth != 1 || compiledH->ancestors[ 0 ] != group.id ||
+         compiledH->ancestors[ 1 ] != h.id ||
+         stateM_compiledCommonAncestor( compiled, &h, &i ) != &group ||
+         stateM_compiledCommonAncestor( compiled, &idle, &group ) != &group ||
+         stateM_compiledCommonAncestor( compiled, &a, &a ) != &a ||
+         stateM_compiledCommonAncestor( compiled, &h, &errorState ) )
+   {
+      fputs( "Unexpected ancestors\n", stderr );
+      exit( 9 );
+   }
+   puts( "Common ancestors found from ancestor arrays" );
+
+   stateM_freeCompiled( compiled );
+
+   testClassTable();
+   testSparseOpcodes();
+   testPerfectHash();
+   testRandomEventTypes();
+
+   return 0;
+}
+
+static bool compareKeyboardChar( void *ch, struct event *event )
+{
+   ++numGuardCalls;
+
+   return (intptr_t)ch == (intptr_t)event->data;
+}
+
+static bool isSpace( void *condition, struct event *event )
+{
+   intptr_t value = (intptr_t)event->data;
+
+   return value == ' ' || value == '\t';
+}
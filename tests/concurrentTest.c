@@ -0,0 +1,183 @@
+/* 
+ * Copyright (c) 2013 Andreas Misje
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#include "stateMachine.h"
+#include "stateMachineConcurrent.h"
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+/* A worker thread cycles a state machine through three states, passing
+ * through an intermediate state on every step, while the main thread reads
+ * its state. Every snapshot must be one of the published (current,
+ * previous) pairs, and the intermediate state must never be seen.
+ */
+
+enum eventTypes
+{
+   Event_tick,
+   Event_stop,
+   Event_step,
+};
+
+static struct concurrentStateMachine fsm;
+static struct state one, two, three, between, done, errorState;
+
+/* Every transition enters 'between' first, which immediately steps to the
+ * next state by posting an event: */
+static void stepOn( void *stateData, struct event *event )
+{
+   stateM_postEvent( &fsm.stateMachine, &(struct event){ Event_step,
+         stateData } );
+}
+
+static bool isTarget( void *target, struct event *event )
+{
+   return event->data == target;
+}
+
+static struct state
+
+one =
+{
+   .transitions = (struct transition[]) {
+      { Event_tick, &two, NULL, NULL, &between },
+      { Event_stop, NULL, NULL, NULL, &done },
+   },
+   .numTransitions = 2,
+},
+
+   two =
+{
+   .transitions = (struct transition[]) {
+      { Event_tick, &three, NULL, NULL, &between },
+   },
+   .numTransitions = 1,
+},
+
+   three =
+{
+   .transitions = (struct transition[]) {
+      { Event_tick, &one, NULL, NULL, &between },
+   },
+   .numTransitions = 1,
+},
+
+   between =
+{
+   .transitions = (struct transition[]) {
+      { Event_step, &one, &isTarget, NULL, &one },
+      { Event_step, &two, &isTarget, NULL, &two },
+      { Event_step, &three, &isTarget, NULL, &three },
+   },
+   .numTransitions = 3,
+   .entryAction = &stepOn,
+},
+
+   done =
+{
+   .data = "done",
+},
+
+   errorState =
+{
+   .data = "error",
+};
+
+static void *work( void *arg )
+{
+   struct state *targets[] = { &two, &three, &one };
+   size_t n;
+
+   for ( n = 0; n < 300000; ++n )
+   {
+      /* 'between' passes its target on through its data: */
+      between.data = targets[ n % 3 ];
+      stateM_handleConcurrentEvent( &fsm, &(struct event){ Event_tick,
+            NULL } );
+   }
+
+   stateM_handleConcurrentEvent( &fsm, &(struct event){ Event_stop, NULL } );
+   return NULL;
+}
+
+int main()
+{
+   struct stateMachineDefinition definition = {
+      .states = (struct state *[]){ &one, &two, &three, &between, &done,
+         &errorState },
+      .numStates = 6,
+      .initialState = &one,
+      .errorState = &errorState,
+   };
+   pthread_t worker;
+   size_t numSamples = 0;
+
+   stateM_initConcurrent( &fsm, &definition );
+
+   if ( pthread_create( &worker, NULL, &work, NULL ) )
+   {
+      fputs( "Could not create thread\n", stderr );
+      exit( 1 );
+   }
+
+   while ( !stateM_concurrentStopped( &fsm ) )
+   {
+      struct state *previous;
+      struct state *current = stateM_concurrentState( &fsm, &previous );
+
+      if ( current == &done )
+         break;
+
+      /* The initial state has no previous state: */
+      if ( !( current == &one && !previous ) && previous != &between )
+      {
+         fputs( "Intermediate state published\n", stderr );
+         exit( 2 );
+      }
+
+      if ( current != &one && current != &two && current != &three )
+      {
+         fputs( "Inconsistent state read\n", stderr );
+         exit( 3 );
+      }
+
+      ++numSamples;
+   }
+
+   pthread_join( worker, NULL );
+
+   if ( stateM_concurrentState( &fsm, NULL ) != &done )
+   {
+      fputs( "Expected the state machine to stop\n", stderr );
+      exit( 4 );
+   }
+
+   if ( !numSamples )
+   {
+      fputs( "No states were read\n", stderr );
+      exit( 5 );
+   }
+   puts( "Only consistent states read while handling events" );
+
+   return 0;
+}
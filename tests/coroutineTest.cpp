@@ -0,0 +1,184 @@
+/* 
+ * Copyright (c) 2013 Andreas Misje
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+
+#include "stateMachineCoroutine.hpp"
+#include <coroutine>
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+
+/* Sessions look up a value in a (pretend) database when they are opened.
+ * The look-up is a coroutine that suspends until the query has completed,
+ * except for cached values. Data arriving in the meantime is held back
+ * until the look-up has completed.
+ */
+
+enum eventTypes
+{
+   Event_open,
+   Event_loaded,
+   Event_data,
+};
+
+struct session
+{
+   struct stateMachine stateMachine;
+   int key;
+   int value;
+   int numDataHandled;
+};
+
+static std::vector<std::coroutine_handle<>> pendingQueries;
+
+struct databaseQuery
+{
+   int key;
+
+   bool await_ready()
+   {
+      /* Key 0 is cached: */
+      return !key;
+   }
+
+   void await_suspend( std::coroutine_handle<> coroutine )
+   {
+      pendingQueries.push_back( coroutine );
+   }
+
+   int await_resume()
+   {
+      return key * 10;
+   }
+};
+
+static stateM::action lookUp( void *stateData, struct event *event )
+{
+   struct session *session = static_cast<struct session *>( event->data );
+   session->value = co_await databaseQuery{ session->key };
+
+   struct event loaded = { Event_loaded, session };
+   stateM_postEvent( &session->stateMachine, &loaded );
+}
+
+static void handleData( void *currentStateData, struct event *event,
+      void *newStateData )
+{
+   ++static_cast<struct session *>( event->data )->numDataHandled;
+}
+
+static struct state idle, loading, loaded;
+
+static struct transition idleTransitions[] = {
+   { Event_open, NULL, NULL, NULL, &loading },
+};
+
+static struct transition loadingTransitions[] = {
+   { Event_loaded, NULL, NULL, NULL, &loaded },
+};
+
+static int loadingDeferredEvents[] = { Event_data };
+
+static struct transition loadedTransitions[] = {
+   { Event_data, NULL, NULL, &handleData, &idle },
+};
+
+static struct state errorState;
+
+static void expectState( struct session *session, struct state *state,
+      bool pending, int exitCode )
+{
+   if ( stateM_currentState( &session->stateMachine ) != state ||
+         stateM_actionsPending( &session->stateMachine ) != pending )
+   {
+      std::fprintf( stderr, "Session %d in unexpected state\n",
+            session->key );
+      std::exit( exitCode );
+   }
+}
+
+int main()
+{
+   idle.transitions = idleTransitions;
+   idle.numTransitions = 1;
+   loading.transitions = loadingTransitions;
+   loading.numTransitions = 1;
+   loading.entryAction = &stateM::asyncAction<&lookUp>;
+   loading.deferredEvents = loadingDeferredEvents;
+   loading.numDeferredEvents = 1;
+   loaded.transitions = loadedTransitions;
+   loaded.numTransitions = 1;
+
+   struct session sessions[ 3 ] = {};
+   for ( int i = 0; i < 3; ++i )
+   {
+      sessions[ i ].key = i;
+      stateM_init( &sessions[ i ].stateMachine, &idle, &errorState );
+
+      struct event open = { Event_open, &sessions[ i ] };
+      if ( stateM::handleEvent( &sessions[ i ].stateMachine, &open ) !=
+            stateM_stateChanged )
+      {
+         std::fputs( "Session not opened\n", stderr );
+         std::exit( 1 );
+      }
+   }
+
+   /* The cached look-up completes at once, the others are waiting for the
+    * database: */
+   expectState( &sessions[ 0 ], &loaded, false, 2 );
+   expectState( &sessions[ 1 ], &loading, true, 3 );
+   expectState( &sessions[ 2 ], &loading, true, 4 );
+   if ( pendingQueries.size() != 2 )
+   {
+      std::fputs( "Expected two pending queries\n", stderr );
+      std::exit( 5 );
+   }
+   std::puts( "Sessions waiting for the database" );
+
+   struct event data = { Event_data, &sessions[ 1 ] };
+   if ( stateM::handleEvent( &sessions[ 1 ].stateMachine, &data ) !=
+         stateM_actionPending )
+   {
+      std::fputs( "Data not held back\n", stderr );
+      std::exit( 6 );
+   }
+   expectState( &sessions[ 1 ], &loading, true, 7 );
+
+   /* The database replies: */
+   std::vector<std::coroutine_handle<>> replies;
+   replies.swap( pendingQueries );
+   for ( std::coroutine_handle<> coroutine : replies )
+      coroutine.resume();
+
+   expectState( &sessions[ 1 ], &idle, false, 8 );
+   expectState( &sessions[ 2 ], &loaded, false, 9 );
+   if ( sessions[ 1 ].value != 10 || sessions[ 2 ].value != 20 ||
+         sessions[ 1 ].numDataHandled != 1 )
+   {
+      std::fputs( "Look-up results or data lost\n", stderr );
+      std::exit( 10 );
+   }
+   std::puts( "Held back data handled after the look-up" );
+
+   return 0;
+}
@@ -0,0 +1,158 @@
+/* 
+ * Copyright (c) 2013 Andreas Misje
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#include "stateMachine.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+/* This test ensures that deferred events are kept until a state handles
+ * them, and that they are recalled in the order they arrived.
+ *
+ *         +-------------------(done)------------------+
+ *         |                                           v
+ *     +------+ (send)  +---------+  (sent)  +-------+
+ * o-->| busy |         | sending |--------->| ready |
+ *     +------+         +---------+          +-------+
+ *      defers             defers    <-(send)--+
+ *      'send'             'send'
+ *
+ * Every 'send' event carries a sequence number that is checked when
+ * 'sending' is entered.
+ */
+
+enum eventTypes
+{
+   Event_send,
+   Event_sent,
+   Event_done,
+};
+
+static void checkSequence( void *oldStateData, struct event *event,
+      void *newStateData );
+
+static struct state busy, sending, ready, errorState;
+
+static struct state
+
+busy =
+{
+   .data = "busy",
+   .transitions = (struct transition[]) {
+      { Event_done, NULL, NULL, NULL, &ready },
+   },
+   .numTransitions = 1,
+   .deferredEvents = (int[]){ Event_send },
+   .numDeferredEvents = 1,
+},
+
+   sending =
+{
+   .data = "sending",
+   .transitions = (struct transition[]) {
+      { Event_sent, NULL, NULL, NULL, &ready },
+   },
+   .numTransitions = 1,
+   .deferredEvents = (int[]){ Event_send },
+   .numDeferredEvents = 1,
+},
+
+   ready =
+{
+   .data = "ready",
+   .transitions = (struct transition[]) {
+      { Event_send, NULL, NULL, &checkSequence, &sending },
+   },
+   .numTransitions = 1,
+},
+
+   errorState =
+{
+   .data = "error",
+};
+
+static int nextSequence = 1;
+
+int main()
+{
+   struct stateMachine fsm;
+   int sequence[] = { 1, 2, 3 };
+   size_t i;
+   int res;
+
+   stateM_init( &fsm, &busy, &errorState );
+
+   for ( i = 0; i < sizeof( sequence ) / sizeof( sequence[ 0 ] ); ++i )
+   {
+      res = stateM_handleEvent( &fsm, &(struct event){ Event_send,
+            &sequence[ i ] } );
+      if ( res != stateM_eventDeferred )
+      {
+         fprintf( stderr, "Expected 'send' to be deferred, got %d\n", res );
+         exit( 1 );
+      }
+   }
+
+   /* Leaving 'busy' recalls the first 'send'. The other two are deferred by
+    * 'sending': */
+   res = stateM_handleEvent( &fsm, &(struct event){ Event_done, NULL } );
+   if ( res != stateM_stateChanged || stateM_currentState( &fsm ) != &sending
+         || fsm.numDeferredEvents != 2 )
+   {
+      fprintf( stderr, "Unexpected result after 'done': %d\n", res );
+      exit( 2 );
+   }
+
+   for ( i = 0; i < 2; ++i )
+   {
+      res = stateM_handleEvent( &fsm, &(struct event){ Event_sent, NULL } );
+      if ( res != stateM_stateChanged || stateM_currentState( &fsm ) !=
+            &sending )
+      {
+         fprintf( stderr, "Unexpected result after 'sent': %d\n", res );
+         exit( 3 );
+      }
+   }
+
+   if ( fsm.numDeferredEvents || nextSequence != 4 )
+   {
+      fputs( "Not all deferred events were recalled\n", stderr );
+      exit( 4 );
+   }
+
+   puts( "Deferred events recalled in order" );
+
+   return 0;
+}
+
+static void checkSequence( void *oldStateData, struct event *event,
+      void *newStateData )
+{
+   int sequence = *(int *)event->data;
+
+   printf( "Sending %d\n", sequence );
+
+   if ( sequence != nextSequence++ )
+   {
+      fprintf( stderr, "Event %d recalled out of order\n", sequence );
+      exit( 5 );
+   }
+}
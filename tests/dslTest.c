@@ -0,0 +1,172 @@
+/* 
+ * Copyright (c) 2013 Andreas Misje
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#include "stateMachine.h"
+#include "stateMachineDsl.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* A door declared with the X-macro DSL is passed the same events through
+ * its generated dispatcher and through stateM_handleEvent(). Both must
+ * return the same values, end up in the same states and call the same
+ * actions in the same order.
+ */
+
+enum eventTypes
+{
+   Event_open,
+   Event_close,
+   Event_lock,
+   Event_unlock,
+   Event_knock,
+   Event_break,
+};
+
+static char log_[ 256 ];
+
+static void record( const char *entry )
+{
+   strcat( log_, entry );
+}
+
+static bool hasKey( void *key, struct event *event )
+{
+   return event->data == key;
+}
+
+static void creak( void *currentStateData, struct event *event,
+      void *newStateData )
+{
+   record( "creak " );
+}
+
+static void echo( void *currentStateData, struct event *event,
+      void *newStateData )
+{
+   record( "echo " );
+}
+
+static void turnOnLight( void *stateData, struct event *event )
+{
+   record( "on " );
+}
+
+static void turnOffLight( void *stateData, struct event *event )
+{
+   record( "off " );
+}
+
+static void enterError( void *stateData, struct event *event )
+{
+   record( stateData );
+}
+
+static int key = 42;
+
+#define DOOR( m, STATE, TRANSITION ) \
+   STATE( m, closed, NULL, NULL, NULL, \
+      TRANSITION( m, Event_open, NULL, NULL, &creak, open ) \
+      TRANSITION( m, Event_lock, &key, &hasKey, NULL, locked ) \
+      TRANSITION( m, Event_knock, NULL, NULL, &echo, closed ) \
+      TRANSITION( m, Event_break, NULL, NULL, NULL, broken ) ) \
+   STATE( m, open, NULL, &turnOnLight, &turnOffLight, \
+      TRANSITION( m, Event_close, NULL, NULL, &creak, closed ) \
+      TRANSITION( m, Event_knock, NULL, NULL, NULL, open ) ) \
+   STATE( m, locked, NULL, NULL, NULL, \
+      TRANSITION( m, Event_unlock, &key, &hasKey, NULL, closed ) \
+      TRANSITION( m, Event_break, NULL, NULL, NULL, error ) ) \
+   STATE( m, broken, NULL, NULL, NULL, ) \
+   STATE( m, error, "error ", &enterError, NULL, )
+
+STATEM_DSL_DEFINE( door, DOOR, closed, error )
+
+int main()
+{
+   struct event events[] = {
+      { Event_knock, NULL },
+      { Event_open, NULL },
+      { Event_lock, &key },
+      { Event_knock, NULL },
+      { Event_close, NULL },
+      { Event_lock, NULL },
+      { Event_lock, &key },
+      { Event_open, NULL },
+      { Event_unlock, &key },
+      { Event_lock, &key },
+      { Event_break, NULL },
+   };
+   size_t numEvents = sizeof( events ) / sizeof( events[ 0 ] );
+   char dispatchLog[ sizeof( log_ ) ];
+   int dispatchRets[ sizeof( events ) / sizeof( events[ 0 ] ) ];
+   enum door_stateIds dispatchStates[ sizeof( events ) / sizeof(
+         events[ 0 ] ) ];
+   enum door_stateIds state = door_initialStateId;
+   struct stateMachine fsm;
+   size_t i;
+
+   if ( door_numStates != 5 || door_getDefinition()->numStates != 5 ||
+         door_brokenState.id != door_broken ||
+         door_getDefinition()->states[ door_locked ] != &door_lockedState ||
+         door_openState.numTransitions != 2 ||
+         door_errorState.numTransitions != 0 )
+   {
+      fputs( "Unexpected state graph\n", stderr );
+      exit( 1 );
+   }
+
+   if ( stateM_validate( door_getDefinition(), NULL, NULL ) )
+   {
+      fputs( "Generated definition is invalid\n", stderr );
+      exit( 2 );
+   }
+
+   for ( i = 0; i < numEvents; ++i )
+   {
+      dispatchRets[ i ] = door_dispatch( &state, &events[ i ] );
+      dispatchStates[ i ] = state;
+   }
+   strcpy( dispatchLog, log_ );
+
+   log_[ 0 ] = '\0';
+   stateM_initWithDefinition( &fsm, door_getDefinition() );
+   for ( i = 0; i < numEvents; ++i )
+   {
+      int ret = stateM_handleEvent( &fsm, &events[ i ] );
+      if ( ret != dispatchRets[ i ] || stateM_currentState( &fsm ) !=
+            door_getDefinition()->states[ dispatchStates[ i ] ] )
+      {
+         fprintf( stderr, "Event %zu handled differently\n", i );
+         exit( 3 );
+      }
+   }
+
+   if ( state != door_error || strcmp( log_, dispatchLog ) ||
+         strcmp( log_, "echo creak on off creak error " ) )
+   {
+      fprintf( stderr, "Unexpected actions: %s\n", dispatchLog );
+      exit( 4 );
+   }
+   puts( "Dispatcher matches stateM_handleEvent()" );
+
+   return 0;
+}
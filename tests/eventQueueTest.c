@@ -0,0 +1,290 @@
+/* 
+ * Copyright (c) 2013 Andreas Misje
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#include "stateMachine.h"
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* This test ensures that events raised by actions are handled in order
+ * within the same call to stateM_handleEvent(), and that the overflow
+ * policies behave as documented.
+ *
+ *        (go)          (next)          (next)
+ * idle -------> first --------> second --------> done
+ *
+ * 'first' posts 'next' from its entry action, and the transition from 'first'
+ * to 'second' posts another 'next' from its transition action. A single 'go'
+ * should therefore end up in 'done'. 'flood' posts more events than the
+ * queue can hold.
+ *
+ * The state 'log' records the events it handles in order to check that
+ * events are handled by priority and that events are coalesced.
+ */
+
+enum eventTypes
+{
+   Event_go,
+   Event_next,
+   Event_flood,
+   Event_nop,
+   Event_a,
+   Event_b,
+   Event_c,
+};
+
+static struct stateMachine fsm;
+
+static void postNext( void *stateData, struct event *event );
+static void postNextTrans( void *oldStateData, struct event *event,
+      void *newStateData );
+static void recursiveNext( void *oldStateData, struct event *event,
+      void *newStateData );
+static void flood( void *oldStateData, struct event *event,
+      void *newStateData );
+static void logEvent( void *oldStateData, struct event *event,
+      void *newStateData );
+
+static struct state idle, first, second, done, logState, errorState;
+static char eventLog[ 32 ];
+
+static struct state
+
+idle =
+{
+   .data = "idle",
+   .transitions = (struct transition[]) {
+      { Event_go, NULL, NULL, NULL, &first },
+      { Event_flood, NULL, NULL, &flood, &idle },
+      { Event_nop, NULL, NULL, NULL, &idle },
+   },
+   .numTransitions = 3,
+},
+
+   first =
+{
+   .data = "first",
+   .entryAction = &postNext,
+   .transitions = (struct transition[]) {
+      { Event_next, NULL, NULL, &postNextTrans, &second },
+   },
+   .numTransitions = 1,
+},
+
+   second =
+{
+   .data = "second",
+   .transitions = (struct transition[]) {
+      { Event_next, NULL, NULL, NULL, &done },
+      { Event_go, NULL, NULL, &recursiveNext, &second },
+   },
+   .numTransitions = 2,
+},
+
+   done =
+{
+   .data = "done",
+},
+
+   logState =
+{
+   .data = "log",
+   .transitions = (struct transition[]) {
+      { Event_a, NULL, NULL, &logEvent, &logState },
+      { Event_b, NULL, NULL, &logEvent, &logState },
+      { Event_c, NULL, NULL, &logEvent, &logState },
+      { Event_nop, NULL, NULL, NULL, &logState },
+   },
+   .numTransitions = 4,
+},
+
+   errorState =
+{
+   .data = "error",
+};
+
+static void expect( int res, int expectedRes, struct state *expectedState,
+      int line )
+{
+   if ( res != expectedRes || stateM_currentState( &fsm ) != expectedState )
+   {
+      fprintf( stderr, "Line %d: got %d in state %s, expected %d in state "
+            "%s\n", line, res, (const char *)stateM_currentState( &fsm
+               )->data, expectedRes, (const char *)expectedState->data );
+      exit( 1 );
+   }
+}
+
+#define EXPECT( res, expectedRes, expectedState ) \
+   expect( res, expectedRes, expectedState, __LINE__ )
+
+int main()
+{
+   int res;
+
+   /* Chained events are handled within the same call: */
+   stateM_init( &fsm, &idle, &errorState );
+   res = stateM_handleEvent( &fsm, &(struct event){ Event_go, NULL } );
+   EXPECT( res, stateM_finalStateReached, &done );
+   if ( stateM_previousState( &fsm ) != &second )
+   {
+      fputs( "Chained events were not handled in order\n", stderr );
+      exit( 2 );
+   }
+   puts( "Chained events handled" );
+
+   /* Calling stateM_handleEvent() from an action queues the event: */
+   stateM_init( &fsm, &second, &errorState );
+   res = stateM_handleEvent( &fsm, &(struct event){ Event_go, NULL } );
+   EXPECT( res, stateM_finalStateReached, &done );
+   puts( "Recursive call queued" );
+
+   /* Events posted while idle are handled before the next event: */
+   stateM_init( &fsm, &idle, &errorState );
+   stateM_postEvent( &fsm, &(struct event){ Event_go, NULL } );
+   EXPECT( stateM_noStateChange, stateM_noStateChange, &idle );
+   res = stateM_handleEvent( &fsm, &(struct event){ Event_nop, NULL } );
+   EXPECT( res, stateM_finalStateReached, &done );
+   puts( "Idle events handled first" );
+
+   /* Overflow, rejecting new events: */
+   stateM_init( &fsm, &idle, &errorState );
+   res = stateM_handleEvent( &fsm, &(struct event){ Event_flood, NULL } );
+   EXPECT( res, stateM_stateLoopSelf, &idle );
+
+   /* Overflow, dropping old events. The last event ('go') is kept: */
+   stateM_init( &fsm, &idle, &errorState );
+   stateM_setOverflowPolicy( &fsm, stateM_overflowDropOldest );
+   res = stateM_handleEvent( &fsm, &(struct event){ Event_flood, NULL } );
+   EXPECT( res, stateM_finalStateReached, &done );
+
+   /* Overflow, entering the error state: */
+   stateM_init( &fsm, &idle, &errorState );
+   stateM_setOverflowPolicy( &fsm, stateM_overflowErrorState );
+   res = stateM_handleEvent( &fsm, &(struct event){ Event_flood, NULL } );
+   EXPECT( res, stateM_errorStateReached, &errorState );
+   puts( "Overflow policies respected" );
+
+   /* Events are handled by priority, and 'b' is coalesced: */
+   stateM_init( &fsm, &logState, &errorState );
+   stateM_postPriorityEvent( &fsm, &(struct event){ Event_a, "a" }, 0,
+         false );
+   stateM_postPriorityEvent( &fsm, &(struct event){ Event_b, "x" }, 0, true );
+   stateM_postPriorityEvent( &fsm, &(struct event){ Event_b, "b" }, 0, true );
+   stateM_postPriorityEvent( &fsm, &(struct event){ Event_c, "c" }, 2,
+         false );
+   stateM_postPriorityEvent( &fsm, &(struct event){ Event_a, "A" }, 1,
+         false );
+   res = stateM_handleEvent( &fsm, &(struct event){ Event_nop, NULL } );
+   EXPECT( res, stateM_stateLoopSelf, &logState );
+   if ( strcmp( eventLog, "cAab" ) )
+   {
+      fprintf( stderr, "Events handled in wrong order: %s\n", eventLog );
+      exit( 4 );
+   }
+
+   /* An urgent event is not rejected by a queue full of less important
+    * events: */
+   stateM_init( &fsm, &logState, &errorState );
+   eventLog[ 0 ] = '\0';
+   size_t i;
+   for ( i = 0; i < STATEM_EVENTQUEUE_SIZE; ++i )
+      stateM_postEvent( &fsm, &(struct event){ Event_a, "a" } );
+   if ( !stateM_postPriorityEvent( &fsm, &(struct event){ Event_c, "c" },
+            STATEM_NUM_PRIORITIES - 1, false ) || stateM_postEvent( &fsm,
+            &(struct event){ Event_b, "b" } ) )
+   {
+      fputs( "Urgent event rejected by full queue\n", stderr );
+      exit( 5 );
+   }
+   stateM_handleEvent( &fsm, &(struct event){ Event_nop, NULL } );
+   if ( eventLog[ 0 ] != 'c' || strlen( eventLog ) != STATEM_EVENTQUEUE_SIZE )
+   {
+      fprintf( stderr, "Unexpected events handled: %s\n", eventLog );
+      exit( 6 );
+   }
+
+   /* Dropping old events never drops more important ones: */
+   stateM_init( &fsm, &logState, &errorState );
+   stateM_setOverflowPolicy( &fsm, stateM_overflowDropOldest );
+   eventLog[ 0 ] = '\0';
+   for ( i = 0; i < STATEM_EVENTQUEUE_SIZE; ++i )
+      stateM_postPriorityEvent( &fsm, &(struct event){ Event_a, "a" }, 1,
+            false );
+   if ( stateM_postEvent( &fsm, &(struct event){ Event_b, "b" } ) ||
+         !stateM_postPriorityEvent( &fsm, &(struct event){ Event_c, "c" }, 1,
+            false ) )
+   {
+      fputs( "Unexpected event dropped from full queue\n", stderr );
+      exit( 7 );
+   }
+   stateM_handleEvent( &fsm, &(struct event){ Event_nop, NULL } );
+   if ( strlen( eventLog ) != STATEM_EVENTQUEUE_SIZE || strchr( eventLog,
+            'b' ) || eventLog[ STATEM_EVENTQUEUE_SIZE - 1 ] != 'c' )
+   {
+      fprintf( stderr, "Unexpected events handled: %s\n", eventLog );
+      exit( 8 );
+   }
+   puts( "Event priorities respected" );
+
+   return 0;
+}
+
+static void postNext( void *stateData, struct event *event )
+{
+   stateM_postEvent( &fsm, &(struct event){ Event_next, NULL } );
+}
+
+static void postNextTrans( void *oldStateData, struct event *event,
+      void *newStateData )
+{
+   stateM_postEvent( &fsm, &(struct event){ Event_next, NULL } );
+}
+
+static void recursiveNext( void *oldStateData, struct event *event,
+      void *newStateData )
+{
+   int res = stateM_handleEvent( &fsm, &(struct event){ Event_next, NULL } );
+   if ( res != stateM_noStateChange )
+   {
+      fprintf( stderr, "Recursive call returned %d\n", res );
+      exit( 3 );
+   }
+}
+
+static void flood( void *oldStateData, struct event *event,
+      void *newStateData )
+{
+   size_t i;
+
+   for ( i = 0; i < STATEM_EVENTQUEUE_SIZE; ++i )
+      stateM_postEvent( &fsm, &(struct event){ Event_nop, NULL } );
+
+   stateM_postEvent( &fsm, &(struct event){ Event_go, NULL } );
+}
+
+static void logEvent( void *oldStateData, struct event *event,
+      void *newStateData )
+{
+   strcat( eventLog, (const char *)event->data );
+}
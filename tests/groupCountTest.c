@@ -0,0 +1,181 @@
+/* 
+ * Copyright (c) 2013 Andreas Misje
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#include "stateMachine.h"
+#include "stateMachineBroadcast.h"
+#include "stateMachineCompile.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+/* The members of a group are counted per state as they change state,
+ * including when they enter the error state because their event queue
+ * overflowed. The members in a state can be enumerated and closed without
+ * touching the others.
+ */
+
+#define NUM_CONNECTIONS 500
+
+enum eventTypes
+{
+   Event_open,
+   Event_close,
+   Event_data,
+};
+
+static struct state closed, open, errorState;
+
+static struct state
+
+closed =
+{
+   .transitions = (struct transition[]) {
+      { Event_open, NULL, NULL, NULL, &open },
+   },
+   .numTransitions = 1,
+},
+
+   open =
+{
+   .transitions = (struct transition[]) {
+      { Event_close, NULL, NULL, NULL, &closed },
+      { Event_data, NULL, NULL, NULL, &open },
+   },
+   .numTransitions = 2,
+},
+
+   errorState =
+{
+   .data = "error",
+};
+
+static void closeConnection( struct stateMachine *fsm, void *data )
+{
+   ++*(size_t *)data;
+   stateM_handleEvent( fsm, &(struct event){ Event_close, NULL } );
+}
+
+static void checkCounts( struct stateMachineGroup *group, size_t numClosed,
+      size_t numOpen, size_t numFailed, int exitCode )
+{
+   if ( stateM_groupCount( group, &closed ) != numClosed
+         || stateM_groupCount( group, &open ) != numOpen
+         || stateM_groupCount( group, &errorState ) != numFailed
+         || stateM_groupCount( group, NULL ) )
+   {
+      fprintf( stderr, "Unexpected counts %zu/%zu/%zu\n",
+            stateM_groupCount( group, &closed ),
+            stateM_groupCount( group, &open ),
+            stateM_groupCount( group, &errorState ) );
+      exit( exitCode );
+   }
+}
+
+int main()
+{
+   struct stateMachineDefinition definition = {
+      .states = (struct state *[]){ &closed, &open, &errorState },
+      .numStates = 3,
+      .initialState = &closed,
+      .errorState = &errorState,
+   };
+   static struct stateMachine connections[ NUM_CONNECTIONS ];
+   struct compiledStateMachine *compiled;
+   struct stateMachineGroup *group;
+   struct stateMachine *fsm;
+   size_t n, numVisited;
+
+   stateM_validate( &definition, NULL, NULL );
+   compiled = stateM_compile( &definition );
+   group = stateM_createGroup( compiled );
+   if ( !compiled || !group )
+   {
+      fputs( "Could not create group\n", stderr );
+      exit( 1 );
+   }
+
+   for ( n = 0; n < NUM_CONNECTIONS; ++n )
+   {
+      stateM_initCompiled( &connections[ n ], compiled );
+      stateM_setOverflowPolicy( &connections[ n ],
+            stateM_overflowErrorState );
+      stateM_groupAdd( group, &connections[ n ] );
+   }
+   checkCounts( group, NUM_CONNECTIONS, 0, 0, 2 );
+
+   /* Every other connection is opened: */
+   for ( n = 0; n < NUM_CONNECTIONS; n += 2 )
+      stateM_handleEvent( &connections[ n ], &(struct event){ Event_open,
+            NULL } );
+   checkCounts( group, NUM_CONNECTIONS / 2, NUM_CONNECTIONS / 2, 0, 3 );
+
+   /* Every tenth connection is flooded with data until its queue
+    * overflows: */
+   for ( n = 0; n < NUM_CONNECTIONS; n += 10 )
+   {
+      size_t i;
+      for ( i = 0; i <= STATEM_EVENTQUEUE_SIZE; ++i )
+         stateM_postEvent( &connections[ n ], &(struct event){ Event_data,
+               NULL } );
+   }
+   checkCounts( group, NUM_CONNECTIONS / 2, NUM_CONNECTIONS / 2
+         - NUM_CONNECTIONS / 10, NUM_CONNECTIONS / 10, 4 );
+
+   numVisited = 0;
+   for ( fsm = stateM_groupFirst( group, &errorState ); fsm;
+         fsm = stateM_groupNext( fsm ) )
+   {
+      if ( ( fsm - connections ) % 10 )
+      {
+         fputs( "Unexpected connection in the error state\n", stderr );
+         exit( 5 );
+      }
+      ++numVisited;
+   }
+   if ( numVisited != NUM_CONNECTIONS / 10 )
+   {
+      fputs( "Not all failed connections enumerated\n", stderr );
+      exit( 6 );
+   }
+   puts( "Failed connections counted and enumerated" );
+
+   /* Close all open connections: */
+   numVisited = 0;
+   if ( stateM_groupForEach( group, &open, &closeConnection, &numVisited )
+         != NUM_CONNECTIONS / 2 - NUM_CONNECTIONS / 10
+         || numVisited != NUM_CONNECTIONS / 2 - NUM_CONNECTIONS / 10 )
+   {
+      fputs( "Not all open connections closed\n", stderr );
+      exit( 7 );
+   }
+   checkCounts( group, NUM_CONNECTIONS - NUM_CONNECTIONS / 10, 0,
+         NUM_CONNECTIONS / 10, 8 );
+
+   stateM_groupRemove( &connections[ 0 ] );
+   checkCounts( group, NUM_CONNECTIONS - NUM_CONNECTIONS / 10, 0,
+         NUM_CONNECTIONS / 10 - 1, 9 );
+   puts( "Open connections closed" );
+
+   stateM_freeGroup( group );
+   stateM_freeCompiled( compiled );
+
+   return 0;
+}
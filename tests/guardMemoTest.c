@@ -0,0 +1,152 @@
+/* 
+ * Copyright (c) 2013 Andreas Misje
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#include "stateMachine.h"
+#include "stateMachineCompile.h"
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+/* This test ensures that a pure guard shared by a state and its parents is
+ * only called once per event, whereas an impure guard is called every
+ * time.
+ *
+ * +-[top]-------------------+
+ * | +-[middle]------------+ |
+ * | | +--------+          | |
+ * | | | bottom |          | |
+ * | | +--------+          | |
+ * | +---------------------+ |
+ * +-------------------------+
+ *
+ * All three states have a transition for 'packet' guarded by
+ * 'isKind( 'x' )', and 'top' has an unguarded transition as well. The
+ * incoming packet is of kind 'y', so the unguarded transition is taken.
+ */
+
+enum eventTypes
+{
+   Event_packet,
+};
+
+static bool isKind( void *kind, struct event *event );
+
+static struct state top, middle, bottom, errorState;
+
+#define GUARDED_TRANSITION( pure ) \
+   { Event_packet, (void *)(intptr_t)'x', &isKind, NULL, &errorState, \
+      stateM_guardFunction, pure }
+
+static struct state
+
+top =
+{
+   .transitions = (struct transition[]) {
+      GUARDED_TRANSITION( true ),
+      { Event_packet, NULL, NULL, NULL, &bottom },
+   },
+   .numTransitions = 2,
+},
+
+   middle =
+{
+   .parentState = &top,
+   .transitions = (struct transition[]) {
+      GUARDED_TRANSITION( true ),
+   },
+   .numTransitions = 1,
+},
+
+   bottom =
+{
+   .parentState = &middle,
+   .transitions = (struct transition[]) {
+      GUARDED_TRANSITION( true ),
+   },
+   .numTransitions = 1,
+},
+
+   errorState =
+{
+   .data = "error",
+};
+
+static size_t numGuardCalls;
+
+static void expectGuardCalls( struct stateMachine *fsm, size_t expected )
+{
+   numGuardCalls = 0;
+
+   if ( stateM_handleEvent( fsm, &(struct event){ Event_packet,
+            (void *)(intptr_t)'y' } ) != stateM_stateLoopSelf ||
+         numGuardCalls != expected )
+   {
+      fprintf( stderr, "Expected %zu guard calls, got %zu\n", expected,
+            numGuardCalls );
+      exit( 1 );
+   }
+}
+
+int main()
+{
+   struct stateMachineDefinition definition = {
+      .states = (struct state *[]){ &top, &middle, &bottom, &errorState },
+      .numStates = 4,
+      .initialState = &bottom,
+      .errorState = &errorState,
+   };
+   struct compiledStateMachine *compiled;
+   struct stateMachine fsm;
+
+   stateM_init( &fsm, &bottom, &errorState );
+   expectGuardCalls( &fsm, 1 );
+
+   /* The guard is only remembered for one event: */
+   expectGuardCalls( &fsm, 1 );
+
+   if ( stateM_validate( &definition, NULL, NULL ) || !( compiled =
+            stateM_compile( &definition ) ) )
+   {
+      fputs( "Could not compile state machine\n", stderr );
+      exit( 2 );
+   }
+   stateM_initCompiled( &fsm, compiled );
+   expectGuardCalls( &fsm, 1 );
+   stateM_freeCompiled( compiled );
+   puts( "Pure guards called once per event" );
+
+   top.transitions[ 0 ].pureGuard = false;
+   middle.transitions[ 0 ].pureGuard = false;
+   bottom.transitions[ 0 ].pureGuard = false;
+   stateM_init( &fsm, &bottom, &errorState );
+   expectGuardCalls( &fsm, 3 );
+   puts( "Impure guards called every time" );
+
+   return 0;
+}
+
+static bool isKind( void *kind, struct event *event )
+{
+   ++numGuardCalls;
+
+   return (intptr_t)kind == (intptr_t)event->data;
+}
@@ -0,0 +1,174 @@
+/* 
+ * Copyright (c) 2013 Andreas Misje
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#include "stateMachine.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+/* This test ensures that shallow and deep history pseudo-states restore the
+ * right states.
+ *
+ * +-[running]---------------------------+
+ * |  (H) (H*)                           |
+ * |         +-[b]-------------------+   |  (interrupt)  +-------------+
+ * | +---+   | +----+  (next) +----+ |   |-------------->| interrupted |
+ * | | a |-->| | b1 |-------->| b2 | |   |               +-------------+
+ * | +---+   | +----+         +----+ |   |<------------------+ |
+ * |  (next) +-----------------------+   |   (resumeShallow/   |
+ * +-------------------------------------+    resumeDeep)      |
+ *      ^                                                      |
+ *      +------------------------------------------------------+
+ *
+ * 'running' and 'b' record their history. 'running' starts in 'a', 'b'
+ * starts in 'b1'.
+ */
+
+enum eventTypes
+{
+   Event_next,
+   Event_interrupt,
+   Event_resumeShallow,
+   Event_resumeDeep,
+};
+
+static struct state running, shallowHistory, deepHistory, a, b, b1, b2,
+                    interrupted, errorState;
+
+static struct state
+
+running =
+{
+   .data = "running",
+   .entryState = &a,
+   .historySlot = 1,
+   .transitions = (struct transition[]) {
+      { Event_interrupt, NULL, NULL, NULL, &interrupted },
+   },
+   .numTransitions = 1,
+},
+
+   shallowHistory =
+{
+   .parentState = &running,
+   .entryState = &a,
+   .historyType = stateM_shallowHistory,
+},
+
+   deepHistory =
+{
+   .parentState = &running,
+   .entryState = &a,
+   .historyType = stateM_deepHistory,
+},
+
+   a =
+{
+   .data = "a",
+   .parentState = &running,
+   .transitions = (struct transition[]) {
+      { Event_next, NULL, NULL, NULL, &b },
+   },
+   .numTransitions = 1,
+},
+
+   b =
+{
+   .data = "b",
+   .parentState = &running,
+   .entryState = &b1,
+   .historySlot = 2,
+},
+
+   b1 =
+{
+   .data = "b1",
+   .parentState = &b,
+   .transitions = (struct transition[]) {
+      { Event_next, NULL, NULL, NULL, &b2 },
+   },
+   .numTransitions = 1,
+},
+
+   b2 =
+{
+   .data = "b2",
+   .parentState = &b,
+   .transitions = (struct transition[]) {
+      { Event_next, NULL, NULL, NULL, &b1 },
+   },
+   .numTransitions = 1,
+},
+
+   interrupted =
+{
+   .data = "interrupted",
+   .transitions = (struct transition[]) {
+      { Event_resumeShallow, NULL, NULL, NULL, &shallowHistory },
+      { Event_resumeDeep, NULL, NULL, NULL, &deepHistory },
+   },
+   .numTransitions = 2,
+},
+
+   errorState =
+{
+   .data = "error",
+};
+
+int main()
+{
+   struct stateMachine fsm;
+   struct {
+      int eventType;
+      struct state *expectedState;
+   } steps[] = {
+      /* Without history, the pseudo-state's entry state is used: */
+      { Event_resumeShallow, &a },
+      { Event_next, &b1 },
+      { Event_next, &b2 },
+      { Event_interrupt, &interrupted },
+      { Event_resumeDeep, &b2 },
+      { Event_interrupt, &interrupted },
+      /* Shallow history enters 'b', which does not use its own history: */
+      { Event_resumeShallow, &b1 },
+   };
+   size_t i;
+
+   stateM_init( &fsm, &interrupted, &errorState );
+
+   for ( i = 0; i < sizeof( steps ) / sizeof( steps[ 0 ] ); ++i )
+   {
+      int res = stateM_handleEvent( &fsm, &(struct event){
+            steps[ i ].eventType, NULL } );
+      if ( res != stateM_stateChanged || stateM_currentState( &fsm ) !=
+            steps[ i ].expectedState )
+      {
+         fprintf( stderr, "Step %zu: got %d in state %s, expected state %s\n",
+               i, res, (const char *)stateM_currentState( &fsm )->data,
+               (const char *)steps[ i ].expectedState->data );
+         exit( 1 );
+      }
+   }
+
+   puts( "History restored" );
+
+   return 0;
+}
@@ -0,0 +1,120 @@
+/* 
+ * Copyright (c) 2013 Andreas Misje
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#include "stateMachine.h"
+#include "stateMachineCompile.h"
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* This test uses the state machine generated by stateMachineImport from
+ * importTest.dot. It checks that the states are laid out in the expected
+ * traversal order, and that the generated definition and dispatch table
+ * behave like the description. */
+#include "importTestMachine.c"
+
+static size_t numEntries, numActions;
+
+int main()
+{
+   struct state **states = importTest_definition.states;
+   struct stateMachine plain, fast;
+   const char *input = "hi\nha\nhx!h\n";
+   const char *expected[] = { "h", "hi", "idle", "h", "ha", "idle", "h",
+      "hx", "idle", "h", "h" };
+   size_t n;
+
+   /* The parents come first, then the most frequently visited states: */
+   if ( importTest_group != 0 || importTest_idle != 1 || importTest_h != 2 ||
+         importTest_hi != 3 || importTest_ha != 4 || importTest_hx != 5 ||
+         importTest_errorState != 6 )
+   {
+      fputs( "Unexpected state layout\n", stderr );
+      exit( 1 );
+   }
+
+   for ( n = 0; n < importTest_definition.numStates; ++n )
+   {
+      if ( states[ n ] != states[ 0 ] + n || states[ n ]->id != n )
+      {
+         fputs( "States are not stored in layout order\n", stderr );
+         exit( 2 );
+      }
+   }
+   puts( "States laid out in traversal order" );
+
+   stateM_initWithDefinition( &plain, &importTest_definition );
+   stateM_initCompiled( &fast, &importTest_compiled );
+
+   for ( n = 0; input[ n ]; ++n )
+   {
+      struct event event = { Event_keyboard, (void *)(intptr_t)input[ n ] };
+      int plainRes = stateM_handleEvent( &plain, &event );
+      int fastRes = stateM_handleEvent( &fast, &event );
+
+      if ( plainRes != fastRes || stateM_currentState( &plain ) !=
+            stateM_currentState( &fast ) || strcmp( stateM_currentState(
+                  &fast )->data, expected[ n ] ) )
+      {
+         fprintf( stderr, "Imported state machine differs at '%c'\n",
+               input[ n ] );
+         exit( 3 );
+      }
+   }
+
+   /* 'hi' and 'ha' are entered twice in each state machine, and the
+    * action from 'hi' is run once: */
+   if ( numEntries != 4 || numActions != 2 )
+   {
+      fputs( "Unexpected number of actions\n", stderr );
+      exit( 4 );
+   }
+
+   /* 'tick' is handled by the parent state: */
+   if ( stateM_handleEvent( &fast, &(struct event){ Event_tick, NULL } ) !=
+         stateM_stateChanged || stateM_currentState( &fast ) != states[
+         importTest_idle ] )
+   {
+      fputs( "Parent transition not taken\n", stderr );
+      exit( 5 );
+   }
+   puts( "Imported state machine behaves like its description" );
+
+   return 0;
+}
+
+bool compareKeyboardChar( void *ch, struct event *event )
+{
+   return (intptr_t)ch == (intptr_t)event->data;
+}
+
+void countEntry( void *stateData, struct event *event )
+{
+   ++numEntries;
+}
+
+void countAction( void *currentStateData, struct event *event,
+      void *newStateData )
+{
+   ++numActions;
+}
@@ -0,0 +1,225 @@
+/* 
+ * Copyright (c) 2013 Andreas Misje
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#include "stateMachine.h"
+#include "stateMachineLayout.h"
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* This test relocates the state machine from stateMachineExample.c
+ * (extended with a 'tick' event and a state deferring it), checks the
+ * layout of the relocated block, and checks that the original and the
+ * relocated state machine behave identically.
+ */
+
+enum eventTypes
+{
+   Event_keyboard,
+   Event_tick,
+};
+
+static bool compareKeyboardChar( void *ch, struct event *event );
+
+static struct state group, idle, h, i, a, waiting, errorState;
+
+static struct state
+
+group =
+{
+   .entryState = &idle,
+   .transitions = (struct transition[]) {
+      { Event_keyboard, (void *)(intptr_t)'!', &compareKeyboardChar, NULL,
+         &idle },
+      { Event_tick, NULL, NULL, NULL, &idle },
+   },
+   .numTransitions = 2,
+   .data = "group",
+},
+
+   idle =
+{
+   .parentState = &group,
+   .transitions = (struct transition[]) {
+      { Event_keyboard, (void *)(intptr_t)'h', &compareKeyboardChar, NULL,
+         &h },
+      { Event_keyboard, (void *)(intptr_t)'w', &compareKeyboardChar, NULL,
+         &waiting },
+   },
+   .numTransitions = 2,
+   .data = "idle",
+},
+
+   h =
+{
+   .parentState = &group,
+   .transitions = (struct transition[]) {
+      { Event_keyboard, (void *)(intptr_t)'a', &compareKeyboardChar, NULL,
+         &a },
+      { Event_keyboard, (void *)(intptr_t)'i', &compareKeyboardChar, NULL,
+         &i },
+   },
+   .numTransitions = 2,
+   .data = "h",
+},
+
+   i =
+{
+   .parentState = &group,
+   .transitions = (struct transition[]) {
+      { Event_keyboard, (void *)(intptr_t)'\n', &compareKeyboardChar, NULL,
+         &idle },
+   },
+   .numTransitions = 1,
+   .data = "i",
+},
+
+   a =
+{
+   .parentState = &group,
+   .transitions = (struct transition[]) {
+      { Event_keyboard, (void *)(intptr_t)'\n', &compareKeyboardChar, NULL,
+         &idle },
+   },
+   .numTransitions = 1,
+   .data = "a",
+},
+
+   waiting =
+{
+   .parentState = &group,
+   .transitions = (struct transition[]) {
+      { Event_keyboard, (void *)(intptr_t)'g', &compareKeyboardChar, NULL,
+         &h },
+   },
+   .numTransitions = 1,
+   .deferredEvents = (int[]){ Event_tick },
+   .numDeferredEvents = 1,
+   .data = "waiting",
+},
+
+   errorState =
+{
+   .data = "error",
+};
+
+static void checkLayout( struct relocatedStateMachine *relocated )
+{
+   /* The error state is a separate tree, and follows the initial one: */
+   const char *expected[] = { "group", "h", "a", "idle", "i", "waiting",
+      "error" };
+   size_t n;
+
+   if ( sizeof( struct hotState ) != 32 || (uintptr_t)relocated->hotStates
+         % STATEM_CACHE_LINE_SIZE || (uintptr_t)relocated->states %
+         STATEM_CACHE_LINE_SIZE || (uintptr_t)relocated->transitions %
+         STATEM_CACHE_LINE_SIZE )
+   {
+      fputs( "Relocated arrays are not cache-line-aligned\n", stderr );
+      exit( 2 );
+   }
+
+   for ( n = 0; n < relocated->definition.numStates; ++n )
+   {
+      struct state *state = relocated->definition.states[ n ];
+      struct hotState *hot = &relocated->hotStates[ n ];
+
+      if ( state != &relocated->states[ n ] || strcmp( state->data,
+               expected[ n ] ) || state->transitions !=
+            &relocated->transitions[ hot->firstTransition ] ||
+            state->numTransitions != hot->numTransitions || (
+               state->parentState ? &relocated->states[ hot->parent ] :
+               NULL ) != state->parentState )
+      {
+         fprintf( stderr, "Unexpected relocated state %u\n", (unsigned)n );
+         exit( 3 );
+      }
+   }
+
+   if ( relocated->hotStates[ relocated->stateMap[ group.id ] ].eventMask !=
+         ( 1U << Event_keyboard | 1U << Event_tick ) ||
+         relocated->hotStates[ relocated->stateMap[ waiting.id ]
+         ].deferredMask != 1U << Event_tick )
+   {
+      fputs( "Unexpected event masks\n", stderr );
+      exit( 4 );
+   }
+   puts( "States relocated in depth-first order" );
+}
+
+int main()
+{
+   struct stateMachineDefinition definition = {
+      /* Deliberately not in depth-first order: */
+      .states = (struct state *[]){ &errorState, &h, &group, &a, &idle, &i,
+         &waiting },
+      .numStates = 7,
+      .initialState = &idle,
+      .errorState = &errorState,
+   };
+   struct relocatedStateMachine *relocated;
+   struct stateMachine plain, fast;
+   const char *input = "hi\nha\nw.gi\n!hx";
+   size_t n;
+
+   if ( stateM_validate( &definition, NULL, NULL ) || !( relocated =
+            stateM_relocate( &definition ) ) )
+   {
+      fputs( "Could not relocate state machine\n", stderr );
+      exit( 1 );
+   }
+
+   checkLayout( relocated );
+
+   stateM_initWithDefinition( &plain, &definition );
+   stateM_initRelocated( &fast, relocated );
+
+   for ( n = 0; input[ n ]; ++n )
+   {
+      /* '.' is a tick, which is deferred in 'waiting': */
+      struct event event = { input[ n ] == '.' ? Event_tick :
+         Event_keyboard, (void *)(intptr_t)input[ n ] };
+      int plainRes = stateM_handleEvent( &plain, &event );
+      int fastRes = stateM_handleEvent( &fast, &event );
+
+      if ( plainRes != fastRes || strcmp( stateM_currentState(
+                  &plain )->data, stateM_currentState( &fast )->data ) ||
+            stateM_currentState( &fast ) != &relocated->states[
+            relocated->stateMap[ stateM_currentState( &plain )->id ] ] )
+      {
+         fprintf( stderr, "Relocated state machine differs at '%c'\n",
+               input[ n ] );
+         exit( 5 );
+      }
+   }
+   puts( "Relocated state machine behaves identically" );
+
+   stateM_freeRelocated( relocated );
+
+   return 0;
+}
+
+static bool compareKeyboardChar( void *ch, struct event *event )
+{
+   return (intptr_t)ch == (intptr_t)event->data;
+}
@@ -0,0 +1,255 @@
+/* 
+ * Copyright (c) 2013 Andreas Misje
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#include "stateMachine.h"
+#include "stateMachineMinimise.h"
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+/* This test minimises a generated-looking state machine that recognises
+ * "ab", "cb", "xy" and "zy" followed by a newline. The paths 'a', 'ab' and
+ * 'c', 'cb' are equivalent, and are merged. 'xyDone' and 'zyDone' carry
+ * different data, so neither they nor the states leading to them may be
+ * merged. 'ping' and 'pong' toggle between each other on 'p' and have the
+ * same entry action, but merging them would turn the toggle into a
+ * self-loop that skips the entry action. Both machines are run on the same
+ * input, and must stay in corresponding states.
+ */
+
+enum eventTypes
+{
+   Event_keyboard,
+};
+
+static bool compareKeyboardChar( void *ch, struct event *event );
+static void countEntry( void *stateData, struct event *event );
+
+static int numEntries;
+
+static struct state idle, a, ab, c, cb, x, xy, xyDone, z, zy, zyDone, ping,
+                    pong, errorState;
+
+#define ON_CHAR( ch, next ) { Event_keyboard, (void *)(intptr_t)( ch ), \
+   &compareKeyboardChar, NULL, ( next ) }
+
+static struct state
+
+idle =
+{
+   .transitions = (struct transition[]) {
+      ON_CHAR( 'a', &a ),
+      ON_CHAR( 'c', &c ),
+      ON_CHAR( 'x', &x ),
+      ON_CHAR( 'z', &z ),
+      ON_CHAR( 'p', &ping ),
+   },
+   .numTransitions = 5,
+},
+
+   a =
+{
+   .transitions = (struct transition[]) { ON_CHAR( 'b', &ab ) },
+   .numTransitions = 1,
+},
+
+   ab =
+{
+   .transitions = (struct transition[]) { ON_CHAR( '\n', &idle ) },
+   .numTransitions = 1,
+},
+
+   c =
+{
+   .transitions = (struct transition[]) { ON_CHAR( 'b', &cb ) },
+   .numTransitions = 1,
+},
+
+   cb =
+{
+   .transitions = (struct transition[]) { ON_CHAR( '\n', &idle ) },
+   .numTransitions = 1,
+},
+
+   x =
+{
+   .transitions = (struct transition[]) { ON_CHAR( 'y', &xy ) },
+   .numTransitions = 1,
+},
+
+   xy =
+{
+   .transitions = (struct transition[]) { ON_CHAR( '\n', &xyDone ) },
+   .numTransitions = 1,
+},
+
+   xyDone =
+{
+   .data = "xy",
+   .transitions = (struct transition[]) { ON_CHAR( '\n', &idle ) },
+   .numTransitions = 1,
+},
+
+   z =
+{
+   .transitions = (struct transition[]) { ON_CHAR( 'y', &zy ) },
+   .numTransitions = 1,
+},
+
+   zy =
+{
+   .transitions = (struct transition[]) { ON_CHAR( '\n', &zyDone ) },
+   .numTransitions = 1,
+},
+
+   zyDone =
+{
+   .data = "zy",
+   .transitions = (struct transition[]) { ON_CHAR( '\n', &idle ) },
+   .numTransitions = 1,
+},
+
+   ping =
+{
+   .transitions = (struct transition[]) {
+      ON_CHAR( 'p', &pong ),
+      ON_CHAR( '\n', &idle ),
+   },
+   .numTransitions = 2,
+   .entryAction = &countEntry,
+},
+
+   pong =
+{
+   .transitions = (struct transition[]) {
+      ON_CHAR( 'p', &ping ),
+      ON_CHAR( '\n', &idle ),
+   },
+   .numTransitions = 2,
+   .entryAction = &countEntry,
+},
+
+   errorState =
+{
+   .data = "error",
+};
+
+int main()
+{
+   struct state *states[] = { &idle, &a, &ab, &c, &cb, &x, &xy, &xyDone, &z,
+      &zy, &zyDone, &ping, &pong, &errorState };
+   struct stateMachineDefinition definition = {
+      .states = states,
+      .numStates = sizeof( states ) / sizeof( states[ 0 ] ),
+      .initialState = &idle,
+      .errorState = &errorState,
+   };
+   struct minimisedStateMachine *minimised;
+   struct stateMachine original, merged;
+   const char *input = "ab\ncb\nxy\n\nzy\n\nppp\nab\n";
+   size_t n;
+
+   if ( stateM_minimise( &definition ) )
+   {
+      fputs( "Unverified definition was minimised\n", stderr );
+      exit( 1 );
+   }
+
+   if ( stateM_validate( &definition, NULL, NULL ) )
+   {
+      fputs( "Definition is invalid\n", stderr );
+      exit( 2 );
+   }
+
+   minimised = stateM_minimise( &definition );
+   if ( !minimised )
+   {
+      fputs( "Could not minimise state machine\n", stderr );
+      exit( 3 );
+   }
+
+   /* 'c' and 'cb' are merged into 'a' and 'ab': */
+   if ( minimised->definition.numStates != definition.numStates - 2 ||
+         minimised->stateMap[ c.id ] != minimised->stateMap[ a.id ] ||
+         minimised->stateMap[ cb.id ] != minimised->stateMap[ ab.id ] ||
+         minimised->stateMap[ x.id ] == minimised->stateMap[ z.id ] )
+   {
+      fprintf( stderr, "Unexpected number of minimised states: %zu\n",
+            minimised->definition.numStates );
+      exit( 4 );
+   }
+   puts( "Equivalent states merged" );
+
+   if ( minimised->stateMap[ ping.id ] == minimised->stateMap[ pong.id ] )
+   {
+      fputs( "States with a transition between them were merged\n",
+            stderr );
+      exit( 7 );
+   }
+   puts( "States with a transition between them kept apart" );
+
+   if ( stateM_validate( &minimised->definition, NULL, NULL ) )
+   {
+      fputs( "Minimised definition is invalid\n", stderr );
+      exit( 5 );
+   }
+
+   stateM_init( &original, definition.initialState, definition.errorState );
+   stateM_init( &merged, minimised->definition.initialState,
+         minimised->definition.errorState );
+
+   for ( n = 0; input[ n ]; ++n )
+   {
+      struct event event = { Event_keyboard, (void *)(intptr_t)input[ n ] };
+      int originalRes, mergedRes, originalEntries;
+
+      numEntries = 0;
+      originalRes = stateM_handleEvent( &original, &event );
+      originalEntries = numEntries;
+      mergedRes = stateM_handleEvent( &merged, &event );
+
+      if ( originalRes != mergedRes || numEntries != 2 * originalEntries ||
+            minimised->stateMap[ stateM_currentState( &original )->id ] !=
+            stateM_currentState( &merged )->id || stateM_currentState(
+               &original )->data != stateM_currentState( &merged )->data )
+      {
+         fprintf( stderr, "Minimised state machine differs at '%c'\n",
+               input[ n ] );
+         exit( 6 );
+      }
+   }
+   puts( "Minimised state machine behaves identically" );
+
+   stateM_freeMinimised( minimised );
+
+   return 0;
+}
+
+static bool compareKeyboardChar( void *ch, struct event *event )
+{
+   return (intptr_t)ch == (intptr_t)event->data;
+}
+
+static void countEntry( void *stateData, struct event *event )
+{
+   ++numEntries;
+}
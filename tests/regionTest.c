@@ -0,0 +1,256 @@
+/* 
+ * Copyright (c) 2013 Andreas Misje
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#include "stateMachine.h"
+#include "stateMachineCompile.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* This test uses an orthogonal state with two regions to test that events
+ * are passed to all regions, that the regions' states are entered and left
+ * in the right order, and that a transition out of a region leaves the
+ * orthogonal state. The same events are then passed to a compiled copy of
+ * the state machine.
+ *
+ *          +-------------------[session]--------------(ping)-+
+ *          |  +-[connection]-------------------------+       |
+ *   (open) |  | +------------+  (up)   +-----------+ |       |
+ * idle ------>| | connecting |-------->| connected | |<------+
+ *          |  | +------------+<--------+-----------+ |
+ *          |  |                (down)                |
+ *          |  +--------------------------------------+
+ *          |  +-[auth]-------------------------------+
+ *          |  | +------+  (login)  +--------+ (kick) |    +--------+
+ *          |  | | anon |---------->| authed |-------------->| closed |
+ *          |  | +------+           +--------+        |    +--------+
+ *          |  +--------------------------------------+         ^
+ *          +--------------------------(close)------------------+
+ */
+
+enum eventTypes
+{
+   Event_open,
+   Event_up,
+   Event_down,
+   Event_login,
+   Event_kick,
+   Event_ping,
+   Event_close,
+};
+
+static void entryAction( void *stateData, struct event *event );
+static void exitAction( void *stateData, struct event *event );
+
+static struct state idle, session, connection, connecting, connected, auth,
+                    anon, authed, closed, errorState;
+
+static struct state
+
+idle =
+{
+   .data = "idle",
+   .transitions = (struct transition[]) {
+      { Event_open, NULL, NULL, NULL, &session },
+   },
+   .numTransitions = 1,
+},
+
+   session =
+{
+   .data = "session",
+   .entryAction = &entryAction,
+   .exitAction = &exitAction,
+   .transitions = (struct transition[]) {
+      { Event_ping, NULL, NULL, NULL, &session },
+      { Event_close, NULL, NULL, NULL, &closed },
+   },
+   .numTransitions = 2,
+   .regions = (struct state *[]){ &connection, &auth },
+   .numRegions = 2,
+},
+
+   connection =
+{
+   .data = "connection",
+   .parentState = &session,
+   .entryState = &connecting,
+},
+
+   connecting =
+{
+   .data = "connecting",
+   .entryAction = &entryAction,
+   .exitAction = &exitAction,
+   .parentState = &connection,
+   .transitions = (struct transition[]) {
+      { Event_up, NULL, NULL, NULL, &connected },
+   },
+   .numTransitions = 1,
+},
+
+   connected =
+{
+   .data = "connected",
+   .entryAction = &entryAction,
+   .exitAction = &exitAction,
+   .parentState = &connection,
+   .transitions = (struct transition[]) {
+      { Event_down, NULL, NULL, NULL, &connecting },
+   },
+   .numTransitions = 1,
+},
+
+   auth =
+{
+   .data = "auth",
+   .parentState = &session,
+   .entryState = &anon,
+},
+
+   anon =
+{
+   .data = "anon",
+   .entryAction = &entryAction,
+   .exitAction = &exitAction,
+   .parentState = &auth,
+   .transitions = (struct transition[]) {
+      { Event_login, NULL, NULL, NULL, &authed },
+   },
+   .numTransitions = 1,
+},
+
+   authed =
+{
+   .data = "authed",
+   .entryAction = &entryAction,
+   .exitAction = &exitAction,
+   .parentState = &auth,
+   .transitions = (struct transition[]) {
+      { Event_kick, NULL, NULL, NULL, &closed },
+   },
+   .numTransitions = 1,
+},
+
+   closed =
+{
+   .data = "closed",
+   .entryAction = &entryAction,
+},
+
+   errorState =
+{
+   .data = "error",
+};
+
+static char actionLog[ 128 ];
+
+static void expect( struct stateMachine *fsm, int eventType,
+      int expectedRes, struct state *expectedConnection,
+      struct state *expectedAuth, const char *expectedLog )
+{
+   actionLog[ 0 ] = '\0';
+   int res = stateM_handleEvent( fsm, &(struct event){ eventType, NULL } );
+
+   if ( res != expectedRes || stateM_regionState( fsm, 0 ) !=
+         expectedConnection || stateM_regionState( fsm, 1 ) != expectedAuth
+         || strcmp( actionLog, expectedLog ) )
+   {
+      fprintf( stderr, "Event %d: got %d with actions \"%s\", expected %d "
+            "with actions \"%s\"\n", eventType, res, actionLog, expectedRes,
+            expectedLog );
+      exit( 1 );
+   }
+}
+
+static void runSession( struct stateMachine *fsm )
+{
+   expect( fsm, Event_open, stateM_stateChanged, &connecting, &anon,
+         "+session+connecting+anon" );
+   expect( fsm, Event_up, stateM_stateChanged, &connected, &anon,
+         "-connecting+connected" );
+   expect( fsm, Event_login, stateM_stateChanged, &connected, &authed,
+         "-anon+authed" );
+   /* Not handled by any region. Handled by the orthogonal state: */
+   expect( fsm, Event_ping, stateM_stateLoopSelf, &connected, &authed, "" );
+   expect( fsm, Event_down, stateM_stateChanged, &connecting, &authed,
+         "-connected+connecting" );
+   expect( fsm, Event_kick, stateM_finalStateReached, NULL, NULL,
+         "-connecting-authed-session+closed" );
+}
+
+int main()
+{
+   struct stateMachineDefinition definition = {
+      .states = (struct state *[]){ &idle, &session, &connection,
+         &connecting, &connected, &auth, &anon, &authed, &closed,
+         &errorState },
+      .numStates = 10,
+      .initialState = &idle,
+      .errorState = &errorState,
+   };
+   struct compiledStateMachine *compiled;
+   struct stateMachine fsm;
+
+   stateM_init( &fsm, &idle, &errorState );
+   runSession( &fsm );
+   puts( "Regions entered and left" );
+
+   if ( stateM_validate( &definition, NULL, NULL ) || !( compiled =
+            stateM_compile( &definition ) ) )
+   {
+      fputs( "Could not compile state machine with regions\n", stderr );
+      exit( 3 );
+   }
+
+   stateM_initCompiled( &fsm, compiled );
+   runSession( &fsm );
+   stateM_freeCompiled( compiled );
+   puts( "Compiled regions entered and left" );
+
+   /* Starting inside a region makes the orthogonal state current: */
+   stateM_init( &fsm, &authed, &errorState );
+   if ( stateM_currentState( &fsm ) != &session || stateM_regionState( &fsm,
+            0 ) != &connecting || stateM_regionState( &fsm, 1 ) != &authed )
+   {
+      fputs( "Unexpected states after initialising inside a region\n",
+            stderr );
+      exit( 2 );
+   }
+   expect( &fsm, Event_close, stateM_finalStateReached, NULL, NULL,
+         "-connecting-authed-session+closed" );
+   puts( "Initial state inside region handled" );
+
+   return 0;
+}
+
+static void entryAction( void *stateData, struct event *event )
+{
+   strcat( actionLog, "+" );
+   strcat( actionLog, (const char *)stateData );
+}
+
+static void exitAction( void *stateData, struct event *event )
+{
+   strcat( actionLog, "-" );
+   strcat( actionLog, (const char *)stateData );
+}
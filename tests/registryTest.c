@@ -0,0 +1,194 @@
+/* 
+ * Copyright (c) 2013 Andreas Misje
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#include "stateMachine.h"
+#include "stateMachineRegistry.h"
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+/* This test registers a few thousand state machines in bulk, dispatches
+ * events to them by key from two threads at once, and unregisters half of
+ * them. Every state machine toggles between two states on every event, so
+ * lost or duplicated events are detected. Finally, an action looks up its
+ * own state machine in the registry while it handles an event passed
+ * through the registry.
+ */
+
+#define NUM_MACHINES 5000
+
+enum eventTypes
+{
+   Event_toggle,
+   Event_find,
+};
+
+static void findSelf( void *currentStateData, struct event *event,
+      void *newStateData );
+
+static struct state on, off, errorState;
+
+static struct state
+
+on =
+{
+   .transitions = (struct transition[]) {
+      { Event_toggle, NULL, NULL, NULL, &off },
+      { Event_find, NULL, NULL, &findSelf, &on },
+   },
+   .numTransitions = 2,
+},
+
+   off =
+{
+   .transitions = (struct transition[]) {
+      { Event_toggle, NULL, NULL, NULL, &on },
+   },
+   .numTransitions = 1,
+},
+
+   errorState =
+{
+   .data = "error",
+};
+
+static struct stateMachineRegistry *registry;
+static struct stateMachine machines[ NUM_MACHINES ];
+static uint64_t keys[ NUM_MACHINES ];
+static struct stateMachine *found;
+
+/* Toggles every state machine three times: */
+static void *toggleAll( void *arg )
+{
+   size_t n, round;
+
+   for ( round = 0; round < 3; ++round )
+      for ( n = 0; n < NUM_MACHINES; ++n )
+         if ( stateM_registryHandleEvent( registry, keys[ n ], &(struct
+                     event){ Event_toggle, NULL } ) != stateM_stateChanged )
+         {
+            fputs( "Could not dispatch by key\n", stderr );
+            exit( 3 );
+         }
+
+   return NULL;
+}
+
+int main()
+{
+   struct stateMachine *pointers[ NUM_MACHINES ];
+   pthread_t thread;
+   size_t n;
+
+   registry = stateM_createRegistry();
+   for ( n = 0; n < NUM_MACHINES; ++n )
+   {
+      stateM_init( &machines[ n ], &off, &errorState );
+      /* Session-id-like keys: */
+      keys[ n ] = 0x5e55000000000000ULL + n * 7919;
+      pointers[ n ] = &machines[ n ];
+   }
+
+   if ( stateM_registryInsertMany( registry, keys, pointers, NUM_MACHINES )
+         != NUM_MACHINES || stateM_registryInsert( registry, keys[ 0 ],
+            &machines[ 1 ] ) || stateM_registrySize( registry ) !=
+         NUM_MACHINES )
+   {
+      fputs( "Could not register state machines\n", stderr );
+      exit( 1 );
+   }
+
+   for ( n = 0; n < NUM_MACHINES; ++n )
+   {
+      if ( stateM_registryFind( registry, keys[ n ] ) != &machines[ n ] )
+      {
+         fputs( "State machine not found\n", stderr );
+         exit( 2 );
+      }
+   }
+   puts( "State machines registered" );
+
+   /* Six toggles in total: */
+   pthread_create( &thread, NULL, &toggleAll, NULL );
+   toggleAll( NULL );
+   pthread_join( thread, NULL );
+
+   for ( n = 0; n < NUM_MACHINES; ++n )
+   {
+      if ( stateM_currentState( &machines[ n ] ) != &off )
+      {
+         fputs( "Events were lost\n", stderr );
+         exit( 4 );
+      }
+   }
+   puts( "Events dispatched by key from two threads" );
+
+   /* Unregister every other state machine: */
+   uint64_t evenKeys[ NUM_MACHINES / 2 ];
+   for ( n = 0; n < NUM_MACHINES / 2; ++n )
+      evenKeys[ n ] = keys[ n * 2 ];
+
+   if ( stateM_registryRemoveMany( registry, evenKeys, NUM_MACHINES / 2 ) !=
+         NUM_MACHINES / 2 || stateM_registryRemove( registry, keys[ 0 ] ) ||
+         stateM_registrySize( registry ) != NUM_MACHINES / 2 )
+   {
+      fputs( "Could not unregister state machines\n", stderr );
+      exit( 5 );
+   }
+
+   for ( n = 0; n < NUM_MACHINES; ++n )
+   {
+      struct stateMachine *expected = n % 2 ? &machines[ n ] : NULL;
+
+      if ( stateM_registryFind( registry, keys[ n ] ) != expected ||
+            ( !expected && stateM_registryHandleEvent( registry, keys[ n ],
+               &(struct event){ Event_toggle, NULL } ) != stateM_errArg ) )
+      {
+         fputs( "Unexpected state machine after unregistering\n", stderr );
+         exit( 6 );
+      }
+   }
+   puts( "State machines unregistered" );
+
+   /* keys[ 1 ] was toggled six times, and is 'off'. Switch it on: */
+   stateM_registryHandleEvent( registry, keys[ 1 ], &(struct event){
+         Event_toggle, NULL } );
+   if ( stateM_registryHandleEvent( registry, keys[ 1 ], &(struct event){
+            Event_find, &keys[ 1 ] } ) != stateM_stateLoopSelf || found !=
+         &machines[ 1 ] )
+   {
+      fputs( "Action could not use the registry\n", stderr );
+      exit( 7 );
+   }
+   puts( "Actions may use the registry" );
+
+   stateM_freeRegistry( registry );
+
+   return 0;
+}
+
+static void findSelf( void *currentStateData, struct event *event,
+      void *newStateData )
+{
+   found = stateM_registryFind( registry, *(uint64_t *)event->data );
+}
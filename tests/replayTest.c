@@ -0,0 +1,205 @@
+/* 
+ * Copyright (c) 2013 Andreas Misje
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#include "stateMachine.h"
+#include "stateMachineCompile.h"
+#include "stateMachineReplay.h"
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+/* A journal of events for many state machines is replayed with different
+ * numbers of threads. Final states and visit counts must be the same as
+ * when every state machine is passed its events one by one.
+ */
+
+#define NUM_MACHINES 5000
+#define NUM_ENTRIES 300000
+
+enum eventTypes
+{
+   Event_toggle,
+   Event_work,
+   Event_finish,
+   Event_fail,
+};
+
+static struct state off, on, busy, done, errorState;
+
+static struct state
+
+off =
+{
+   .transitions = (struct transition[]) {
+      { Event_toggle, NULL, NULL, NULL, &on },
+   },
+   .numTransitions = 1,
+},
+
+   on =
+{
+   .transitions = (struct transition[]) {
+      { Event_toggle, NULL, NULL, NULL, &off },
+      { Event_work, NULL, NULL, NULL, &busy },
+      { Event_finish, NULL, NULL, NULL, &done },
+      { Event_fail, NULL, NULL, NULL, &errorState },
+   },
+   .numTransitions = 4,
+},
+
+   busy =
+{
+   .transitions = (struct transition[]) {
+      { Event_work, NULL, NULL, NULL, &busy },
+      { Event_toggle, NULL, NULL, NULL, &on },
+   },
+   .numTransitions = 2,
+},
+
+   done =
+{
+   .data = "done",
+},
+
+   errorState =
+{
+   .data = "error",
+};
+
+/* Machine ids are sparse, but in the same order as the machines: */
+static uint64_t machineId( size_t machine )
+{
+   return (uint64_t)machine * 7919 << 20 | 13;
+}
+
+static void compare( struct replayResult *result, struct stateMachine
+      *machines, uint64_t *numVisits, unsigned numThreads )
+{
+   size_t i;
+
+   if ( !result || result->numMachines != NUM_MACHINES ||
+         result->numStates != 5 )
+   {
+      fprintf( stderr, "Replay with %u threads failed\n", numThreads );
+      exit( 2 );
+   }
+
+   for ( i = 0; i < NUM_MACHINES; ++i )
+   {
+      if ( result->machineIds[ i ] != machineId( i ) ||
+            result->finalStates[ i ] != machines[ i ].currentState )
+      {
+         fprintf( stderr, "Machine %zu differs with %u threads\n", i,
+               numThreads );
+         exit( 3 );
+      }
+   }
+
+   for ( i = 0; i < 5; ++i )
+   {
+      if ( result->numVisits[ i ] != numVisits[ i ] )
+      {
+         fprintf( stderr, "Visits to state %zu differ with %u threads\n", i,
+               numThreads );
+         exit( 4 );
+      }
+   }
+}
+
+int main()
+{
+   struct stateMachineDefinition definition = {
+      .states = (struct state *[]){ &off, &on, &busy, &done, &errorState },
+      .numStates = 5,
+      .initialState = &off,
+      .errorState = &errorState,
+   };
+   static struct journalEntry journal[ NUM_ENTRIES ];
+   static struct stateMachine machines[ NUM_MACHINES ];
+   static const unsigned threadCounts[] = { 1, 3, 8 };
+   uint64_t numVisits[ 5 ] = { 0 };
+   uint32_t random = 1;
+   size_t i;
+
+   stateM_validate( &definition, NULL, NULL );
+   struct compiledStateMachine *compiled = stateM_compile( &definition );
+   if ( !compiled )
+   {
+      fputs( "Could not compile state machine\n", stderr );
+      exit( 1 );
+   }
+
+   /* Mostly toggling and work. Some machines finish or fail: */
+   for ( i = 0; i < NUM_ENTRIES; ++i )
+   {
+      random = random * 1103515245 + 12345;
+      size_t machine = ( random >> 8 ) % NUM_MACHINES;
+      random = random * 1103515245 + 12345;
+      unsigned roll = ( random >> 8 ) % 1000;
+
+      journal[ i ].machineId = machineId( machine );
+      journal[ i ].event.type = roll < 1 ? Event_fail : roll < 3 ?
+         Event_finish : roll < 500 ? Event_toggle : Event_work;
+   }
+
+   /* Replay the journal one event at a time: */
+   for ( i = 0; i < NUM_MACHINES; ++i )
+   {
+      stateM_initCompiled( &machines[ i ], compiled );
+      ++numVisits[ off.id ];
+   }
+
+   for ( i = 0; i < NUM_ENTRIES; ++i )
+   {
+      struct stateMachine *fsm = &machines[ ( journal[ i ].machineId >> 20 )
+         / 7919 ];
+      int ret = stateM_handleEvent( fsm, &journal[ i ].event );
+
+      if ( ret == stateM_stateChanged || ret == stateM_stateLoopSelf ||
+            ret == stateM_finalStateReached || ret ==
+            stateM_errorStateReached )
+         ++numVisits[ fsm->currentState->id ];
+   }
+
+   for ( i = 0; i < sizeof( threadCounts ) / sizeof( threadCounts[ 0 ] );
+         ++i )
+   {
+      struct replayResult *result = stateM_replay( compiled, journal,
+            NUM_ENTRIES, threadCounts[ i ] );
+      compare( result, machines, numVisits, threadCounts[ i ] );
+      stateM_freeReplay( result );
+   }
+   puts( "Parallel replays match sequential replay" );
+
+   if ( stateM_replay( compiled, journal, NUM_ENTRIES,
+            STATEM_MAX_REPLAY_THREADS + 1 ) || stateM_replay( compiled,
+            journal, NUM_ENTRIES, UINT_MAX ) )
+   {
+      fputs( "Replayed with too many threads\n", stderr );
+      exit( 5 );
+   }
+   puts( "Too many threads rejected" );
+
+   stateM_freeCompiled( compiled );
+
+   return 0;
+}
@@ -0,0 +1,236 @@
+/* 
+ * Copyright (c) 2013 Andreas Misje
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#include "stateMachine.h"
+#include "stateMachineRing.h"
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+/* Connections copy everything arriving on a pipe to a socket, in small
+ * chunks. Reads and writes are queued by the states' entry actions, and
+ * completions are dispatched in batches, so far fewer system calls are
+ * made than events are handled.
+ */
+
+#define NUM_CONNECTIONS 32
+#define CHUNK_SIZE 16
+
+enum eventTypes
+{
+   Event_start,
+   Event_read,
+   Event_written,
+};
+
+struct connection
+{
+   struct stateMachine stateMachine;
+   char buffer[ CHUNK_SIZE ];
+   struct ringRequest read;
+   struct ringRequest write;
+   int peer;
+};
+
+static struct stateMachineRing *ring;
+static size_t numClosed;
+
+static struct connection *connectionOf( struct event *event )
+{
+   return ( (struct ringRequest *)event->data )->data;
+}
+
+static void queue( bool queued )
+{
+   if ( !queued )
+   {
+      perror( "Could not queue request" );
+      exit( 2 );
+   }
+}
+
+static void startRead( void *stateData, struct event *event )
+{
+   queue( stateM_ringRead( ring, &connectionOf( event )->read ) );
+}
+
+static void startWrite( void *stateData, struct event *event )
+{
+   struct connection *connection = connectionOf( event );
+   connection->write.size = (unsigned)connection->read.result;
+   queue( stateM_ringWrite( ring, &connection->write ) );
+}
+
+static void close_( void *stateData, struct event *event )
+{
+   ++numClosed;
+}
+
+static bool dataRead( void *condition, struct event *event )
+{
+   return ( (struct ringRequest *)event->data )->result > 0;
+}
+
+static bool allWritten( void *condition, struct event *event )
+{
+   struct ringRequest *write = event->data;
+   return write->result == (int)write->size;
+}
+
+static struct state idle, reading, writing, closed, errorState;
+
+static struct state
+
+idle =
+{
+   .transitions = (struct transition[]) {
+      { Event_start, NULL, NULL, NULL, &reading },
+   },
+   .numTransitions = 1,
+},
+
+   reading =
+{
+   .transitions = (struct transition[]) {
+      { Event_read, NULL, &dataRead, NULL, &writing },
+      { Event_read, NULL, NULL, NULL, &closed },
+   },
+   .numTransitions = 2,
+   .entryAction = &startRead,
+},
+
+   writing =
+{
+   .transitions = (struct transition[]) {
+      { Event_written, NULL, &allWritten, NULL, &reading },
+      { Event_written, NULL, NULL, NULL, &errorState },
+   },
+   .numTransitions = 2,
+   .entryAction = &startWrite,
+},
+
+   closed =
+{
+   .entryAction = &close_,
+},
+
+   errorState =
+{
+   .data = "error",
+};
+
+int main()
+{
+   static struct connection connections[ NUM_CONNECTIONS ];
+   char message[ 64 ], received[ 64 ];
+   size_t n, numEvents = 0;
+
+   ring = stateM_createRing( NUM_CONNECTIONS );
+   if ( !ring )
+   {
+      if ( errno == ENOSYS || errno == EPERM )
+      {
+         puts( "io_uring not available, test skipped" );
+         return 0;
+      }
+
+      perror( "Could not create ring" );
+      exit( 1 );
+   }
+
+   for ( n = 0; n < NUM_CONNECTIONS; ++n )
+   {
+      struct connection *connection = &connections[ n ];
+      int input[ 2 ], output[ 2 ];
+
+      if ( pipe( input ) || socketpair( AF_UNIX, SOCK_STREAM, 0, output ) )
+      {
+         perror( "Could not create pipe or socket" );
+         exit( 3 );
+      }
+
+      /* The whole message is in the pipe before the connection starts: */
+      int length = snprintf( message, sizeof( message ),
+            "Message number %zu, longer than one chunk", n );
+      if ( write( input[ 1 ], message, (size_t)length ) != length )
+      {
+         perror( "Could not write message" );
+         exit( 4 );
+      }
+      close( input[ 1 ] );
+
+      stateM_init( &connection->stateMachine, &idle, &errorState );
+      connection->read = (struct ringRequest){ &connection->stateMachine,
+         Event_read, input[ 0 ], connection->buffer, CHUNK_SIZE, 0,
+         connection };
+      connection->write = (struct ringRequest){ &connection->stateMachine,
+         Event_written, output[ 0 ], connection->buffer, 0, 0, connection };
+      connection->peer = output[ 1 ];
+
+      stateM_handleEvent( &connection->stateMachine, &(struct event){
+            Event_start, &connection->read } );
+   }
+
+   while ( numClosed < NUM_CONNECTIONS )
+   {
+      int numDispatched = stateM_ringDispatch( ring, 1 );
+      if ( numDispatched < 0 )
+      {
+         perror( "Could not dispatch completions" );
+         exit( 5 );
+      }
+      numEvents += (size_t)numDispatched;
+   }
+
+   for ( n = 0; n < NUM_CONNECTIONS; ++n )
+   {
+      int length = snprintf( message, sizeof( message ),
+            "Message number %zu, longer than one chunk", n );
+      if ( recv( connections[ n ].peer, received, sizeof( received ),
+               MSG_DONTWAIT ) != length || memcmp( message, received,
+               (size_t)length ) )
+      {
+         fputs( "Message not copied\n", stderr );
+         exit( 6 );
+      }
+
+      close( connections[ n ].read.fd );
+      close( connections[ n ].write.fd );
+      close( connections[ n ].peer );
+   }
+   puts( "Messages copied through the ring" );
+
+   printf( "%zu events, %zu system calls\n", numEvents,
+         ring->numEnterCalls );
+   if ( ring->numEnterCalls * 4 > numEvents )
+   {
+      fputs( "Completions not batched\n", stderr );
+      exit( 7 );
+   }
+
+   stateM_freeRing( ring );
+
+   return 0;
+}
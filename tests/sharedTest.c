@@ -0,0 +1,234 @@
+/* 
+ * Copyright (c) 2013 Andreas Misje
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#include "stateMachine.h"
+#include "stateMachineShared.h"
+#include <errno.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+/* A parent and a child process pass 'tick' events to the same shared state
+ * machine, which cycles through three states, while reading its state.
+ * No tick may be lost. A deferred event with an integer payload must
+ * survive being stored in shared memory. An instance left behind by a
+ * process that died while saving it must still be readable, and must be
+ * taken over in the state it had before. Finally, a segment must not be
+ * mapped with a different definition.
+ */
+
+enum eventTypes
+{
+   Event_tick,
+   Event_pause,
+   Event_resume,
+};
+
+static struct state one, two, three, paused, errorState;
+
+static struct state
+
+one =
+{
+   .transitions = (struct transition[]) {
+      { Event_tick, NULL, NULL, NULL, &two },
+      { Event_pause, NULL, NULL, NULL, &paused },
+   },
+   .numTransitions = 2,
+},
+
+   two =
+{
+   .transitions = (struct transition[]) {
+      { Event_tick, NULL, NULL, NULL, &three },
+      { Event_pause, NULL, NULL, NULL, &paused },
+   },
+   .numTransitions = 2,
+},
+
+   three =
+{
+   .transitions = (struct transition[]) {
+      { Event_tick, NULL, NULL, NULL, &one },
+      { Event_pause, NULL, NULL, NULL, &paused },
+   },
+   .numTransitions = 2,
+},
+
+   paused =
+{
+   .transitions = (struct transition[]) {
+      { Event_resume, NULL, NULL, NULL, &one },
+   },
+   .numTransitions = 1,
+   .deferredEvents = (int[]){ Event_tick },
+   .numDeferredEvents = 1,
+},
+
+   errorState =
+{
+   .data = "error",
+};
+
+static struct stateMachineDefinition definition = {
+   .states = (struct state *[]){ &one, &two, &three, &paused, &errorState },
+   .numStates = 5,
+   .initialState = &one,
+   .errorState = &errorState,
+};
+
+static void tick( struct sharedStateMachines *shared, size_t count )
+{
+   size_t n;
+
+   for ( n = 0; n < count; ++n )
+   {
+      struct state *state = stateM_sharedState( shared, 1, NULL );
+
+      if ( state != &one && state != &two && state != &three )
+      {
+         fputs( "Read an invalid state\n", stderr );
+         exit( 3 );
+      }
+
+      stateM_handleSharedEvent( shared, 1, &(struct event){ Event_tick,
+            NULL } );
+   }
+}
+
+int main()
+{
+   struct sharedStateMachines *shared;
+   struct state *previous;
+   pid_t child;
+   int status;
+
+   if ( stateM_validate( &definition, NULL, NULL ) )
+   {
+      fputs( "Definition is invalid\n", stderr );
+      exit( 1 );
+   }
+
+   shared = stateM_createShared( NULL, &definition, 2 );
+   if ( !shared && errno == ENOSYS )
+   {
+      puts( "Shared memory not supported, skipped" );
+      return 0;
+   }
+   else if ( !shared )
+   {
+      perror( "Could not create shared state machines" );
+      exit( 2 );
+   }
+
+   /* 2000 ticks, three states: */
+   child = fork();
+   if ( child == 0 )
+   {
+      tick( shared, 1000 );
+      _exit( 0 );
+   }
+
+   tick( shared, 1000 );
+   waitpid( child, &status, 0 );
+
+   if ( !WIFEXITED( status ) || WEXITSTATUS( status ) || stateM_sharedState(
+            shared, 1, &previous ) != &three || previous != &two ||
+         stateM_sharedState( shared, 0, NULL ) != &one )
+   {
+      fputs( "Ticks were lost\n", stderr );
+      exit( 4 );
+   }
+   puts( "Processes took turns handling events" );
+
+   stateM_handleSharedEvent( shared, 0, &(struct event){ Event_pause, NULL
+         } );
+   if ( stateM_handleSharedEvent( shared, 0, &(struct event){ Event_tick,
+            (void *)(intptr_t)42 } ) != stateM_eventDeferred ||
+         stateM_handleSharedEvent( shared, 0, &(struct event){ Event_resume,
+            NULL } ) != stateM_stateChanged || stateM_sharedState( shared, 0,
+            NULL ) != &two )
+   {
+      fputs( "Deferred event was not kept in shared memory\n", stderr );
+      exit( 5 );
+   }
+   puts( "Deferred events kept in shared memory" );
+
+   /* A child dies while owning instance 0 and saving it, having written
+    * part of the paused state: */
+   child = fork();
+   if ( child == 0 )
+   {
+      struct sharedStateMachine *instance = &shared->segment->instances[ 0 ];
+
+      instance->owner = (uint32_t)getpid();
+      instance->snapshots[ ( instance->sequence >> 1 & 1 ) ^ 1
+         ].currentState = paused.id;
+      ++instance->sequence;
+      _exit( 0 );
+   }
+   waitpid( child, &status, 0 );
+
+   if ( stateM_sharedState( shared, 0, NULL ) != &two )
+   {
+      fputs( "Could not read instance of dead process\n", stderr );
+      exit( 9 );
+   }
+
+   if ( stateM_handleSharedEvent( shared, 0, &(struct event){ Event_tick,
+            NULL } ) != stateM_stateChanged || stateM_sharedState( shared, 0,
+            NULL ) != &three )
+   {
+      fputs( "Instance of dead process not taken over\n", stderr );
+      exit( 8 );
+   }
+
+   /* Restore the state the checks below expect: */
+   stateM_handleSharedEvent( shared, 0, &(struct event){ Event_tick, NULL } );
+   stateM_handleSharedEvent( shared, 0, &(struct event){ Event_tick, NULL } );
+   puts( "Instances of dead processes taken over" );
+
+   /* The same segment cannot be used with a different definition: */
+   struct stateMachineDefinition other = definition;
+   other.initialState = &two;
+   if ( stateM_mapShared( shared->fd, &other ) || errno != EINVAL )
+   {
+      fputs( "Mapped segment with a different definition\n", stderr );
+      exit( 6 );
+   }
+
+   struct sharedStateMachines *again = stateM_mapShared( shared->fd,
+         &definition );
+   if ( !again || stateM_sharedState( again, 0, NULL ) != &two )
+   {
+      fputs( "Could not map segment again\n", stderr );
+      exit( 7 );
+   }
+   puts( "Definitions checked when mapping" );
+
+   stateM_closeShared( again );
+   stateM_closeShared( shared );
+
+   return 0;
+}
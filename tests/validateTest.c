@@ -0,0 +1,196 @@
+/* 
+ * Copyright (c) 2013 Andreas Misje
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#include "stateMachine.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+/* This test ensures that stateM_validate() finds the problems it should,
+ * and that a state machine initialised from a validated definition works.
+ */
+
+enum eventTypes
+{
+   Event_start,
+   Event_stop,
+};
+
+static struct state idle, busy, stray, cycleA, cycleB, orthogonal, region,
+                    errorState;
+
+static struct state
+
+idle =
+{
+   .transitions = (struct transition[]) {
+      { Event_start, NULL, NULL, NULL, &busy },
+      /* Shadowed by the previous transition: */
+      { Event_start, NULL, NULL, NULL, &idle },
+      /* No next state: */
+      { Event_stop, NULL, NULL, NULL, NULL },
+   },
+   .numTransitions = 3,
+},
+
+   busy =
+{
+   .transitions = (struct transition[]) {
+      { Event_stop, NULL, NULL, NULL, &idle },
+   },
+   .numTransitions = 1,
+},
+
+   /* Not reachable from 'idle': */
+   stray =
+{
+   .transitions = (struct transition[]) {
+      { Event_stop, NULL, NULL, NULL, &idle },
+   },
+   .numTransitions = 1,
+},
+
+   cycleA =
+{
+   .parentState = &cycleB,
+},
+
+   cycleB =
+{
+   .parentState = &cycleA,
+},
+
+   /* The second region is missing: */
+   orthogonal =
+{
+   .regions = (struct state *[]){ &region, NULL },
+   .numRegions = 2,
+},
+
+   region =
+{
+   .parentState = &orthogonal,
+},
+
+   errorState =
+{
+   .data = "error",
+};
+
+static int errorCounts[ stateM_orphanHistoryState + 1 ];
+
+static void countError( enum stateM_definitionErrors error,
+      struct state *state, struct transition *transition, void *userData )
+{
+   ++errorCounts[ error ];
+}
+
+static void expectErrors( struct stateMachineDefinition *definition,
+      int expectedErrors, const int *expectedCounts )
+{
+   size_t i;
+   int res;
+
+   for ( i = 0; i <= stateM_orphanHistoryState; ++i )
+      errorCounts[ i ] = 0;
+
+   res = stateM_validate( definition, &countError, NULL );
+   if ( res != expectedErrors || definition->verified != !expectedErrors )
+   {
+      fprintf( stderr, "Expected %d errors, got %d\n", expectedErrors, res );
+      exit( 1 );
+   }
+
+   for ( i = 0; i <= stateM_orphanHistoryState; ++i )
+   {
+      if ( errorCounts[ i ] != expectedCounts[ i ] )
+      {
+         fprintf( stderr, "Expected error %zu %d times, got %d\n", i,
+               expectedCounts[ i ], errorCounts[ i ] );
+         exit( 2 );
+      }
+   }
+}
+
+int main()
+{
+   struct stateMachineDefinition definition = {
+      .states = (struct state *[]){ &idle, &busy, &stray, &errorState },
+      .numStates = 4,
+      .initialState = &idle,
+      .errorState = &errorState,
+   };
+   int expected[ stateM_orphanHistoryState + 1 ] = { 0 };
+
+   expected[ stateM_shadowedTransition ] = 1;
+   expected[ stateM_nullNextState ] = 1;
+   expected[ stateM_unreachableState ] = 1;
+   expectErrors( &definition, 3, expected );
+   puts( "Shadowed, unreachable and incomplete transitions found" );
+
+   /* Fix the problems: */
+   idle.numTransitions = 1;
+   definition.numStates = 2;
+   definition.states[ 1 ] = &errorState;
+   definition.initialState = &busy;
+
+   expected[ stateM_shadowedTransition ] = 0;
+   expected[ stateM_nullNextState ] = 0;
+   expected[ stateM_unreachableState ] = 0;
+   expected[ stateM_unknownState ] = 2;
+   expectErrors( &definition, 2, expected );
+   puts( "Unknown states found" );
+
+   definition.states = (struct state *[]){ &idle, &busy, &errorState };
+   definition.numStates = 3;
+   expected[ stateM_unknownState ] = 0;
+   expectErrors( &definition, 0, expected );
+
+   struct stateMachine fsm;
+   stateM_initWithDefinition( &fsm, &definition );
+   if ( stateM_handleEvent( &fsm, &(struct event){ Event_stop, NULL } ) !=
+         stateM_stateChanged || stateM_currentState( &fsm ) != &idle ||
+         stateM_handleEvent( &fsm, &(struct event){ Event_start, NULL } ) !=
+         stateM_stateChanged || stateM_currentState( &fsm ) != &busy )
+   {
+      fputs( "Validated state machine misbehaved\n", stderr );
+      exit( 3 );
+   }
+   puts( "Validated state machine works" );
+
+   definition.states = (struct state *[]){ &idle, &busy, &cycleA, &cycleB,
+      &errorState };
+   definition.numStates = 5;
+   expected[ stateM_parentStateCycle ] = 2;
+   expectErrors( &definition, 2, expected );
+   puts( "Parent cycles found" );
+
+   definition.states = (struct state *[]){ &orthogonal, &region,
+      &errorState };
+   definition.numStates = 3;
+   definition.initialState = &orthogonal;
+   expected[ stateM_parentStateCycle ] = 0;
+   expected[ stateM_unknownState ] = 1;
+   expectErrors( &definition, 1, expected );
+   puts( "Missing regions found" );
+
+   return 0;
+}
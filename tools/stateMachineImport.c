@@ -0,0 +1,1482 @@
+/* 
+ * Copyright (c) 2013 Andreas Misje
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+/* stateMachineImport: compile a Graphviz DOT description of a state machine
+ * into static C definitions and a precompiled dispatch table.
+ *
+ * Usage: stateMachineImport [-p prefix] input.dot output.c output.h
+ *
+ * The supported DOT subset:
+ *
+ *    digraph keyboard {
+ *       initial = idle;
+ *       error = errorState;
+ *       events = "Event_keyboard Event_tick";
+ *
+ *       subgraph cluster_group {
+ *          entry = idle;
+ *          idle [data = "\"idle\"", entryAction = printEnter];
+ *          h;
+ *       }
+ *
+ *       group -> idle [event = Event_tick];
+ *       idle -> h [event = Event_keyboard, guard = compareKeyboardChar,
+ *          condition = "(void *)'h'", weight = 10];
+ *       errorState;
+ *    }
+ *
+ * Every node is a state. A cluster named "cluster_<state>" makes the nodes
+ * declared in it (with node statements) children of <state>, and its
+ * "entry" attribute sets the state's entry state. Clusters may be nested.
+ * Node attributes: data (a C expression), entryAction, exitAction and defer
+ * (a space-separated list of events). Edge attributes: event, guard,
+ * condition (a C expression), action, pure (true/false) and weight (the
+ * expected relative frequency of the transition). Edges are tried in the
+ * order they appear. Events are emitted as an enum, numbered in the order
+ * given by the "events" graph attribute followed by the order in which
+ * they are first used. Other attributes and "graph", "node" and "edge"
+ * statements are ignored.
+ *
+ * The definition is validated and compiled while importing. States and
+ * transitions are laid out in the order they are expected to be visited:
+ * starting with the initial state, each state is followed by its unplaced
+ * ancestors' and successors' subtrees, most frequent transitions first.
+ * The generated header declares the event and state enums, the definition
+ * (<prefix>_definition) and the compiled state machine (<prefix>_compiled),
+ * which is ready to be passed to stateM_initCompiled().
+ */
+
+#include "stateMachine.h"
+#include "stateMachineCompile.h"
+#include <ctype.h>
+#include <inttypes.h>
+#include <stdarg.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define NONE SIZE_MAX
+
+struct importedState
+{
+   char *name;
+   size_t parent;
+   size_t entry;
+   char *data;
+   char *entryAction;
+   char *exitAction;
+   size_t *deferredEvents;
+   size_t numDeferredEvents;
+   /* Sum of the weights of the transitions leading to this state: */
+   unsigned long heat;
+   /* Position in the generated layout: */
+   size_t order;
+};
+
+struct importedTransition
+{
+   size_t source;
+   size_t target;
+   size_t event;
+   char *guard;
+   char *condition;
+   char *action;
+   bool pure;
+   unsigned long weight;
+   int line;
+};
+
+enum tokenTypes
+{
+   Token_end,
+   Token_id,
+   Token_string,
+   Token_punctuation,
+};
+
+struct attribute
+{
+   char *key;
+   char *value;
+};
+
+struct token
+{
+   enum tokenTypes type;
+   char *text;
+   int line;
+};
+
+struct import
+{
+   const char *fileName;
+   char *input;
+   char *cursor;
+   int line;
+   struct token token;
+
+   struct importedState *states;
+   size_t numStates;
+   struct importedTransition *transitions;
+   size_t numTransitions;
+   char **events;
+   size_t numEvents;
+   char *initialState;
+   char *errorState;
+   char *prefix;
+
+   /* Transition indices grouped by source state, in source order: */
+   size_t *transitionsBySource;
+   /* Index of every state's first transition in #transitionsBySource: */
+   size_t *firstBySource;
+
+   /* Imported state indices in layout order: */
+   size_t *layout;
+   size_t numPlaced;
+
+   /* The definition built in layout order while importing: */
+   struct stateMachineDefinition definition;
+   struct state *builtStates;
+   struct transition *builtTransitions;
+   /* Imported transition index of every built transition: */
+   size_t *builtTransitionSources;
+   size_t numErrors;
+};
+
+static void fail( struct import *import, int line, const char *format,
+      ... );
+static void *allocate( size_t size );
+static void *grow( void *array, size_t count, size_t size );
+static char *duplicate( const char *text, size_t length );
+static char *readFile( const char *fileName );
+
+static void nextToken( struct import *import );
+static bool isPunctuation( struct import *import, const char *text );
+static void expect( struct import *import, const char *text );
+static char *expectId( struct import *import );
+static void parseGraph( struct import *import );
+static void parseStatements( struct import *import, size_t cluster );
+static void parseStatement( struct import *import, size_t cluster );
+static void parseSubgraph( struct import *import, size_t cluster );
+static void parseNode( struct import *import, char *name, size_t cluster );
+static void parseEdges( struct import *import, char *name );
+static size_t parseAttributes( struct import *import,
+      struct attribute **attributes );
+static void freeAttributes( struct attribute *attributes,
+      size_t numAttributes );
+
+static size_t findState( struct import *import, const char *name );
+static size_t addState( struct import *import, char *name );
+static size_t addEvent( struct import *import, const char *name );
+static void addEventList( struct import *import, const char *list,
+      size_t **events, size_t *numEvents );
+
+static bool isIdentifier( const char *name );
+
+static void layOut( struct import *import );
+static void place( struct import *import, size_t index );
+static void findInitialStates( struct import *import, size_t *initial,
+      size_t *error );
+
+static struct compiledStateMachine *compileImport( struct import *import );
+static void reportError( enum stateM_definitionErrors error,
+      struct state *state, struct transition *transition, void *userData );
+static bool dummyGuard( void *condition, struct event *event );
+
+static void writeHeader( struct import *import, FILE *file,
+      const char *headerName );
+static void writeSource( struct import *import, FILE *file,
+      const char *headerName, struct compiledStateMachine *compiled );
+static void writePrototypes( struct import *import, FILE *file );
+static bool isNewName( char ***names, size_t *numNames, const char *name );
+static void writeStateRef( struct import *import, FILE *file,
+      struct state *state );
+static void writeTransitionRef( struct import *import, FILE *file,
+      struct transition *transition );
+
+int main( int argc, char **argv )
+{
+   struct import import = { .line = 1 };
+   int arg = 1;
+
+   if ( argc == 6 && !strcmp( argv[ 1 ], "-p" ) )
+   {
+      import.prefix = argv[ 2 ];
+      arg = 3;
+   }
+   else if ( argc != 4 )
+   {
+      fprintf( stderr, "Usage: %s [-p prefix] input.dot output.c output.h\n",
+            argv[ 0 ] );
+      return EXIT_FAILURE;
+   }
+
+   import.fileName = argv[ arg ];
+   import.input = readFile( import.fileName );
+   import.cursor = import.input;
+
+   nextToken( &import );
+   parseGraph( &import );
+
+   if ( !import.prefix )
+   {
+      fputs( "A graph name or a prefix (-p) is required\n", stderr );
+      return EXIT_FAILURE;
+   }
+
+   layOut( &import );
+
+   struct compiledStateMachine *compiled = compileImport( &import );
+
+   FILE *source = fopen( argv[ arg + 1 ], "w" );
+   FILE *header = fopen( argv[ arg + 2 ], "w" );
+   if ( !source || !header )
+   {
+      perror( "Could not open output file" );
+      return EXIT_FAILURE;
+   }
+
+   /* Include the header by its base name: */
+   const char *headerName = strrchr( argv[ arg + 2 ], '/' );
+   headerName = headerName ? headerName + 1 : argv[ arg + 2 ];
+
+   writeHeader( &import, header, headerName );
+   writeSource( &import, source, headerName, compiled );
+
+   if ( fclose( source ) || fclose( header ) )
+   {
+      perror( "Could not write output file" );
+      return EXIT_FAILURE;
+   }
+
+   return EXIT_SUCCESS;
+}
+
+static void fail( struct import *import, int line, const char *format,
+      ... )
+{
+   va_list args;
+
+   fprintf( stderr, "%s:%d: ", import->fileName, line );
+   va_start( args, format );
+   vfprintf( stderr, format, args );
+   va_end( args );
+   fputc( '\n', stderr );
+
+   exit( EXIT_FAILURE );
+}
+
+static void *allocate( size_t size )
+{
+   void *memory = calloc( 1, size ? size : 1 );
+
+   if ( !memory )
+   {
+      fputs( "Out of memory\n", stderr );
+      exit( EXIT_FAILURE );
+   }
+
+   return memory;
+}
+
+static void *grow( void *array, size_t count, size_t size )
+{
+   /* Grow the array when count reaches a power of two: */
+   if ( count & ( count - 1 ) )
+      return array;
+
+   array = realloc( array, ( count ? count * 2 : 1 ) * size );
+   if ( !array )
+   {
+      fputs( "Out of memory\n", stderr );
+      exit( EXIT_FAILURE );
+   }
+
+   return array;
+}
+
+static char *duplicate( const char *text, size_t length )
+{
+   char *copy = allocate( length + 1 );
+
+   memcpy( copy, text, length );
+   return copy;
+}
+
+static char *readFile( const char *fileName )
+{
+   FILE *file = fopen( fileName, "r" );
+   char *contents = NULL;
+   size_t length = 0;
+   int ch;
+
+   if ( !file )
+   {
+      perror( fileName );
+      exit( EXIT_FAILURE );
+   }
+
+   while ( ( ch = fgetc( file ) ) != EOF )
+   {
+      contents = grow( contents, length, 1 );
+      contents[ length++ ] = (char)ch;
+   }
+   fclose( file );
+
+   contents = grow( contents, length, 1 );
+   contents[ length ] = '\0';
+   return contents;
+}
+
+static void nextToken( struct import *import )
+{
+   char *cursor = import->cursor;
+
+   /* Skip white space and comments: */
+   for ( ;; )
+   {
+      if ( *cursor == '\n' )
+         ++import->line;
+
+      if ( isspace( (unsigned char)*cursor ) )
+         ++cursor;
+      else if ( cursor[ 0 ] == '/' && cursor[ 1 ] == '/' )
+         cursor += strcspn( cursor, "\n" );
+      else if ( *cursor == '#' && ( cursor == import->input || cursor[ -1 ]
+               == '\n' ) )
+         cursor += strcspn( cursor, "\n" );
+      else if ( cursor[ 0 ] == '/' && cursor[ 1 ] == '*' )
+      {
+         for ( cursor += 2; *cursor && !( cursor[ 0 ] == '*' && cursor[ 1 ]
+                  == '/' ); ++cursor )
+            if ( *cursor == '\n' )
+               ++import->line;
+
+         if ( !*cursor )
+            fail( import, import->line, "Unterminated comment" );
+
+         cursor += 2;
+      }
+      else
+         break;
+   }
+
+   import->token.line = import->line;
+   free( import->token.text );
+   import->token.text = NULL;
+
+   if ( !*cursor )
+      import->token.type = Token_end;
+   else if ( isalnum( (unsigned char)*cursor ) || *cursor == '_' || *cursor
+         == '.' || ( *cursor == '-' && isdigit( (unsigned char)cursor[ 1 ] ) ) )
+   {
+      char *start = cursor++;
+
+      while ( isalnum( (unsigned char)*cursor ) || *cursor == '_' || *cursor
+            == '.' )
+         ++cursor;
+
+      import->token.type = Token_id;
+      import->token.text = duplicate( start, cursor - start );
+   }
+   else if ( *cursor == '"' )
+   {
+      char *text = allocate( strlen( cursor ) );
+      size_t length = 0;
+
+      /* Only \" is an escape sequence in DOT. Other backslashes are kept: */
+      for ( ++cursor; *cursor != '"'; ++cursor )
+      {
+         if ( !*cursor )
+            fail( import, import->token.line, "Unterminated string" );
+
+         if ( *cursor == '\n' )
+            ++import->line;
+
+         if ( cursor[ 0 ] == '\\' && cursor[ 1 ] == '"' )
+            ++cursor;
+
+         text[ length++ ] = *cursor;
+      }
+      ++cursor;
+
+      import->token.type = Token_string;
+      import->token.text = text;
+   }
+   else if ( cursor[ 0 ] == '-' && cursor[ 1 ] == '>' )
+   {
+      import->token.type = Token_punctuation;
+      import->token.text = duplicate( cursor, 2 );
+      cursor += 2;
+   }
+   else if ( strchr( "{}[]=;,", *cursor ) )
+   {
+      import->token.type = Token_punctuation;
+      import->token.text = duplicate( cursor++, 1 );
+   }
+   else
+      fail( import, import->line, "Unexpected character '%c'", *cursor );
+
+   import->cursor = cursor;
+}
+
+static bool isPunctuation( struct import *import, const char *text )
+{
+   return import->token.type == Token_punctuation && !strcmp(
+         import->token.text, text );
+}
+
+static void expect( struct import *import, const char *text )
+{
+   if ( !isPunctuation( import, text ) )
+      fail( import, import->token.line, "Expected '%s'", text );
+
+   nextToken( import );
+}
+
+static char *expectId( struct import *import )
+{
+   if ( import->token.type != Token_id && import->token.type !=
+         Token_string )
+      fail( import, import->token.line, "Expected an identifier" );
+
+   char *id = import->token.text;
+   import->token.text = NULL;
+   nextToken( import );
+
+   return id;
+}
+
+static void parseGraph( struct import *import )
+{
+   if ( import->token.type == Token_id && !strcmp( import->token.text,
+            "strict" ) )
+      nextToken( import );
+
+   if ( import->token.type != Token_id || strcmp( import->token.text,
+            "digraph" ) )
+      fail( import, import->token.line, "Expected 'digraph'" );
+
+   nextToken( import );
+
+   if ( !isPunctuation( import, "{" ) )
+   {
+      char *name = expectId( import );
+
+      if ( !import->prefix )
+         import->prefix = name;
+   }
+
+   expect( import, "{" );
+   parseStatements( import, NONE );
+   expect( import, "}" );
+
+   if ( import->token.type != Token_end )
+      fail( import, import->token.line, "Expected end of file" );
+
+   if ( !import->initialState )
+      fail( import, import->line, "No initial state given" );
+
+   if ( !import->errorState )
+      fail( import, import->line, "No error state given" );
+}
+
+static void parseStatements( struct import *import, size_t cluster )
+{
+   while ( !isPunctuation( import, "}" ) )
+   {
+      if ( import->token.type == Token_end )
+         fail( import, import->token.line, "Expected '}'" );
+
+      parseStatement( import, cluster );
+
+      if ( isPunctuation( import, ";" ) )
+         nextToken( import );
+   }
+}
+
+static void parseStatement( struct import *import, size_t cluster )
+{
+   if ( import->token.type == Token_id && !strcmp( import->token.text,
+            "subgraph" ) )
+   {
+      nextToken( import );
+      parseSubgraph( import, cluster );
+      return;
+   }
+
+   if ( isPunctuation( import, "{" ) )
+   {
+      parseSubgraph( import, cluster );
+      return;
+   }
+
+   char *name = expectId( import );
+
+   if ( !strcmp( name, "graph" ) || !strcmp( name, "node" ) || !strcmp(
+            name, "edge" ) )
+   {
+      struct attribute *attributes;
+
+      /* Default attributes are ignored: */
+      freeAttributes( attributes, parseAttributes( import, &attributes ) );
+      free( name );
+   }
+   else if ( isPunctuation( import, "=" ) )
+   {
+      nextToken( import );
+      char *value = expectId( import );
+
+      if ( cluster != NONE && !strcmp( name, "entry" ) )
+         import->states[ cluster ].entry = addState( import, value );
+      else if ( cluster == NONE && !strcmp( name, "initial" ) )
+         import->initialState = value;
+      else if ( cluster == NONE && !strcmp( name, "error" ) )
+         import->errorState = value;
+      else if ( cluster == NONE && !strcmp( name, "events" ) )
+      {
+         addEventList( import, value, NULL, NULL );
+         free( value );
+      }
+      else
+         free( value );
+
+      free( name );
+   }
+   else if ( isPunctuation( import, "->" ) )
+      parseEdges( import, name );
+   else
+      parseNode( import, name, cluster );
+}
+
+static void parseSubgraph( struct import *import, size_t cluster )
+{
+   char *name = NULL;
+
+   if ( !isPunctuation( import, "{" ) )
+      name = expectId( import );
+
+   /* Only clusters introduce parent states. Other subgraphs are merely
+    * groups of statements: */
+   if ( name && !strncmp( name, "cluster_", 8 ) )
+   {
+      size_t parent = addState( import, duplicate( name + 8, strlen( name
+                  + 8 ) ) );
+
+      if ( import->states[ parent ].parent == NONE && cluster != NONE )
+         import->states[ parent ].parent = cluster;
+
+      cluster = parent;
+   }
+   free( name );
+
+   expect( import, "{" );
+   parseStatements( import, cluster );
+   expect( import, "}" );
+}
+
+static void parseNode( struct import *import, char *name, size_t cluster )
+{
+   int line = import->token.line;
+   size_t index = addState( import, name );
+   struct importedState *state = &import->states[ index ];
+   size_t i;
+
+   if ( cluster != NONE )
+   {
+      if ( state->parent != NONE && state->parent != cluster )
+         fail( import, line, "State '%s' declared in two clusters",
+               state->name );
+
+      if ( index == cluster )
+         fail( import, line, "State '%s' declared in its own cluster",
+               state->name );
+
+      state->parent = cluster;
+   }
+
+   struct attribute *attributes;
+   size_t numAttributes = parseAttributes( import, &attributes );
+
+   for ( i = 0; i < numAttributes; ++i )
+   {
+      char *key = attributes[ i ].key;
+      char **field = NULL;
+
+      if ( !strcmp( key, "data" ) )
+         field = &state->data;
+      else if ( !strcmp( key, "entryAction" ) )
+         field = &state->entryAction;
+      else if ( !strcmp( key, "exitAction" ) )
+         field = &state->exitAction;
+      else if ( !strcmp( key, "defer" ) )
+         addEventList( import, attributes[ i ].value, &state->deferredEvents,
+               &state->numDeferredEvents );
+
+      if ( field )
+      {
+         free( *field );
+         *field = attributes[ i ].value;
+         attributes[ i ].value = NULL;
+      }
+   }
+
+   freeAttributes( attributes, numAttributes );
+}
+
+static void parseEdges( struct import *import, char *name )
+{
+   size_t firstTransition = import->numTransitions;
+   size_t source = addState( import, name );
+   size_t i, j;
+
+   /* An edge statement may be a chain: a -> b -> c */
+   while ( isPunctuation( import, "->" ) )
+   {
+      int line = import->token.line;
+
+      nextToken( import );
+      size_t target = addState( import, expectId( import ) );
+
+      import->transitions = grow( import->transitions,
+            import->numTransitions, sizeof( *import->transitions ) );
+      import->transitions[ import->numTransitions++ ] = (struct
+            importedTransition){
+         .source = source,
+         .target = target,
+         .event = NONE,
+         .weight = 1,
+         .line = line,
+      };
+
+      source = target;
+   }
+
+   struct attribute *attributes;
+   size_t numAttributes = parseAttributes( import, &attributes );
+
+   for ( i = firstTransition; i < import->numTransitions; ++i )
+   {
+      struct importedTransition *transition = &import->transitions[ i ];
+
+      for ( j = 0; j < numAttributes; ++j )
+      {
+         char *key = attributes[ j ].key;
+         char *value = attributes[ j ].value;
+         char **field = NULL;
+
+         if ( !strcmp( key, "event" ) )
+            transition->event = addEvent( import, value );
+         else if ( !strcmp( key, "guard" ) )
+            field = &transition->guard;
+         else if ( !strcmp( key, "condition" ) )
+            field = &transition->condition;
+         else if ( !strcmp( key, "action" ) )
+            field = &transition->action;
+         else if ( !strcmp( key, "pure" ) )
+            transition->pure = !strcmp( value, "true" );
+         else if ( !strcmp( key, "weight" ) )
+            transition->weight = strtoul( value, NULL, 10 );
+
+         if ( field )
+         {
+            free( *field );
+            *field = duplicate( value, strlen( value ) );
+         }
+      }
+   }
+
+   freeAttributes( attributes, numAttributes );
+
+   for ( i = firstTransition; i < import->numTransitions; ++i )
+      if ( import->transitions[ i ].event == NONE )
+         fail( import, import->transitions[ i ].line,
+               "Transition from '%s' has no event",
+               import->states[ import->transitions[ i ].source ].name );
+}
+
+static size_t parseAttributes( struct import *import,
+      struct attribute **attributes )
+{
+   size_t numAttributes = 0;
+
+   *attributes = NULL;
+
+   /* Attributes may be split into several bracketed lists: */
+   while ( isPunctuation( import, "[" ) )
+   {
+      nextToken( import );
+
+      while ( !isPunctuation( import, "]" ) )
+      {
+         char *key = expectId( import );
+
+         expect( import, "=" );
+         *attributes = grow( *attributes, numAttributes, sizeof(
+                  **attributes ) );
+         ( *attributes )[ numAttributes ].key = key;
+         ( *attributes )[ numAttributes++ ].value = expectId( import );
+
+         if ( isPunctuation( import, "," ) || isPunctuation( import, ";" ) )
+            nextToken( import );
+      }
+
+      nextToken( import );
+   }
+
+   return numAttributes;
+}
+
+static void freeAttributes( struct attribute *attributes,
+      size_t numAttributes )
+{
+   size_t i;
+
+   for ( i = 0; i < numAttributes; ++i )
+   {
+      free( attributes[ i ].key );
+      free( attributes[ i ].value );
+   }
+   free( attributes );
+}
+
+static size_t findState( struct import *import, const char *name )
+{
+   size_t i;
+
+   for ( i = 0; i < import->numStates; ++i )
+      if ( !strcmp( import->states[ i ].name, name ) )
+         return i;
+
+   return NONE;
+}
+
+static size_t addState( struct import *import, char *name )
+{
+   size_t index = findState( import, name );
+
+   if ( index != NONE )
+   {
+      free( name );
+      return index;
+   }
+
+   if ( !isIdentifier( name ) )
+      fail( import, import->token.line, "'%s' is not a valid state name",
+            name );
+
+   import->states = grow( import->states, import->numStates, sizeof(
+            *import->states ) );
+   import->states[ import->numStates ] = (struct importedState){
+      .name = name,
+      .parent = NONE,
+      .entry = NONE,
+   };
+
+   return import->numStates++;
+}
+
+static size_t addEvent( struct import *import, const char *name )
+{
+   size_t i;
+
+   for ( i = 0; i < import->numEvents; ++i )
+      if ( !strcmp( import->events[ i ], name ) )
+         return i;
+
+   if ( !isIdentifier( name ) )
+      fail( import, import->token.line, "'%s' is not a valid event name",
+            name );
+
+   import->events = grow( import->events, import->numEvents, sizeof(
+            *import->events ) );
+   import->events[ import->numEvents ] = duplicate( name, strlen( name ) );
+
+   return import->numEvents++;
+}
+
+static void addEventList( struct import *import, const char *list,
+      size_t **events, size_t *numEvents )
+{
+   while ( *list )
+   {
+      size_t length = strcspn( list, " \t\n," );
+
+      if ( length )
+      {
+         char *name = duplicate( list, length );
+         size_t event = addEvent( import, name );
+
+         if ( events )
+         {
+            *events = grow( *events, *numEvents, sizeof( **events ) );
+            ( *events )[ ( *numEvents )++ ] = event;
+         }
+         free( name );
+      }
+
+      list += length + !!list[ length ];
+   }
+}
+
+static bool isIdentifier( const char *name )
+{
+   if ( !isalpha( (unsigned char)*name ) && *name != '_' )
+      return false;
+
+   while ( isalnum( (unsigned char)*name ) || *name == '_' )
+      ++name;
+
+   return !*name;
+}
+
+static void layOut( struct import *import )
+{
+   size_t numStates = import->numStates;
+   size_t initial, error;
+   size_t i, j;
+
+   findInitialStates( import, &initial, &error );
+
+   /* Group the transitions by source state (a stable counting sort): */
+   import->firstBySource = allocate( ( numStates + 1 ) * sizeof( size_t ) );
+   import->transitionsBySource = allocate( import->numTransitions * sizeof(
+            size_t ) );
+
+   for ( i = 0; i < import->numTransitions; ++i )
+   {
+      struct importedTransition *transition = &import->transitions[ i ];
+
+      ++import->firstBySource[ transition->source + 1 ];
+      import->states[ transition->target ].heat += transition->weight;
+   }
+
+   for ( i = 0; i < numStates; ++i )
+      import->firstBySource[ i + 1 ] += import->firstBySource[ i ];
+
+   size_t *next = allocate( numStates * sizeof( size_t ) );
+   memcpy( next, import->firstBySource, numStates * sizeof( size_t ) );
+   for ( i = 0; i < import->numTransitions; ++i )
+      import->transitionsBySource[ next[ import->transitions[ i ].source
+         ]++ ] = i;
+   free( next );
+
+   import->layout = allocate( numStates * sizeof( size_t ) );
+   for ( i = 0; i < numStates; ++i )
+      import->states[ i ].order = NONE;
+
+   /* Everything reachable from the initial state comes first. The
+    * remaining states follow, hottest first, and the error state last: */
+   place( import, initial );
+
+   size_t *remaining = allocate( numStates * sizeof( size_t ) );
+   size_t numRemaining = 0;
+   for ( i = 0; i < numStates; ++i )
+   {
+      if ( import->states[ i ].order != NONE || i == error )
+         continue;
+
+      for ( j = numRemaining; j > 0 && import->states[ remaining[ j - 1 ]
+            ].heat < import->states[ i ].heat; --j )
+         remaining[ j ] = remaining[ j - 1 ];
+
+      remaining[ j ] = i;
+      ++numRemaining;
+   }
+
+   for ( i = 0; i < numRemaining; ++i )
+      place( import, remaining[ i ] );
+   free( remaining );
+
+   place( import, error );
+}
+
+static void place( struct import *import, size_t index )
+{
+   struct importedState *state = &import->states[ index ];
+   size_t first = import->firstBySource[ index ];
+   size_t count = import->firstBySource[ index + 1 ] - first;
+   size_t i, j;
+
+   if ( state->order != NONE )
+      return;
+
+   /* The parent states are searched for transitions on every event
+    * handled in this state, so place them before it: */
+   if ( state->parent != NONE )
+   {
+      place( import, state->parent );
+
+      if ( state->order != NONE )
+         return;
+   }
+
+   state->order = import->numPlaced;
+   import->layout[ import->numPlaced++ ] = index;
+
+   if ( state->entry != NONE )
+      place( import, state->entry );
+
+   /* Visit the successors along the most frequent transitions first: */
+   size_t *successors = allocate( count * sizeof( size_t ) );
+   for ( i = 0; i < count; ++i )
+   {
+      struct importedTransition *transition = &import->transitions[
+         import->transitionsBySource[ first + i ] ];
+
+      for ( j = i; j > 0 && import->transitions[ successors[ j - 1 ]
+            ].weight < transition->weight; --j )
+         successors[ j ] = successors[ j - 1 ];
+
+      successors[ j ] = import->transitionsBySource[ first + i ];
+   }
+
+   for ( i = 0; i < count; ++i )
+      place( import, import->transitions[ successors[ i ] ].target );
+   free( successors );
+}
+
+static void findInitialStates( struct import *import, size_t *initial,
+      size_t *error )
+{
+   *initial = findState( import, import->initialState );
+   *error = findState( import, import->errorState );
+
+   if ( *initial == NONE )
+      fail( import, import->line, "Unknown initial state '%s'",
+            import->initialState );
+
+   if ( *error == NONE )
+      fail( import, import->line, "Unknown error state '%s'",
+            import->errorState );
+}
+
+static struct compiledStateMachine *compileImport( struct import *import )
+{
+   size_t numStates = import->numStates;
+   size_t numTransitions = import->numTransitions;
+   size_t numBuilt = 0;
+   size_t i, j, k;
+
+   import->builtStates = allocate( numStates * sizeof( struct state ) );
+   import->builtTransitions = allocate( numTransitions * sizeof(
+            struct transition ) );
+   import->builtTransitionSources = allocate( numTransitions * sizeof(
+            size_t ) );
+   import->definition.states = allocate( numStates * sizeof(
+            struct state * ) );
+
+#define BUILT_STATE( index ) ( ( index ) == NONE ? NULL : \
+      &import->builtStates[ import->states[ ( index ) ].order ] )
+
+   for ( i = 0; i < numStates; ++i )
+   {
+      size_t index = import->layout[ i ];
+      struct importedState *imported = &import->states[ index ];
+      struct state *state = &import->builtStates[ i ];
+      size_t first = import->firstBySource[ index ];
+      size_t count = import->firstBySource[ index + 1 ] - first;
+
+      state->parentState = BUILT_STATE( imported->parent );
+      state->entryState = BUILT_STATE( imported->entry );
+      state->transitions = &import->builtTransitions[ numBuilt ];
+      state->numTransitions = count;
+      state->numDeferredEvents = imported->numDeferredEvents;
+      state->deferredEvents = allocate( imported->numDeferredEvents * sizeof(
+               int ) );
+      for ( j = 0; j < imported->numDeferredEvents; ++j )
+         state->deferredEvents[ j ] = (int)imported->deferredEvents[ j ];
+
+      for ( j = 0; j < count; ++j )
+      {
+         size_t source = import->transitionsBySource[ first + j ];
+         struct importedTransition *transition = &import->transitions[
+            source ];
+
+         /* The guards cannot be called while importing. Transitions with
+          * the same guard function and condition share a condition
+          * pointer, so that the validator can detect shadowed transitions:
+          */
+         for ( k = 0; k < j; ++k )
+         {
+            struct importedTransition *earlier = &import->transitions[
+               import->transitionsBySource[ first + k ] ];
+
+            if ( transition->guard && earlier->guard && !strcmp(
+                     transition->guard, earlier->guard ) && (
+                     transition->condition && earlier->condition ? !strcmp(
+                        transition->condition, earlier->condition ) :
+                     transition->condition == earlier->condition ) )
+               break;
+         }
+
+         import->builtTransitions[ numBuilt ] = (struct transition){
+            .eventType = (int)transition->event,
+            .condition = &import->transitions[
+               import->transitionsBySource[ first + k ] ],
+            .guard = transition->guard ? &dummyGuard : NULL,
+            .nextState = BUILT_STATE( transition->target ),
+            .pureGuard = transition->pure,
+         };
+         import->builtTransitionSources[ numBuilt++ ] = source;
+      }
+
+      import->definition.states[ i ] = state;
+   }
+
+   size_t initial, error;
+   findInitialStates( import, &initial, &error );
+   import->definition.numStates = numStates;
+   import->definition.initialState = BUILT_STATE( initial );
+   import->definition.errorState = BUILT_STATE( error );
+
+#undef BUILT_STATE
+
+   if ( stateM_validate( &import->definition, &reportError, import ) < 0 )
+   {
+      fputs( "Out of memory\n", stderr );
+      exit( EXIT_FAILURE );
+   }
+
+   if ( import->numErrors )
+      exit( EXIT_FAILURE );
+
+   /* Shadowed transitions are harmless, and are left out when compiled: */
+   import->definition.verified = true;
+
+   struct compiledStateMachine *compiled = stateM_compile(
+         &import->definition );
+   if ( !compiled )
+   {
+      fputs( "Out of memory\n", stderr );
+      exit( EXIT_FAILURE );
+   }
+
+   return compiled;
+}
+
+static void reportError( enum stateM_definitionErrors error,
+      struct state *state, struct transition *transition, void *userData )
+{
+   static const char *messages[] = {
+      [ stateM_missingState ] = "missing state",
+      [ stateM_unknownState ] = "refers to a state not in the definition",
+      [ stateM_nullNextState ] = "transition has no next state",
+      [ stateM_unreachableState ] = "state is unreachable",
+      [ stateM_entryStateCycle ] = "entry states form a cycle",
+      [ stateM_parentStateCycle ] = "parent states form a cycle",
+      [ stateM_shadowedTransition ] = "transition can never be taken",
+      [ stateM_tooManyRegions ] = "too many regions",
+      [ stateM_invalidRegion ] = "invalid region",
+      [ stateM_invalidHistorySlot ] = "invalid history slot",
+      [ stateM_orphanHistoryState ] = "history state has no parent",
+   };
+   struct import *import = userData;
+   const char *severity = "error";
+   int line = import->line;
+
+   if ( error == stateM_shadowedTransition )
+      severity = "warning";
+   else
+      ++import->numErrors;
+
+   if ( transition )
+      line = import->transitions[ import->builtTransitionSources[ transition
+         - import->builtTransitions ] ].line;
+
+   fprintf( stderr, "%s:%d: %s: ", import->fileName, line, severity );
+   if ( state )
+      fprintf( stderr, "'%s': ", import->states[ import->layout[ state -
+            import->builtStates ] ].name );
+   fprintf( stderr, "%s\n", messages[ error ] );
+}
+
+static bool dummyGuard( void *condition, struct event *event )
+{
+   (void)condition;
+   (void)event;
+
+   return false;
+}
+
+static void writeHeader( struct import *import, FILE *file,
+      const char *headerName )
+{
+   size_t i;
+
+   fprintf( file, "/* Generated by stateMachineImport from %s. Do not edit."
+         " */\n\n", import->fileName );
+
+   fputs( "#ifndef ", file );
+   for ( i = 0; headerName[ i ]; ++i )
+      fputc( isalnum( (unsigned char)headerName[ i ] ) ? toupper( (unsigned
+                  char)headerName[ i ] ) : '_', file );
+   fputs( "\n#define ", file );
+   for ( i = 0; headerName[ i ]; ++i )
+      fputc( isalnum( (unsigned char)headerName[ i ] ) ? toupper( (unsigned
+                  char)headerName[ i ] ) : '_', file );
+
+   fputs( "\n\n#include \"stateMachine.h\"\n"
+         "#include \"stateMachineCompile.h\"\n\n", file );
+
+   fprintf( file, "enum %s_events\n{\n", import->prefix );
+   for ( i = 0; i < import->numEvents; ++i )
+      fprintf( file, "   %s,\n", import->events[ i ] );
+   fputs( "};\n\n", file );
+
+   fputs( "/* State ids, in layout order: */\n", file );
+   fprintf( file, "enum %s_states\n{\n", import->prefix );
+   for ( i = 0; i < import->numStates; ++i )
+      fprintf( file, "   %s_%s,\n", import->prefix, import->states[
+            import->layout[ i ] ].name );
+   fputs( "};\n\n", file );
+
+   fprintf( file, "extern struct stateMachineDefinition %s_definition;\n"
+         "extern struct compiledStateMachine %s_compiled;\n\n#endif\n",
+         import->prefix, import->prefix );
+}
+
+static void writeSource( struct import *import, FILE *file,
+      const char *headerName, struct compiledStateMachine *compiled )
+{
+   const char *prefix = import->prefix;
+   size_t numStates = import->numStates;
+   size_t numDeferred = 0;
+   size_t i, j;
+
+   fprintf( file, "/* Generated by stateMachineImport from %s. Do not edit."
+         " */\n\n#include \"%s\"\n#include <stddef.h>\n"
+         "#include <stdint.h>\n\n", import->fileName, headerName );
+
+   writePrototypes( import, file );
+
+   fprintf( file, "static struct state %s_stateStorage[ %zu ];\n\n", prefix,
+         numStates );
+
+   /* Deferred events of all states: */
+   fprintf( file, "static int %s_deferredEvents[] = {\n", prefix );
+   for ( i = 0; i < numStates; ++i )
+   {
+      struct importedState *state = &import->states[ import->layout[ i ] ];
+
+      for ( j = 0; j < state->numDeferredEvents; ++j )
+         fprintf( file, "   %s,\n", import->events[
+               state->deferredEvents[ j ] ] );
+   }
+   fputs( "   /* Never empty: */\n   0,\n};\n\n", file );
+
+   fprintf( file, "static struct transition %s_transitions[] = {\n",
+         prefix );
+   for ( i = 0; i < import->numTransitions; ++i )
+   {
+      struct importedTransition *transition = &import->transitions[
+         import->builtTransitionSources[ i ] ];
+      struct transition *built = &import->builtTransitions[ i ];
+
+      if ( !i || transition->source != import->transitions[
+            import->builtTransitionSources[ i - 1 ] ].source )
+         fprintf( file, "   /* %s: */\n", import->states[
+               transition->source ].name );
+
+      fprintf( file, "   { %s, %s, %s%s, %s%s, ", import->events[
+            transition->event ], transition->condition ?
+            transition->condition : "NULL", transition->guard ? "&" : "",
+            transition->guard ? transition->guard : "NULL",
+            transition->action ? "&" : "", transition->action ?
+            transition->action : "NULL" );
+      writeStateRef( import, file, built->nextState );
+      fprintf( file, ", stateM_guardFunction, %s },\n", transition->pure ?
+            "true" : "false" );
+   }
+   fputs( "   /* Never empty: */\n   { 0 },\n};\n\n", file );
+
+   fprintf( file, "static struct state %s_stateStorage[ %zu ] = {\n",
+         prefix, numStates );
+   for ( i = 0; i < numStates; ++i )
+   {
+      struct importedState *imported = &import->states[ import->layout[ i ]
+      ];
+      struct state *state = &import->builtStates[ i ];
+
+      fprintf( file, "   [ %s_%s ] = {\n", prefix, imported->name );
+      if ( state->parentState )
+      {
+         fputs( "      .parentState = ", file );
+         writeStateRef( import, file, state->parentState );
+         fputs( ",\n", file );
+      }
+      if ( state->entryState )
+      {
+         fputs( "      .entryState = ", file );
+         writeStateRef( import, file, state->entryState );
+         fputs( ",\n", file );
+      }
+      fprintf( file, "      .transitions = &%s_transitions[ %zu ],\n"
+            "      .numTransitions = %zu,\n", prefix, (size_t)(
+               state->transitions - import->builtTransitions ),
+            state->numTransitions );
+      if ( imported->data )
+         fprintf( file, "      .data = %s,\n", imported->data );
+      if ( imported->entryAction )
+         fprintf( file, "      .entryAction = &%s,\n",
+               imported->entryAction );
+      if ( imported->exitAction )
+         fprintf( file, "      .exitAction = &%s,\n",
+               imported->exitAction );
+      if ( state->numDeferredEvents )
+         fprintf( file, "      .deferredEvents = &%s_deferredEvents[ %zu ],\n"
+               "      .numDeferredEvents = %zu,\n", prefix, numDeferred,
+               state->numDeferredEvents );
+      fprintf( file, "      .id = %s_%s,\n   },\n", prefix, imported->name );
+
+      numDeferred += state->numDeferredEvents;
+   }
+   fputs( "};\n\n", file );
+
+   fprintf( file, "static struct state *%s_states[] = {\n", prefix );
+   for ( i = 0; i < numStates; ++i )
+   {
+      fputs( "   ", file );
+      writeStateRef( import, file, &import->builtStates[ i ] );
+      fputs( ",\n", file );
+   }
+   fputs( "};\n\n", file );
+
+   fprintf( file, "struct stateMachineDefinition %s_definition = {\n"
+         "   .states = %s_states,\n   .numStates = %zu,\n"
+         "   .initialState = ", prefix, prefix, numStates );
+   writeStateRef( import, file, import->definition.initialState );
+   fputs( ",\n   .errorState = ", file );
+   writeStateRef( import, file, import->definition.errorState );
+   fputs( ",\n   .verified = true,\n};\n\n", file );
+
+   /* The compiled dispatch table, as created by stateM_compile(): */
+   size_t numEvents = 0, numGuarded = 0;
+   for ( i = 0; i < numStates; ++i )
+   {
+      struct compiledState *state = &compiled->states[ i ];
+
+      numEvents += state->numEvents;
+      for ( j = 0; j < state->numEvents; ++j )
+         numGuarded += state->events[ j ].numGuarded;
+   }
+
+   fprintf( file, "static struct transition *%s_guardedTransitions[] = {\n",
+         prefix );
+   for ( i = 0; i < numGuarded; ++i )
+   {
+      fputs( "   ", file );
+      writeTransitionRef( import, file, compiled->guardedTransitions[ i ] );
+      fputs( ",\n", file );
+   }
+   fputs( "   /* Never empty: */\n   NULL,\n};\n\n", file );
+
+   fprintf( file, "static struct compiledEventTransitions %s_compiledEvents[]"
+         " = {\n", prefix );
+   for ( i = 0; i < numEvents; ++i )
+   {
+      struct compiledEventTransitions *events = &compiled->events[ i ];
+
+      fprintf( file, "   { %s, %zu, %zu, ", import->events[
+            events->eventType ], events->firstGuarded, events->numGuarded );
+      writeTransitionRef( import, file, events->defaultTransition );
+      fputs( ", NULL, 0 },\n", file );
+   }
+   fputs( "   /* Never empty: */\n   { 0 },\n};\n\n", file );
+
+   fprintf( file, "static uint32_t %s_ancestors[] = {\n", prefix );
+   for ( i = 0; i < numStates; ++i )
+   {
+      fputs( "  ", file );
+      for ( j = 0; j <= compiled->states[ i ].depth; ++j )
+         fprintf( file, " %s_%s,", prefix, import->states[ import->layout[
+               compiled->states[ i ].ancestors[ j ] ] ].name );
+      fputs( "\n", file );
+   }
+   fputs( "   /* Never empty: */\n   0,\n};\n\n", file );
+
+   fprintf( file, "static struct compiledState %s_compiledStates[] = {\n",
+         prefix );
+   for ( i = 0; i < numStates; ++i )
+      fprintf( file, "   [ %s_%s ] = { &%s_compiledEvents[ %zu ], %zu, "
+            "&%s_ancestors[ %zu ], %zu },\n", prefix, import->states[
+            import->layout[ i ] ].name, prefix, (size_t)(
+               compiled->states[ i ].events - compiled->events ),
+            compiled->states[ i ].numEvents, prefix, (size_t)(
+               compiled->states[ i ].ancestors - compiled->ancestors ),
+            compiled->states[ i ].depth );
+   fputs( "};\n\n", file );
+
+   fprintf( file, "static int %s_eventTypes[] = {\n", prefix );
+   for ( i = 0; i < compiled->numEventTypes; ++i )
+      fprintf( file, "   %s,\n", import->events[ compiled->eventTypes[ i ] ] );
+   fputs( "   /* Never empty: */\n   0,\n};\n\n", file );
+
+   fprintf( file, "static uint32_t %s_eventIds[] = {", prefix );
+   for ( i = 0; i < compiled->numEventIdSlots; ++i )
+      fprintf( file, "%s %" PRIu32 ",", i % 16 ? "" : "\n  ",
+            compiled->eventIds[ i ] );
+   fputs( "\n};\n\n", file );
+
+   if ( compiled->eventIdSeeds )
+   {
+      fprintf( file, "static uint32_t %s_eventIdSeeds[] = {", prefix );
+      for ( i = 0; i < compiled->numEventIdSeeds; ++i )
+         fprintf( file, "%s %" PRIu32 "u,", i % 8 ? "" : "\n  ",
+               compiled->eventIdSeeds[ i ] );
+      fputs( "\n};\n\n", file );
+   }
+
+   /* Only one of the event table and the perfect hash's slots is used: */
+   if ( compiled->eventTable )
+   {
+      fprintf( file, "static uint32_t %s_eventTable[] = {\n", prefix );
+      for ( i = 0; i < numStates; ++i )
+      {
+         fputs( "  ", file );
+         for ( j = 0; j < compiled->numEventTypes; ++j )
+            fprintf( file, " %" PRIu32 ",", compiled->eventTable[ i *
+                  compiled->numEventTypes + j ] );
+         fputs( "\n", file );
+      }
+      fputs( "   /* Never empty: */\n   0,\n};\n\n", file );
+   }
+
+   fprintf( file, "static uint32_t %s_eventSeeds[] = {", prefix );
+   for ( i = 0; i < compiled->numEventSeeds; ++i )
+      fprintf( file, "%s %" PRIu32 "u,", i % 8 ? "" : "\n  ",
+            compiled->eventSeeds[ i ] );
+   fputs( "\n   /* Never empty: */\n   0,\n};\n\n", file );
+
+   if ( compiled->eventSlots )
+   {
+      fprintf( file, "static uint16_t %s_eventSlots[] = {", prefix );
+      for ( i = 0; i < compiled->numEventSlots; ++i )
+         fprintf( file, "%s %" PRIu16 ",", i % 16 ? "" : "\n  ",
+               compiled->eventSlots[ i ] );
+      fputs( "\n};\n\n", file );
+   }
+
+   fprintf( file, "struct compiledStateMachine %s_compiled = {\n"
+         "   .definition = &%s_definition,\n"
+         "   .states = %s_compiledStates,\n"
+         "   .events = %s_compiledEvents,\n"
+         "   .guardedTransitions = %s_guardedTransitions,\n"
+         "   .ancestors = %s_ancestors,\n"
+         "   .numEventTypes = %zu,\n"
+         "   .eventTypes = %s_eventTypes,\n"
+         "   .eventIds = %s_eventIds,\n"
+         "   .numEventIdSlots = %zu,\n"
+         "   .minEventType = %d,\n"
+         "   .numEventIdSeeds = %zu,\n"
+         "   .eventIdSeeds = %s%s,\n"
+         "   .eventTable = %s%s,\n"
+         "   .numEventSeeds = %zu,\n"
+         "   .eventSeeds = %s_eventSeeds,\n"
+         "   .numEventSlots = %zu,\n"
+         "   .eventSlots = %s%s,\n};\n", prefix, prefix, prefix, prefix,
+         prefix, prefix, compiled->numEventTypes, prefix, prefix,
+         compiled->numEventIdSlots, compiled->minEventType,
+         compiled->numEventIdSeeds, compiled->eventIdSeeds ? prefix : "NULL",
+         compiled->eventIdSeeds ? "_eventIdSeeds" : "",
+         compiled->eventTable ? prefix : "NULL",
+         compiled->eventTable ? "_eventTable" : "",
+         compiled->numEventSeeds, prefix, compiled->numEventSlots,
+         compiled->eventSlots ? prefix : "NULL",
+         compiled->eventSlots ? "_eventSlots" : "" );
+}
+
+static void writePrototypes( struct import *import, FILE *file )
+{
+   char **names = NULL;
+   size_t numNames = 0;
+   size_t i;
+
+   for ( i = 0; i < import->numTransitions; ++i )
+   {
+      struct importedTransition *transition = &import->transitions[ i ];
+
+      if ( transition->guard && isNewName( &names, &numNames,
+               transition->guard ) )
+         fprintf( file, "bool %s( void *condition, struct event *event );\n",
+               transition->guard );
+
+      if ( transition->action && isNewName( &names, &numNames,
+               transition->action ) )
+         fprintf( file, "void %s( void *currentStateData, struct event "
+               "*event,\n      void *newStateData );\n",
+               transition->action );
+   }
+
+   for ( i = 0; i < import->numStates; ++i )
+   {
+      struct importedState *state = &import->states[ i ];
+
+      if ( state->entryAction && isNewName( &names, &numNames,
+               state->entryAction ) )
+         fprintf( file, "void %s( void *stateData, struct event *event );\n",
+               state->entryAction );
+
+      if ( state->exitAction && isNewName( &names, &numNames,
+               state->exitAction ) )
+         fprintf( file, "void %s( void *stateData, struct event *event );\n",
+               state->exitAction );
+   }
+
+   if ( numNames )
+      fputc( '\n', file );
+
+   free( names );
+}
+
+static bool isNewName( char ***names, size_t *numNames, const char *name )
+{
+   size_t i;
+
+   for ( i = 0; i < *numNames; ++i )
+      if ( !strcmp( ( *names )[ i ], name ) )
+         return false;
+
+   *names = grow( *names, *numNames, sizeof( **names ) );
+   ( *names )[ ( *numNames )++ ] = (char *)name;
+
+   return true;
+}
+
+static void writeStateRef( struct import *import, FILE *file,
+      struct state *state )
+{
+   fprintf( file, "&%s_stateStorage[ %s_%s ]", import->prefix,
+         import->prefix, import->states[ import->layout[ state -
+         import->builtStates ] ].name );
+}
+
+static void writeTransitionRef( struct import *import, FILE *file,
+      struct transition *transition )
+{
+   if ( transition )
+      fprintf( file, "&%s_transitions[ %zu ]", import->prefix,
+            (size_t)( transition - import->builtTransitions ) );
+   else
+      fputs( "NULL", file );
+}